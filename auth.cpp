@@ -0,0 +1,222 @@
+#include "auth.h"
+#include "jam_protocol.h"
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <vector>
+
+static inline uint64_t rotl(uint64_t x, int b) noexcept {
+    return (x << b) | (x >> (64 - b));
+}
+
+struct SipState {
+    uint64_t v0, v1, v2, v3;
+
+    void round() noexcept {
+        v0 += v1; v1 = rotl(v1, 13); v1 ^= v0; v0 = rotl(v0, 32);
+        v2 += v3; v3 = rotl(v3, 16); v3 ^= v2;
+        v0 += v3; v3 = rotl(v3, 21); v3 ^= v0;
+        v2 += v1; v1 = rotl(v1, 17); v1 ^= v2; v2 = rotl(v2, 32);
+    }
+
+    void compress(uint64_t m) noexcept {
+        v3 ^= m;
+        round();
+        round();
+        v0 ^= m;
+    }
+};
+
+// SipHash-2-4 over data fed in pieces, so a MAC can cover a header and a payload without copying
+class SipHasher {
+public:
+    explicit SipHasher(const SipKey& key) noexcept
+        : state_{key.k0 ^ 0x736f6d6570736575ull, key.k1 ^ 0x646f72616e646f6dull,
+                 key.k0 ^ 0x6c7967656e657261ull, key.k1 ^ 0x7465646279746573ull} {}
+
+    void update(const void* data, std::size_t bytes) noexcept {
+        const uint8_t* in = static_cast<const uint8_t*>(data);
+        total_ += bytes;
+        // Work on a local copy: byte loads may alias members, which would keep the state in memory
+        SipState state = state_;
+        uint64_t pending = pending_;
+        std::size_t pending_size = pending_size_;
+        // Whole words, stitched onto whatever an earlier piece left over
+        const unsigned shift = 8 * static_cast<unsigned>(pending_size);
+        for (; bytes >= 8; in += 8, bytes -= 8) {
+            uint64_t word;
+            std::memcpy(&word, in, 8);
+            word = from_le(word);
+            if (shift == 0) {
+                state.compress(word);
+            } else {
+                state.compress(pending | (word << shift));
+                pending = word >> (64 - shift);
+            }
+        }
+        for (; bytes > 0; ++in, --bytes) {
+            pending |= static_cast<uint64_t>(*in) << (8 * pending_size);
+            if (++pending_size == 8) {
+                state.compress(pending);
+                pending = 0;
+                pending_size = 0;
+            }
+        }
+        state_ = state;
+        pending_ = pending;
+        pending_size_ = pending_size;
+    }
+
+    uint64_t finish() noexcept {
+        SipState state = state_;
+        state.compress(pending_ | (static_cast<uint64_t>(total_ & 0xFF) << 56));
+        state.v2 ^= 0xFF;
+        for (int i = 0; i < 4; ++i) state.round();
+        return state.v0 ^ state.v1 ^ state.v2 ^ state.v3;
+    }
+
+private:
+    static uint64_t from_le(uint64_t word) noexcept {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        return __builtin_bswap64(word);
+#else
+        return word;
+#endif
+    }
+
+    SipState state_;
+    uint64_t pending_ = 0; // Bytes not yet compressed, little-endian
+    std::size_t pending_size_ = 0;
+    uint64_t total_ = 0;
+};
+
+static void put_u64(uint8_t* out, uint64_t value) noexcept {
+    for (int i = 0; i < 8; ++i) out[i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+uint64_t Auth::siphash(const SipKey& key, const void* data, std::size_t bytes) noexcept {
+    SipHasher hasher(key);
+    hasher.update(data, bytes);
+    return hasher.finish();
+}
+
+SipKey Auth::room_key(const std::string& password) {
+    std::vector<uint8_t> input(password.begin(), password.end());
+    input.push_back(0); // Domain byte, 0 for k0 and 1 for k1
+    SipKey key{0x6d69646a616d2d31ull, 0x726f6f6d2d6b6579ull}; // "midjam-1", "room-key"
+    for (int i = 0; i < ROOM_KEY_ROUNDS; ++i) {
+        input.back() = 0;
+        uint64_t k0 = siphash(key, input.data(), input.size());
+        input.back() = 1;
+        uint64_t k1 = siphash(key, input.data(), input.size());
+        key = SipKey{k0, k1};
+    }
+    return key;
+}
+
+uint64_t Auth::proof(const SipKey& room, uint64_t client_nonce, uint64_t server_nonce, const std::string& nickname) noexcept {
+    uint8_t nonces[2 * NONCE_SIZE];
+    put_u64(nonces, client_nonce);
+    put_u64(nonces + NONCE_SIZE, server_nonce);
+    SipHasher hasher(room);
+    hasher.update(AUTH_TAG, 4);
+    hasher.update(nonces, sizeof(nonces));
+    hasher.update(nickname.data(), nickname.size());
+    return hasher.finish();
+}
+
+uint64_t Auth::gone_proof(const SipKey& room, uint64_t session_token) noexcept {
+    uint8_t token[8];
+    put_u64(token, session_token);
+    SipHasher hasher(room);
+    hasher.update("GONE", 4);
+    hasher.update(token, sizeof(token));
+    return hasher.finish();
+}
+
+SipKey Auth::session_key(const SipKey& room, uint64_t client_nonce, uint64_t server_nonce, char direction) noexcept {
+    uint8_t input[2 * NONCE_SIZE + 2];
+    put_u64(input, client_nonce);
+    put_u64(input + NONCE_SIZE, server_nonce);
+    input[2 * NONCE_SIZE] = static_cast<uint8_t>(direction);
+    input[2 * NONCE_SIZE + 1] = 0;
+    uint64_t k0 = siphash(room, input, sizeof(input));
+    input[2 * NONCE_SIZE + 1] = 1;
+    uint64_t k1 = siphash(room, input, sizeof(input));
+    return SipKey{k0, k1};
+}
+
+uint64_t Auth::random_u64() {
+    static std::mutex mutex;
+    static std::random_device device;
+    std::lock_guard<std::mutex> lock(mutex);
+    return (static_cast<uint64_t>(device()) << 32) ^ device();
+}
+
+bool Auth::equal(uint64_t a, uint64_t b) noexcept {
+    volatile uint64_t difference = a ^ b;
+    return difference == 0;
+}
+
+PacketAuth::PacketAuth(const SipKey& send_key, const SipKey& receive_key) noexcept
+    : enabled_(true), send_key_(send_key), receive_key_(receive_key) {}
+
+PacketAuth::PacketAuth(const PacketAuth& other) noexcept {
+    *this = other;
+}
+
+PacketAuth& PacketAuth::operator=(const PacketAuth& other) noexcept {
+    enabled_ = other.enabled_;
+    send_key_ = other.send_key_;
+    receive_key_ = other.receive_key_;
+    send_sequence_.store(other.send_sequence_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    highest_received_ = other.highest_received_;
+    received_window_ = other.received_window_;
+    return *this;
+}
+
+PacketAuth::State PacketAuth::state() const noexcept {
+    return State{send_key_, receive_key_, send_sequence_.load(std::memory_order_relaxed), highest_received_, received_window_};
+}
+
+PacketAuth::PacketAuth(const State& state) noexcept
+    : enabled_(true), send_key_(state.send_key), receive_key_(state.receive_key), send_sequence_(state.send_sequence),
+      highest_received_(state.highest_received), received_window_(state.received_window) {}
+
+uint64_t PacketAuth::mac(const SipKey& key, uint32_t sequence, const char* data, std::size_t bytes) const noexcept {
+    uint8_t header[4] = {static_cast<uint8_t>(sequence), static_cast<uint8_t>(sequence >> 8),
+                         static_cast<uint8_t>(sequence >> 16), static_cast<uint8_t>(sequence >> 24)};
+    SipHasher hasher(key);
+    hasher.update(header, sizeof(header));
+    hasher.update(data, bytes);
+    return hasher.finish();
+}
+
+void PacketAuth::seal(const char* data, std::size_t bytes, char* trailer) noexcept {
+    uint32_t sequence = send_sequence_.fetch_add(1, std::memory_order_relaxed) + 1;
+    for (int i = 0; i < 4; ++i) trailer[i] = static_cast<char>(sequence >> (8 * i));
+    JamProtocol::write_i64(trailer + 4, static_cast<int64_t>(mac(send_key_, sequence, data, bytes)));
+}
+
+bool PacketAuth::open(const char* data, std::size_t& bytes) noexcept {
+    if (bytes < TRAILER_SIZE) return false;
+    std::size_t payload = bytes - TRAILER_SIZE;
+    const char* trailer = data + payload;
+    uint32_t sequence = 0;
+    for (int i = 0; i < 4; ++i) sequence |= static_cast<uint32_t>(static_cast<uint8_t>(trailer[i])) << (8 * i);
+    uint64_t expected = mac(receive_key_, sequence, data, payload);
+    if (!Auth::equal(expected, static_cast<uint64_t>(JamProtocol::read_i64(trailer + 4)))) return false;
+
+    // 64-packet sliding window, as in IPsec: UDP may reorder, but never twice the same sequence
+    if (sequence > highest_received_) {
+        uint32_t shift = sequence - highest_received_;
+        received_window_ = shift >= 64 ? 1 : (received_window_ << shift) | 1;
+        highest_received_ = sequence;
+    } else {
+        uint32_t age = highest_received_ - sequence;
+        if (age >= 64 || (received_window_ & (1ull << age))) return false;
+        received_window_ |= 1ull << age;
+    }
+    bytes = payload;
+    return true;
+}
@@ -0,0 +1,93 @@
+#ifndef AUTH_H
+#define AUTH_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+// Optional room password. Joining is a challenge/response (JOIN -> CHAL -> AUTH -> ACK)
+// that proves knowledge of the password without sending it and derives per-session
+// keys from both sides' nonces. Afterwards every datagram in either direction carries
+// a trailer with a sequence number and a SipHash-2-4 MAC over both, so spoofed or
+// replayed packets (notes, QUIT...) are dropped before they are parsed.
+struct SipKey {
+    uint64_t k0 = 0;
+    uint64_t k1 = 0;
+};
+
+class Auth {
+public:
+    static constexpr std::size_t NONCE_SIZE = 8;
+    static constexpr std::size_t MAC_SIZE = 8;
+
+    // JOIN: tag + client nonce + nickname
+    static constexpr const char* JOIN_TAG = "JOIN";
+    static constexpr std::size_t JOIN_HEADER_SIZE = 4 + NONCE_SIZE;
+    // CHAL: tag + client nonce + server nonce
+    static constexpr const char* CHALLENGE_TAG = "CHAL";
+    static constexpr std::size_t CHALLENGE_SIZE = 4 + 2 * NONCE_SIZE;
+    // AUTH: tag + client nonce + server nonce + proof + nickname
+    static constexpr const char* AUTH_TAG = "AUTH";
+    static constexpr std::size_t AUTH_HEADER_SIZE = 4 + 2 * NONCE_SIZE + MAC_SIZE;
+    // DENY: wrong password
+    static constexpr const char* DENY_TAG = "DENY";
+
+    static constexpr int ROOM_KEY_ROUNDS = 65536; // Slows down offline guessing from a captured AUTH
+
+    static uint64_t siphash(const SipKey& key, const void* data, std::size_t bytes) noexcept;
+
+    static SipKey room_key(const std::string& password);
+    static uint64_t proof(const SipKey& room, uint64_t client_nonce, uint64_t server_nonce, const std::string& nickname) noexcept;
+    // GONE in password rooms: the server knows the room key and answers for this token
+    static uint64_t gone_proof(const SipKey& room, uint64_t session_token) noexcept;
+    // `direction` is 'c' for client -> server and 's' for server -> client
+    static SipKey session_key(const SipKey& room, uint64_t client_nonce, uint64_t server_nonce, char direction) noexcept;
+
+    static uint64_t random_u64();
+    static bool equal(uint64_t a, uint64_t b) noexcept; // Without an early exit
+};
+
+// One end of an authenticated session: seals outgoing datagrams and opens incoming ones.
+// Disabled (the default) means plain datagrams both ways.
+class PacketAuth {
+public:
+    static constexpr std::size_t TRAILER_SIZE = 4 + Auth::MAC_SIZE; // Sequence + MAC
+
+    PacketAuth() = default;
+    PacketAuth(const SipKey& send_key, const SipKey& receive_key) noexcept;
+    PacketAuth(const PacketAuth& other) noexcept;
+    PacketAuth& operator=(const PacketAuth& other) noexcept;
+
+    bool enabled() const noexcept { return enabled_; }
+
+    // Everything needed to carry a session over to another process (hot restart)
+    struct State {
+        SipKey send_key;
+        SipKey receive_key;
+        uint32_t send_sequence = 0;
+        uint32_t highest_received = 0;
+        uint64_t received_window = 0;
+    };
+    State state() const noexcept;
+    explicit PacketAuth(const State& state) noexcept;
+
+    // Writes TRAILER_SIZE bytes for `data` to `trailer`. Safe to call from several threads.
+    void seal(const char* data, std::size_t bytes, char* trailer) noexcept;
+    // Checks and strips the trailer, rejecting forgeries and replays; `bytes` shrinks on success.
+    // Single reader only.
+    bool open(const char* data, std::size_t& bytes) noexcept;
+
+private:
+    uint64_t mac(const SipKey& key, uint32_t sequence, const char* data, std::size_t bytes) const noexcept;
+
+    bool enabled_ = false;
+    SipKey send_key_;
+    SipKey receive_key_;
+    std::atomic<uint32_t> send_sequence_{0};
+    uint32_t highest_received_ = 0;
+    uint64_t received_window_ = 0; // Bit i: highest_received_ - i was seen
+};
+
+#endif
@@ -0,0 +1,80 @@
+// Loopback load for the server's datagram path: N players join an open room and each
+// plays `rate` notes per second for `seconds`; every note fans out to the other N - 1.
+// Prints how many fanned-out notes arrived. Run it against a server started with
+// -io asio and then -io uring, and compare the server's CPU time and
+// midijam_send_errors_total / midijam_*_drops_total on its metrics port.
+//
+//   udp_fanout_load [clients] [rate] [seconds] [server ip] [server port]
+#include <boost/asio.hpp>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using boost::asio::ip::udp;
+
+int main(int argc, char* argv[]) {
+    int clients = argc > 1 ? std::atoi(argv[1]) : 32;
+    int rate = argc > 2 ? std::atoi(argv[2]) : 200;
+    int seconds = argc > 3 ? std::atoi(argv[3]) : 8;
+    std::string host = argc > 4 ? argv[4] : "127.0.0.1";
+    int port = argc > 5 ? std::atoi(argv[5]) : 5000;
+    if (clients < 2 || rate < 1 || seconds < 1 || port < 1 || port > 65535) {
+        std::fprintf(stderr, "usage: udp_fanout_load [clients >= 2] [rate] [seconds] [server ip] [server port]\n");
+        return 1;
+    }
+
+    boost::asio::io_context io;
+    udp::endpoint server(boost::asio::ip::make_address(host), static_cast<unsigned short>(port));
+    std::vector<std::unique_ptr<udp::socket>> sockets;
+    for (int i = 0; i < clients; ++i) {
+        auto socket = std::make_unique<udp::socket>(io, udp::endpoint(udp::v4(), 0));
+        socket->set_option(boost::asio::socket_base::receive_buffer_size(4 << 20));
+        socket->non_blocking(true);
+        std::string nickname = "load" + std::to_string(i);
+        socket->send_to(boost::asio::buffer(nickname), server);
+        sockets.push_back(std::move(socket));
+    }
+
+    std::array<char, 2048> buffer;
+    long received = 0;
+    auto drain = [&]() {
+        boost::system::error_code ec;
+        for (auto& socket : sockets) {
+            udp::endpoint from;
+            while (socket->receive_from(boost::asio::buffer(buffer), from, 0, ec) > 0 && !ec) {
+                if (static_cast<uint8_t>(buffer[0]) == 0x90) ++received; // Only notes; PING, TMPO and CLIST too arrive here
+            }
+        }
+    };
+    std::this_thread::sleep_for(std::chrono::milliseconds(500)); // ACKs, client lists, clock sync
+    drain();
+    received = 0;
+
+    long sent = 0;
+    auto start = std::chrono::steady_clock::now();
+    auto interval = std::chrono::nanoseconds(1000000000L / rate);
+    auto next = start;
+    while (std::chrono::steady_clock::now() - start < std::chrono::seconds(seconds)) {
+        for (auto& socket : sockets) {
+            unsigned char note[3] = {0x90, static_cast<unsigned char>(sent & 0x7F), 100};
+            boost::system::error_code ec;
+            socket->send_to(boost::asio::buffer(note), server, 0, ec);
+            if (!ec) ++sent;
+        }
+        next += interval;
+        while (std::chrono::steady_clock::now() < next) drain();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(300)); // Let the last fan-out land
+    drain();
+    for (auto& socket : sockets) socket->send_to(boost::asio::buffer("QUIT", 4), server);
+
+    long expected = sent * (clients - 1);
+    std::printf("%d clients x %d notes/s for %d s: sent %ld, received %ld of %ld (%.2f%%)\n",
+                clients, rate, seconds, sent, received, expected, expected ? 100.0 * received / expected : 0.0);
+    return 0;
+}
@@ -2,16 +2,33 @@
 #include <boost/asio.hpp>
 #include <boost/beast.hpp>
 #include "RtMidi.h"
-#include "midi_utils.h"
+#include "midi_port_pool.h"
+#include "jam_protocol.h"
+#include "clock_sync.h"
+#include "tempo_clock.h"
+#include "midi_message.h"
+#include "midi_transform.h"
+#include "subscription.h"
+#include "ump.h"
+#include "auth.h"
+#include "probe_stats.h"
+#include "trace.h"
+#include "embedded_assets.h"
 #include <iostream>
-#include <fstream>
 #include <thread>
 #include <csignal>
 #include <memory>
-#include <filesystem>
 #include <mutex>
 #include <chrono>
 #include <algorithm>
+#include <deque>
+#include <unordered_map>
+#include <condition_variable>
+#include <future>
+#include <atomic>
+#include <map>
+#include <random>
+#include <functional>
 using boost::asio::ip::udp;
 namespace beast = boost::beast;
 namespace http = beast::http;
@@ -41,194 +58,461 @@ public:
 };
 static Logger logger;
 
-class MidiJamClient {
+// "ip:port", for logs and status
+static std::string endpoint_name(const udp::endpoint& endpoint) {
+    return endpoint.address().to_string() + ":" + std::to_string(endpoint.port());
+}
+
+// Measures candidate servers with bursts of timestamped PROB echoes, all candidates at
+// once, from a socket of its own so probes never mix with a session's traffic. Probing
+// runs on the network thread; results() may be read from any thread.
+class ServerProber : public std::enable_shared_from_this<ServerProber> {
+public:
+    static constexpr std::size_t MAX_CANDIDATES = 16;
+    static constexpr int BURST = 5; // Probes per candidate and burst
+    static constexpr auto BURST_SPACING = std::chrono::milliseconds(20);
+    static constexpr auto REPLY_TIMEOUT = std::chrono::milliseconds(500); // After the last probe of a burst
+
+    struct Result {
+        std::string server; // "ip:port"
+        bool answering = false; // Replied during the last burst
+        int64_t rtt_ns = -1;
+        int64_t jitter_ns = 0;
+        double loss = 0.0;
+        int64_t score_ns = ProbeStats::UNREACHABLE;
+    };
+
+    ServerProber(boost::asio::io_context& io_context, std::vector<udp::endpoint> candidates)
+        : socket_(io_context, udp::endpoint(udp::v4(), 0)), timer_(io_context), candidates_(std::move(candidates)),
+          stats_(candidates_.size()), pending_(candidates_.size(), 0), answered_(candidates_.size(), false) {}
+
+    // Sends a burst to every candidate; `done` runs on the network thread once every reply is
+    // in or timed out. Call on the network thread, one burst at a time.
+    void probe(std::function<void()> done) noexcept {
+        done_ = std::move(done);
+        ++burst_;
+        std::fill(answered_.begin(), answered_.end(), false);
+        if (!receiving_) {
+            receiving_ = true;
+            receive();
+        }
+        send_round(0);
+    }
+
+    // Network thread; an unfinished burst never calls its `done`
+    void close() noexcept {
+        boost::system::error_code ec;
+        timer_.cancel();
+        socket_.close(ec);
+        done_ = nullptr;
+    }
+
+    const std::vector<udp::endpoint>& candidates() const noexcept { return candidates_; }
+
+    std::vector<Result> results() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<Result> results;
+        for (std::size_t i = 0; i < candidates_.size(); ++i) {
+            Result result;
+            result.server = endpoint_name(candidates_[i]);
+            result.answering = answered_[i];
+            result.rtt_ns = stats_[i].median_rtt_ns();
+            result.jitter_ns = stats_[i].jitter_ns();
+            result.loss = stats_[i].loss();
+            result.score_ns = stats_[i].score_ns();
+            results.push_back(result);
+        }
+        return results;
+    }
+
+    // Index of the lowest score among the candidates that answered the last burst; -1 if none did
+    int best() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        int best = -1;
+        for (std::size_t i = 0; i < candidates_.size(); ++i) {
+            if (!answered_[i]) continue;
+            if (best < 0 || stats_[i].score_ns() < stats_[best].score_ns()) best = static_cast<int>(i);
+        }
+        return best;
+    }
+
+    // [{"server", "answering", "rtt_us", "jitter_us", "loss"}], in candidate order
+    json results_json() const {
+        json list = json::array();
+        for (const Result& result : results()) {
+            list.push_back({{"server", result.server}, {"answering", result.answering},
+                            {"rtt_us", result.rtt_ns < 0 ? json(nullptr) : json(result.rtt_ns / 1000)},
+                            {"jitter_us", result.jitter_ns / 1000}, {"loss", result.loss}});
+        }
+        return list;
+    }
+
+    // True if candidate `a` is so much better than `b` that moving is worth the gap
+    bool clearly_better(int a, int b) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return ProbeStats::clearly_better(stats_[a], stats_[b]);
+    }
+
+private:
+    // Cookie: burst << 16 | candidate << 8 | round, so late replies from an earlier burst are ignored
+    void send_round(int round) noexcept {
+        for (std::size_t i = 0; i < candidates_.size(); ++i) {
+            std::array<char, JamProtocol::PROBE_SIZE> probe;
+            JamProtocol::write_tag(probe.data(), JamProtocol::PROBE_TAG);
+            JamProtocol::write_i64(probe.data() + JamProtocol::TAG_SIZE, ClockSync::local_now_ns());
+            JamProtocol::write_u32(probe.data() + JamProtocol::TAG_SIZE + 8,
+                                   (burst_ & 0xFFFF) << 16 | static_cast<uint32_t>(i) << 8 | static_cast<uint32_t>(round));
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                pending_[i] |= 1u << round;
+            }
+            boost::system::error_code ec;
+            socket_.send_to(boost::asio::buffer(probe), candidates_[i], 0, ec);
+            if (ec && logger.is_debug_mode()) logger.log("Probe send error: " + ec.message());
+        }
+        timer_.expires_after(round + 1 < BURST ? BURST_SPACING : REPLY_TIMEOUT);
+        timer_.async_wait([this, self = shared_from_this(), round](const boost::system::error_code& ec) {
+            if (ec) return;
+            if (round + 1 < BURST) {
+                send_round(round + 1);
+            } else {
+                finish_burst();
+            }
+        });
+    }
+
+    void finish_burst() noexcept {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (std::size_t i = 0; i < candidates_.size(); ++i) {
+                for (int round = 0; round < BURST; ++round) {
+                    if (pending_[i] & (1u << round)) stats_[i].add_loss();
+                }
+                pending_[i] = 0;
+            }
+        }
+        if (done_) {
+            auto done = std::move(done_);
+            done_ = nullptr;
+            done();
+        }
+    }
+
+    void receive() noexcept {
+        socket_.async_receive_from(boost::asio::buffer(buffer_), sender_,
+            [this, self = shared_from_this()](const boost::system::error_code& ec, std::size_t bytes) {
+                int64_t now_ns = ClockSync::local_now_ns();
+                if (ec == boost::asio::error::operation_aborted) return;
+                if (!ec && JamProtocol::has_tag(buffer_.data(), bytes, JamProtocol::PROBE_REPLY_TAG, JamProtocol::PROBE_SIZE)) {
+                    int64_t sent_ns = JamProtocol::read_i64(buffer_.data() + JamProtocol::TAG_SIZE);
+                    uint32_t cookie = JamProtocol::read_u32(buffer_.data() + JamProtocol::TAG_SIZE + 8);
+                    std::size_t candidate = (cookie >> 8) & 0xFF;
+                    uint32_t round = cookie & 0xFF;
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    if ((cookie >> 16) == (burst_ & 0xFFFF) && candidate < candidates_.size() && round < BURST &&
+                        (pending_[candidate] & (1u << round))) {
+                        pending_[candidate] &= ~(1u << round);
+                        answered_[candidate] = true;
+                        stats_[candidate].add_reply(now_ns - sent_ns);
+                    }
+                }
+                receive();
+            });
+    }
+
+    udp::socket socket_;
+    boost::asio::steady_timer timer_;
+    std::vector<udp::endpoint> candidates_;
+    mutable std::mutex mutex_; // Guards the statistics below for results()
+    std::vector<ProbeStats> stats_;
+    std::vector<uint32_t> pending_; // Per candidate: bit r set while round r of this burst awaits its reply
+    std::vector<bool> answered_;
+    uint32_t burst_ = 0;
+    bool receiving_ = false;
+    std::function<void()> done_;
+    std::array<char, 64> buffer_;
+    udp::endpoint sender_;
+};
+
+// One session: a connection to one server/room with its own channel and MIDI routing.
+// Every session runs on the shared network io_context; handlers hold a shared_ptr so a
+// session outlives its last pending operation.
+class MidiJamClient : public std::enable_shared_from_this<MidiJamClient> {
 private:
     static constexpr size_t BUFFER_SIZE = 128;
-    static constexpr size_t JSON_BUFFER_SIZE = 1024;
+    static constexpr size_t JSON_BUFFER_SIZE = 2048; // A CLIST of ~20 players fits
     static constexpr auto CLIENT_LIST_INTERVAL = std::chrono::seconds(5);
     static constexpr auto CLIENT_LOG_INTERVAL = std::chrono::seconds(5);
-    boost::asio::io_context io_context_;
-    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work_guard_; // Keep io_context alive
+    static constexpr auto CLOCK_SYNC_BURST_INTERVAL = std::chrono::milliseconds(50);
+    static constexpr auto CLOCK_SYNC_INTERVAL = std::chrono::milliseconds(2000);
+    static constexpr int CLOCK_SYNC_BURST = 8; // Quick samples right after connecting
+    static constexpr auto SYSEX_FRAGMENT_INTERVAL = std::chrono::milliseconds(4); // ~64 KB/s bulk lane
+    static constexpr size_t MAX_SYSEX_BACKLOG = 1 << 20; // Bytes of SysEx waiting to be sent
+    static constexpr auto HANDSHAKE_TIMEOUT = std::chrono::seconds(1); // For the reply to one attempt
+    static constexpr int CONNECT_ATTEMPTS = 5; // Before connect() gives up; reconnecting never does
+    static constexpr auto BACKOFF_BASE = std::chrono::milliseconds(250); // Between attempts, doubling...
+    static constexpr auto BACKOFF_MAX = std::chrono::seconds(8); // ...up to this
+    static constexpr auto SERVER_SILENCE_TIMEOUT = std::chrono::seconds(6); // Three SYNC replies in a row missing
+    static constexpr auto PROBE_INTERVAL = std::chrono::seconds(30); // Re-measuring the candidate servers...
+    static constexpr auto FAILOVER_PROBE_INTERVAL = std::chrono::seconds(2); // ...or this often while reconnecting
+    static_assert(JSON_BUFFER_SIZE >= JamProtocol::SYSEX_HEADER_SIZE + JamProtocol::SYSEX_FRAGMENT_PAYLOAD + PacketAuth::TRAILER_SIZE,
+                  "SysEx fragment would be truncated");
+    boost::asio::io_context& io_context_; // Shared network thread
+    MidiPortPool& midi_ports_;
+    int id_;
     udp::socket udp_socket_;
+    mutable std::mutex endpoint_mutex_; // server_endpoint_ changes on failover; read it through server_endpoint()
     udp::endpoint server_endpoint_;
     std::string nickname_;
-    RtMidiIn midi_in_;
-    RtMidiIn midi_in_2_;
-    RtMidiOut midi_out_;
+    std::string password_; // Room password; empty for open rooms
+    bool ump_ = false; // MIDI travels as UMP datagrams; the ports stay MIDI 1.0 and we translate at the edges
+    SipKey room_key_; // Derived from the password once; the key stretching is slow
+    std::mutex auth_mutex_; // auth_ is replaced when a reconnect has to join afresh
+    PacketAuth auth_; // Session keys from the handshake; seals everything we send
+    std::vector<std::pair<unsigned int, int>> midi_inputs_; // (port, pool token)
+    std::shared_ptr<SharedMidiOutput> midi_out_;
     std::array<unsigned char, BUFFER_SIZE> midi_buffer_;
     std::array<char, JSON_BUFFER_SIZE> json_buffer_;
     volatile bool running_ = true;
     uint8_t midi_channel_;
-    bool has_second_input_ = false;
     boost::asio::steady_timer client_list_timer_;
     boost::asio::steady_timer log_timer_;  // Separate timer for logging
-    std::vector<std::thread> thread_pool_;
-    bool connected_ = false;
+    boost::asio::steady_timer clock_sync_timer_;
+    std::mutex subscriptions_mutex_;
+    std::map<uint16_t, Subscription> subscriptions_; // What we asked the server for, by sender id
+    // Per input (midi_in, midi_in_2), immutable once published: the MIDI callback reads it with
+    // std::atomic_load and set_routing swaps in a new one with std::atomic_store
+    std::array<std::shared_ptr<const MidiTransform>, 2> routing_;
+    std::mutex routing_mutex_; // Serializes set_routing only
+    ClockSync clock_sync_; // Maps local time onto the server's session clock
+    MidiClockGenerator clock_generator_; // Local 0xF8 ticks following the room tempo
+
+    // SysEx travels as paced fragments on its own lane so dumps never hold up notes
+    struct SysexAssembly {
+        uint16_t message_id = 0;
+        uint16_t next_index = 0;
+        std::vector<unsigned char> data;
+    };
+    boost::asio::steady_timer sysex_timer_;
+    std::deque<std::vector<char>> sysex_queue_; // Outgoing fragments, oldest first
+    size_t sysex_backlog_ = 0;
+    bool sysex_sending_ = false;
+    uint16_t next_sysex_id_ = 0;
+    std::mutex sysex_mutex_;
+    std::unordered_map<uint16_t, SysexAssembly> sysex_inbound_; // Keyed by source client id
+    int clock_sync_burst_left_ = 0;
+    bool connected_ = false; // Between connect() and disconnect(), whatever the link does meanwhile
+    std::atomic<bool> server_closed_{false}; // The server said it is shutting down (SHUT)
+
+    // Connection state machine, on the network thread. Connecting is the first join, which
+    // connect() waits for; after that a lost server means Reconnecting, with jittered
+    // exponential backoff, until an RSUM re-attaches the session or a fresh join replaces it.
+    enum class LinkState { Idle, Connecting, Connected, Reconnecting, Failed };
+    std::atomic<LinkState> link_state_{LinkState::Idle};
+    boost::asio::steady_timer handshake_timer_; // Reply timeout of an attempt, then the backoff before the next
+    int failed_attempts_ = 0; // Since the last success
+    bool resuming_ = false; // The attempt in flight is an RSUM
+    uint64_t join_nonce_ = 0; // Client nonce of the JOIN in flight
+    PacketAuth pending_auth_; // Keys from the server's CHAL, until its ACK
+    uint64_t session_token_ = 0; // From SESS; 0 until the server sent one
+    std::atomic<uint16_t> server_id_{0}; // Our id in the room, from SESS
+    std::chrono::steady_clock::time_point last_heard_; // Last valid datagram from the server
+    std::atomic<uint64_t> reconnects_{0};
+    std::promise<bool> joined_; // Outcome of the first join
+    std::string failure_; // Why the first join gave up
+    std::minstd_rand jitter_rng_;
+
+    // With several candidate servers: which one we joined, and whether another answers clearly faster
+    std::shared_ptr<ServerProber> prober_;
+    boost::asio::steady_timer probe_timer_;
+    bool probing_ = false; // A burst is in flight
+    std::atomic<int> current_candidate_{0};
+    std::atomic<int> recommended_{-1}; // -1: ours is the best
     json last_client_list_; // Changed to Nlohmann JSON type
+    uint64_t client_list_version_ = 0; // Bumped whenever a new list arrives
     mutable std::mutex client_list_mutex_;
     int midi_in_port_;
     int midi_out_port_;
     int midi_in_port_2_;
 
-    static void midi_callback(double, std::vector<unsigned char>* msg, void* userData) noexcept {
-        if (!msg || msg->empty() || !userData) return;
-        auto* client = static_cast<MidiJamClient*>(userData);
-        // Filter MIDI messages: only allow Note On/Off, Aftertouch, and CC
-        uint8_t status = msg->at(0) & 0xF0;
-        if (status != 0x80 && // Note Off
-            status != 0x90 && // Note On
-            status != 0xA0 && // Aftertouch
-            status != 0xB0 && // CC
-            status != 0xD0) // Channel Pressure (Aftertouch)
+    // Called from the RtMidi thread for every input port this session is routed from;
+    // `input` is 0 for midi_in and 1 for midi_in_2
+    void on_midi_input(std::size_t input, const std::vector<unsigned char>& msg) noexcept {
+        if (!running_) return;
+        MIDIJAM_TRACE(Trace::MIDI_IN, msg.data(), msg.size());
+        // Transport from a local sequencer is a request to the room's tempo master, not MIDI to forward
+        switch (msg.at(0)) {
+            case 0xFA: case 0xFB: case 0xFC:
+                send_transport(msg.at(0), 0);
+                return;
+            case 0xF2:
+                if (msg.size() >= 3) send_transport(0xF2, msg.at(1) | (msg.at(2) << 7));
+                return;
+        }
+        uint8_t status = msg.at(0);
+        // While reconnecting the local echo keeps playing; nothing is sent to a server that isn't there
+        bool linked = online();
+        if (status == 0xF0) {
+            if (linked) queue_sysex(msg);
+            midi_out_->send(msg);
             return;
-        std::vector<unsigned char> adjusted = *msg;
-        if(status != 0xD0)
-        {
-            adjusted[0] = (msg->at(0) & 0xF0) | (client->midi_channel_ & 0x0F);
-        } else
-        {
-            adjusted[0] = 0xD0 | (client->midi_channel_ & 0x0F);
         }
-        std::ostringstream log_msg;
-        log_msg << "Sending MIDI: ";
-        for (auto byte : adjusted) {
-            log_msg << std::hex << std::setw(2) << std::setfill('0') << (int)byte << " ";
+        // Clock is generated locally from the room tempo and MTC is meaningless across the network
+        if (MidiMessage::is_realtime(status) || status == 0xF1) return;
+        // Split/layer/transpose through this input's routing; layers share one datagram
+        std::array<MidiTransform::Message, MidiTransform::MAX_ZONES> routed;
+        std::size_t routed_count = 1;
+        if (MidiMessage::is_channel_message(status)) {
+            routed_count = std::atomic_load(&routing_[input])->process(msg.data(), msg.size(), routed.data());
+            if (routed_count == 0) return;
+        }
+        auto packet = std::make_shared<std::vector<unsigned char>>(); // Must outlive the async send
+        std::vector<unsigned char>& adjusted = *packet;
+        if (MidiMessage::is_channel_message(status)) {
+            for (std::size_t i = 0; i < routed_count; ++i) {
+                adjusted.insert(adjusted.end(), routed[i].bytes.begin(), routed[i].bytes.begin() + routed[i].size);
+            }
+        } else {
+            adjusted = msg; // System common passes unchanged
         }
         if (logger.is_debug_mode()) {
+            std::ostringstream log_msg;
+            log_msg << "Sending MIDI: ";
+            for (auto byte : adjusted) {
+                log_msg << std::hex << std::setw(2) << std::setfill('0') << (int)byte << " ";
+            }
             logger.log(log_msg.str());
         }
-        client->udp_socket_.async_send_to(
-            boost::asio::buffer(adjusted), client->server_endpoint_,
-            [](const boost::system::error_code& ec, std::size_t) {
-                if (ec) {
-                    logger.log("MIDI send error: " + ec.message());
-                }
-                else {
-                    if (logger.is_debug_mode()) {
-                        logger.log("MIDI sent successfully");
+        const std::size_t midi_size = adjusted.size();
+        if (!MidiMessage::is_channel_message(status)) midi_out_->send(adjusted);
+        if (linked) {
+            // Traces hash the MIDI 1.0 bytes, so a UMP send still matches the peer's MIDI output
+            auto midi = packet;
+            if (ump_) {
+                std::vector<char> words;
+                std::size_t dropped = 0;
+                Ump::from_midi1(adjusted.data(), adjusted.size(), words, dropped); // Never empty: SysEx took the SYSX path
+                if (dropped) logger.log("UMP send dropped " + std::to_string(dropped) + " message(s) past the datagram size");
+                packet = std::make_shared<std::vector<unsigned char>>(words.begin(), words.end());
+            }
+            seal(*packet);
+            udp_socket_.async_send_to(
+                boost::asio::buffer(*packet), server_endpoint(),
+                [packet, midi, midi_size](const boost::system::error_code& ec, std::size_t) {
+                    if (ec) {
+                        logger.log("MIDI send error: " + ec.message());
                     }
-                }
-            });
-        MidiUtils::sendMidiMessage(client->midi_out_, adjusted);
+                    else {
+                        MIDIJAM_TRACE(Trace::CLIENT_SEND, midi->data(), midi_size);
+                        if (logger.is_debug_mode()) {
+                            logger.log("MIDI sent successfully");
+                        }
+                    }
+                });
+        }
+        if (MidiMessage::is_channel_message(status)) {
+            for (std::size_t i = 0; i < routed_count; ++i) midi_out_->send(routed[i].bytes.data(), routed[i].size);
+        }
+    }
+
+    // A copy, since a failover can swap the endpoint from another thread at any time
+    udp::endpoint server_endpoint() const {
+        std::lock_guard<std::mutex> lock(endpoint_mutex_);
+        return server_endpoint_;
+    }
+
+    // Appends the MAC trailer when the room has a password
+    template <class Byte>
+    void seal(std::vector<Byte>& packet) noexcept {
+        std::lock_guard<std::mutex> lock(auth_mutex_);
+        if (!auth_.enabled()) return;
+        std::array<char, PacketAuth::TRAILER_SIZE> trailer;
+        auth_.seal(reinterpret_cast<const char*>(packet.data()), packet.size(), trailer.data());
+        packet.insert(packet.end(), trailer.begin(), trailer.end());
+    }
+
+    // Blocking send from the network thread, sealed like every other datagram
+    void send_now(const char* data, std::size_t bytes, boost::system::error_code& ec) noexcept {
+        std::array<char, PacketAuth::TRAILER_SIZE> trailer;
+        std::size_t trailer_size = 0;
+        {
+            std::lock_guard<std::mutex> lock(auth_mutex_);
+            if (auth_.enabled()) {
+                auth_.seal(data, bytes, trailer.data());
+                trailer_size = trailer.size();
+            }
+        }
+        std::array<boost::asio::const_buffer, 2> buffers{boost::asio::buffer(data, bytes), boost::asio::buffer(trailer.data(), trailer_size)};
+        udp_socket_.send_to(buffers, server_endpoint(), 0, ec);
     }
 
 public:
-    MidiJamClient(const std::string& server_ip, short server_port, const std::string& nickname,
-                  int midi_in_port, int midi_out_port, int midi_in_port_2, uint8_t midi_channel)
-        : io_context_(),
-          work_guard_(boost::asio::make_work_guard(io_context_)), // Initialize work guard
+    // Call connect() once the session is owned by a shared_ptr
+    MidiJamClient(boost::asio::io_context& io_context, MidiPortPool& midi_ports, int id,
+                  const std::string& server_ip, short server_port, const std::string& nickname,
+                  int midi_in_port, int midi_out_port, int midi_in_port_2, uint8_t midi_channel,
+                  const std::string& password = "")
+        : io_context_(io_context), midi_ports_(midi_ports), id_(id),
           udp_socket_(io_context_, udp::endpoint(udp::v4(), 0)),
           server_endpoint_(boost::asio::ip::make_address(server_ip), server_port),
-          nickname_(nickname), midi_channel_(midi_channel), client_list_timer_(io_context_), log_timer_(io_context_),
+          nickname_(nickname), password_(password), midi_channel_(midi_channel), client_list_timer_(io_context_), log_timer_(io_context_),
+          clock_sync_timer_(io_context_),
+          clock_generator_(clock_sync_, [this](const std::vector<unsigned char>& msg) { midi_out_->send(msg); }),
+          sysex_timer_(io_context_), handshake_timer_(io_context_), jitter_rng_(static_cast<uint32_t>(Auth::random_u64())),
+          probe_timer_(io_context_),
           midi_in_port_(midi_in_port), midi_out_port_(midi_out_port), midi_in_port_2_(midi_in_port_2) {
-        try {
-            connect();
-        } catch (const std::exception& e) {
-            logger.log("Failed to initialize MidiJamClient: " + std::string(e.what()));
-            throw;
-        }
+        routing_.fill(std::make_shared<const MidiTransform>(MidiTransform::passthrough(midi_channel_)));
+        if (!password_.empty()) room_key_ = Auth::room_key(password_);
     }
 
     ~MidiJamClient() {
-        disconnect();
-        work_guard_.reset(); // Release work guard on destruction
+        release_midi(); // The pool's handlers point at this session
     }
 
-    bool connect_with_handshake(int max_retries = 5, std::chrono::seconds timeout = std::chrono::seconds(1)) {
-        int retry_count = 0;
-        bool acknowledged = false;
-        udp_socket_.set_option(boost::asio::socket_base::send_buffer_size(65536));
-        udp_socket_.set_option(boost::asio::socket_base::receive_buffer_size(65536));
-        while (retry_count < max_retries && !acknowledged) {
-            try {
-                if (logger.is_debug_mode()) {
-                    logger.log("Sending nickname: " + nickname_);
-                }
-                udp_socket_.send_to(boost::asio::buffer(nickname_), server_endpoint_);
-                // Set up a timer for the timeout
-                boost::asio::steady_timer timer(io_context_);
-                timer.expires_after(timeout);
-                // Asynchronously wait for the timer
-                boost::system::error_code timer_ec;
-                timer.async_wait([&timer_ec](const boost::system::error_code& ec) {
-                    if (!ec) {
-                        timer_ec = boost::asio::error::timed_out; // Mark as timed out
-                    }
-                });
-                // Asynchronously wait for the server's response
-                boost::system::error_code receive_ec;
-                size_t bytes = 0;
-                udp::endpoint sender_endpoint;
-                auto receive_handler = [&](const boost::system::error_code& ec, std::size_t length) {
-                    if (!ec) {
-                        bytes = length;
-                        receive_ec = ec;
-                    } else {
-                        receive_ec = ec;
-                    }
-                    timer.cancel(); // Cancel the timer since we received a response
-                };
-                udp_socket_.async_receive_from(
-                    boost::asio::buffer(json_buffer_), sender_endpoint, receive_handler);
-                // Run the io_context to process the asynchronous operations
-                io_context_.run_for(timeout);
-                // Check the results
-                if (timer_ec == boost::asio::error::timed_out) {
-                    logger.log("Handshake failed: Server did not respond within the timeout period.");
-                } else if (receive_ec) {
-                    logger.log("Handshake failed: " + receive_ec.message());
-                } else if (bytes == 3 && std::memcmp(json_buffer_.data(), "ACK", 3) == 0) {
-                    if (logger.is_debug_mode()) {
-                        logger.log("Received ACK from server");
-                    }
-                    acknowledged = true;
-                } else {
-                    logger.log("Handshake failed: Invalid response");
-                }
-                if (!acknowledged) {
-                    retry_count++;
-                    std::this_thread::sleep_for(std::chrono::milliseconds(500));
-                }
-            } catch (const std::exception& e) {
-                logger.log("Handshake exception: " + std::string(e.what()));
-                retry_count++;
-                std::this_thread::sleep_for(std::chrono::milliseconds(500));
-            }
-        }
-        if (!acknowledged) {
-            logger.log("Failed to connect after " + std::to_string(max_retries) + " retries");
-        }
-        return acknowledged;
+    static bool is_ack(const char* data, std::size_t bytes) noexcept {
+        return bytes == 3 && std::memcmp(data, "ACK", 3) == 0;
+    }
+
+    // Send and receive MIDI as UMP datagrams instead of raw MIDI 1.0 bytes. Call before connect().
+    void set_ump(bool ump) noexcept { ump_ = ump; }
+
+    // Candidate servers to choose from, by probing, instead of the one given to the
+    // constructor. Call before connect().
+    void set_candidates(std::vector<udp::endpoint> candidates) {
+        prober_ = std::make_shared<ServerProber>(io_context_, std::move(candidates));
     }
 
+    // Opens until the first join is accepted (connect() returns) or gives up (connect() throws).
+    // After that the MIDI ports stay open and a lost server only means reconnecting.
     void connect() {
         if (connected_) return;
-        if (!connect_with_handshake()) {
-            logger.log("Failed to connect to the server. Retrying will be possible via the HTTP API.");
-            throw std::runtime_error("Failed to establish connection with the server");
-        } else {
-            setup_midi(midi_in_port_, midi_out_port_, midi_in_port_2_);
+        udp_socket_.set_option(boost::asio::socket_base::send_buffer_size(65536));
+        udp_socket_.set_option(boost::asio::socket_base::receive_buffer_size(65536));
+        if (prober_) choose_server();
+        setup_midi(midi_in_port_, midi_out_port_, midi_in_port_2_);
+        auto joined = joined_.get_future();
+        link_state_ = LinkState::Connecting;
+        boost::asio::post(io_context_, [this, self = shared_from_this()]() {
             start_receive();
-            start_client_list_requests();
-            start_log_state(); // Start logging
-            connected_ = true;
-            thread_pool_.emplace_back([this]() {
-                if (logger.is_debug_mode()) {
-                    logger.log("Starting io_context thread");
-                }
-                io_context_.run();
-                if (logger.is_debug_mode()) {
-                    logger.log("io_context thread stopped");
-                }
-            });
-            logger.log_simple("Successfully connected to server: " + server_endpoint_.address().to_string() + ":" + std::to_string(server_endpoint_.port()));
-            logger.log_simple("Client started successfully");
+            begin_attempt();
+        });
+        if (!joined.get()) {
+            running_ = false;
+            close_network(false);
+            release_midi();
+            logger.log("Session " + std::to_string(id_) + " failed to connect to the server (" + failure_ +
+                       "). Retrying will be possible via the HTTP API.");
+            throw std::runtime_error("Failed to establish connection with the server: " + failure_);
         }
+        clock_generator_.start();
+        connected_ = true;
+        logger.log_simple("Successfully connected to server: " + endpoint_name(server_endpoint()));
+        logger.log_simple("Client started successfully");
     }
 
     void start_log_state() noexcept {
         log_timer_.expires_after(CLIENT_LOG_INTERVAL);
-        log_timer_.async_wait([this](const boost::system::error_code& ec) {
+        log_timer_.async_wait([this, self = shared_from_this()](const boost::system::error_code& ec) {
             if (!ec) {
                 if (logger.is_debug_mode()) {
                     logger.log("Client state: running=" + std::to_string(running_) + ", connected=" + std::to_string(connected_));
@@ -249,44 +533,360 @@ public:
     void disconnect() {
         if (!connected_) return;
         running_ = false;
-        // Cancel timers
-        boost::system::error_code ec;
-        size_t cancelled_clist = client_list_timer_.cancel();
-        if (cancelled_clist > 0) {
+        release_midi(); // No more sends from the RtMidi thread after this
+        clock_generator_.stop();
+        close_network(true);
+        connected_ = false;
+        logger.log_simple("Session " + std::to_string(id_) + " disconnected from server");
+        logger.log_simple("Client stopped successfully");
+    }
+
+    bool is_connected() const { return connected_; }
+    bool server_closed() const { return server_closed_; }
+    uint64_t reconnects() const { return reconnects_; }
+    uint16_t server_id() const { return server_id_; }
+    int id() const { return id_; }
+
+    // "connecting", "connected", "reconnecting", "failed" or "idle"
+    std::string link_state_name() const {
+        switch (link_state_.load()) {
+            case LinkState::Connecting: return "connecting";
+            case LinkState::Connected: return "connected";
+            case LinkState::Reconnecting: return "reconnecting";
+            case LinkState::Failed: return "failed";
+            default: return "idle";
+        }
+    }
+
+private:
+    // Timers and the socket belong to the network thread; waits until QUIT is out so the
+    // same ports can be reused by a new session straight away
+    void close_network(bool send_quit) {
+        auto closed = std::make_shared<std::promise<void>>();
+        auto done = closed->get_future();
+        boost::asio::post(io_context_, [this, self = shared_from_this(), closed, send_quit]() {
+            handshake_timer_.cancel();
+            probe_timer_.cancel();
+            if (prober_) prober_->close();
+            size_t cancelled_clist = client_list_timer_.cancel();
             if (logger.is_debug_mode()) {
-                logger.log("Successfully cancelled CLIST timer.");
+                logger.log(cancelled_clist > 0 ? "Successfully cancelled CLIST timer." : "CLIST timer was already expired or cancelled.");
             }
-        } else {
+            clock_sync_timer_.cancel();
+            size_t cancelled_log = log_timer_.cancel();
             if (logger.is_debug_mode()) {
-                logger.log("CLIST timer was already expired or cancelled.");
+                logger.log(cancelled_log > 0 ? "Successfully cancelled log timer." : "Log timer was already expired or cancelled.");
             }
-        }
-        size_t cancelled_log = log_timer_.cancel();
-        if (cancelled_log > 0) {
+            sysex_timer_.cancel();
+            boost::system::error_code ec;
+            if (send_quit) {
+                send_now("QUIT", 4, ec);
+                if (ec) logger.log("Error sending QUIT: " + ec.message());
+            }
+            udp_socket_.close(ec); // Completes the pending receive with operation_aborted
+            link_state_ = LinkState::Idle;
+            closed->set_value();
+        });
+        done.wait();
+    }
+
+    bool online() const noexcept { return link_state_ == LinkState::Connected; }
+
+    void send_plain(const char* data, std::size_t bytes, boost::system::error_code& ec) noexcept {
+        udp_socket_.send_to(boost::asio::buffer(data, bytes), server_endpoint(), 0, ec);
+    }
+
+    // One handshake attempt on the network thread: RSUM while we hold a session token, so
+    // the server re-attaches us in one round trip, otherwise a fresh join
+    void begin_attempt() noexcept {
+        resuming_ = session_token_ != 0;
+        boost::system::error_code ec;
+        if (resuming_) {
+            std::array<char, JamProtocol::RESUME_SIZE> resume;
+            JamProtocol::write_tag(resume.data(), JamProtocol::RESUME_TAG);
+            JamProtocol::write_i64(resume.data() + JamProtocol::TAG_SIZE, static_cast<int64_t>(session_token_));
+            send_now(resume.data(), resume.size(), ec); // Sealed with the session's keys in password rooms
+        } else if (password_.empty()) {
             if (logger.is_debug_mode()) {
-                logger.log("Successfully cancelled log timer.");
+                logger.log("Sending nickname: " + nickname_);
             }
+            // The QUIT ends whatever the server still holds for our address, so the nickname starts a session
+            send_plain("QUIT", 4, ec);
+            if (!ec) send_plain(nickname_.data(), nickname_.size(), ec);
         } else {
+            // JOIN -> CHAL -> AUTH -> ACK; the password itself never goes on the wire
+            join_nonce_ = Auth::random_u64();
+            pending_auth_ = PacketAuth();
+            std::vector<char> join(Auth::JOIN_HEADER_SIZE);
+            JamProtocol::write_tag(join.data(), Auth::JOIN_TAG);
+            JamProtocol::write_i64(join.data() + JamProtocol::TAG_SIZE, static_cast<int64_t>(join_nonce_));
+            join.insert(join.end(), nickname_.begin(), nickname_.end());
+            send_plain(join.data(), join.size(), ec);
+        }
+        if (ec) logger.log("Handshake send error: " + ec.message());
+        await_handshake_reply();
+    }
+
+    void await_handshake_reply() noexcept {
+        handshake_timer_.expires_after(HANDSHAKE_TIMEOUT);
+        handshake_timer_.async_wait([this, self = shared_from_this()](const boost::system::error_code& ec) {
+            if (ec || !running_) return;
+            attempt_failed("the server did not respond");
+        });
+    }
+
+    void attempt_failed(const std::string& reason) noexcept {
+        ++failed_attempts_;
+        if (link_state_ == LinkState::Connecting && failed_attempts_ >= CONNECT_ATTEMPTS) {
+            logger.log("Handshake failed: " + reason);
+            give_up("no answer after " + std::to_string(CONNECT_ATTEMPTS) + " attempts");
+            return;
+        }
+        auto delay = backoff_delay();
+        if (logger.is_debug_mode()) {
+            logger.log("Handshake failed: " + reason + "; next attempt in " + std::to_string(delay.count()) + " ms");
+        }
+        handshake_timer_.expires_after(delay);
+        handshake_timer_.async_wait([this, self = shared_from_this()](const boost::system::error_code& ec) {
+            if (ec || !running_) return;
+            begin_attempt();
+        });
+    }
+
+    // Exponential backoff with equal jitter: half the delay is fixed, half random, so
+    // clients cut off by the same outage don't all come back in the same instant
+    std::chrono::milliseconds backoff_delay() noexcept {
+        int doublings = std::min(failed_attempts_ - 1, 5);
+        auto ceiling = std::min<std::chrono::milliseconds>(BACKOFF_BASE * (1 << doublings), BACKOFF_MAX);
+        std::uniform_int_distribution<int64_t> jitter(0, ceiling.count() / 2);
+        return ceiling / 2 + std::chrono::milliseconds(jitter(jitter_rng_));
+    }
+
+    // The server said no. The first join reports it to connect(); a reconnect stops retrying,
+    // since the room's password or mode changed under us.
+    void give_up(const std::string& reason) noexcept {
+        handshake_timer_.cancel();
+        if (link_state_ == LinkState::Connecting) {
+            failure_ = reason;
+            link_state_ = LinkState::Failed;
+            joined_.set_value(false);
+            return;
+        }
+        logger.log("Session " + std::to_string(id_) + " cannot rejoin: " + reason);
+        link_state_ = LinkState::Failed;
+    }
+
+    // GONE for our token; in password rooms only with the room key's proof, so a forged one
+    // can't throw us out of our session
+    bool is_gone(const char* data, std::size_t bytes) const noexcept {
+        if (password_.empty()) return JamProtocol::has_tag(data, bytes, JamProtocol::GONE_TAG, JamProtocol::GONE_SIZE);
+        if (!JamProtocol::has_tag(data, bytes, JamProtocol::GONE_TAG, JamProtocol::GONE_SIZE + Auth::MAC_SIZE)) return false;
+        uint64_t proof = static_cast<uint64_t>(JamProtocol::read_i64(data + JamProtocol::GONE_SIZE));
+        return Auth::equal(proof, Auth::gone_proof(room_key_, session_token_));
+    }
+
+    // Replies to begin_attempt(), in json_buffer_; everything else waits for the ACK
+    void handle_handshake_reply(std::size_t bytes) noexcept {
+        const char* data = json_buffer_.data();
+        if (resuming_) {
+            if (is_gone(data, bytes)) {
+                // The server restarted or gave up on us: join afresh right away, under a new id
+                logger.log("Session " + std::to_string(id_) + ": the server no longer holds our session; joining again");
+                session_token_ = 0;
+                begin_attempt();
+                return;
+            }
+            if (open_datagram(bytes) && is_ack(data, bytes)) joined();
+            return;
+        }
+        if (password_.empty()) {
+            if (is_ack(data, bytes)) joined();
+            return;
+        }
+        if (is_ack(data, bytes)) {
+            // The server took the JOIN for a nickname: it has no password and now lists us under a garbled name
+            boost::system::error_code ec;
+            send_plain("QUIT", 4, ec);
+            logger.log("Handshake failed: the server does not use a room password");
+            give_up("the server does not use a room password");
+            return;
+        }
+        if (JamProtocol::has_tag(data, bytes, Auth::DENY_TAG, 4)) {
+            logger.log("Handshake failed: wrong room password");
+            give_up("wrong room password");
+            return;
+        }
+        if (JamProtocol::has_tag(data, bytes, Auth::CHALLENGE_TAG, Auth::CHALLENGE_SIZE) &&
+            static_cast<uint64_t>(JamProtocol::read_i64(data + JamProtocol::TAG_SIZE)) == join_nonce_) {
+            uint64_t server_nonce = static_cast<uint64_t>(JamProtocol::read_i64(data + JamProtocol::TAG_SIZE + Auth::NONCE_SIZE));
+            pending_auth_ = PacketAuth(Auth::session_key(room_key_, join_nonce_, server_nonce, 'c'),
+                                       Auth::session_key(room_key_, join_nonce_, server_nonce, 's'));
+            std::vector<char> response(Auth::AUTH_HEADER_SIZE);
+            char* p = response.data();
+            JamProtocol::write_tag(p, Auth::AUTH_TAG);
+            JamProtocol::write_i64(p + JamProtocol::TAG_SIZE, static_cast<int64_t>(join_nonce_));
+            JamProtocol::write_i64(p + JamProtocol::TAG_SIZE + Auth::NONCE_SIZE, static_cast<int64_t>(server_nonce));
+            JamProtocol::write_i64(p + JamProtocol::TAG_SIZE + 2 * Auth::NONCE_SIZE,
+                static_cast<int64_t>(Auth::proof(room_key_, join_nonce_, server_nonce, nickname_)));
+            response.insert(response.end(), nickname_.begin(), nickname_.end());
+            boost::system::error_code ec;
+            send_plain(response.data(), response.size(), ec);
+            if (ec) logger.log("Handshake send error: " + ec.message());
+            await_handshake_reply(); // A full timeout for the AUTH, too
+            return;
+        }
+        std::size_t payload = bytes;
+        if (pending_auth_.enabled() && pending_auth_.open(data, payload) && is_ack(data, payload)) {
+            {
+                std::lock_guard<std::mutex> lock(auth_mutex_);
+                auth_ = pending_auth_;
+            }
+            joined();
+        }
+    }
+
+    // The join or resume was accepted
+    void joined() noexcept {
+        handshake_timer_.cancel();
+        bool first = link_state_ == LinkState::Connecting;
+        failed_attempts_ = 0;
+        last_heard_ = std::chrono::steady_clock::now();
+        server_closed_ = false;
+        if (!resuming_) {
+            // Maybe a new server process, on another clock, numbering its tempo versions from 1 again
+            clock_sync_.reset();
+            if (!first) clock_generator_.reset();
+        }
+        clock_sync_burst_left_ = CLOCK_SYNC_BURST;
+        link_state_ = LinkState::Connected;
+        if (ump_) {
+            // Like subscriptions, a fresh session starts on raw MIDI until we ask again
+            std::array<char, JamProtocol::FORMAT_SIZE> format;
+            JamProtocol::write_tag(format.data(), JamProtocol::FORMAT_TAG);
+            JamProtocol::write_u16(format.data() + JamProtocol::TAG_SIZE, JamProtocol::FORMAT_UMP);
+            boost::system::error_code ec;
+            send_now(format.data(), format.size(), ec);
+            if (ec) logger.log("Format request send error: " + ec.message());
+        }
+        {
+            // A fresh session starts without them; a resumed one just hears them again
+            std::lock_guard<std::mutex> lock(subscriptions_mutex_);
+            for (const auto& [sender, subscription] : subscriptions_) send_subscription(subscription);
+        }
+        if (first) {
             if (logger.is_debug_mode()) {
-                logger.log("Log timer was already expired or cancelled.");
+                logger.log("Received ACK from server");
             }
+            start_client_list_requests();
+            start_clock_sync();
+            start_log_state();
+            if (prober_) schedule_probe();
+            joined_.set_value(true);
+            return;
         }
-        udp_socket_.send_to(boost::asio::buffer("QUIT", 4), server_endpoint_, 0, ec);
-        if (ec) logger.log("Error sending QUIT: " + ec.message());
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
-        io_context_.stop(); // Stop the io_context AFTER cancelling the timer and sending QUIT
-        for (auto& t : thread_pool_) {
-            if (t.joinable()) {
-                t.join();
+        ++reconnects_;
+        clock_sync_timer_.cancel();
+        start_clock_sync(); // Burst now rather than at the next interval
+        logger.log("Session " + std::to_string(id_) + (resuming_ ? " resumed its session on " : " joined again on ") +
+                   endpoint_name(server_endpoint()));
+    }
+
+    // Reconnects with an RSUM straight away; the backoff starts with the second attempt
+    void connection_lost(const std::string& reason) noexcept {
+        if (link_state_ != LinkState::Connected) return;
+        logger.log("Session " + std::to_string(id_) + " lost the server (" + reason + "); reconnecting");
+        link_state_ = LinkState::Reconnecting;
+        failed_attempts_ = 0;
+        begin_attempt();
+        if (prober_) {
+            probe_timer_.cancel(); // Look for a server that answers right away
+            run_probe();
+        }
+    }
+
+    // Probes every candidate at once and picks the best that answers; the given server if none
+    // does, so the join reports the failure. Runs before connect() joins.
+    void choose_server() {
+        auto probed = std::make_shared<std::promise<void>>();
+        auto done = probed->get_future();
+        boost::asio::post(io_context_, [this, self = shared_from_this(), probed]() {
+            probing_ = true;
+            prober_->probe([this, self, probed]() {
+                probing_ = false;
+                probed->set_value();
+            });
+        });
+        done.wait();
+        std::string ranking;
+        for (const auto& result : prober_->results()) {
+            ranking += (ranking.empty() ? "" : ", ") + result.server + " " +
+                       (result.answering ? std::to_string(result.rtt_ns / 1000) + " us" : std::string("no answer"));
+        }
+        int best = prober_->best();
+        if (best >= 0) use_candidate(best);
+        logger.log("Session " + std::to_string(id_) + " probed " + ranking + (best >= 0 ? "; joining " +
+                   prober_->results()[best].server : "; none answered"));
+    }
+
+    void use_candidate(int candidate) {
+        std::lock_guard<std::mutex> lock(endpoint_mutex_);
+        server_endpoint_ = prober_->candidates()[candidate];
+        current_candidate_ = candidate;
+        recommended_ = -1;
+    }
+
+    void schedule_probe() noexcept {
+        probe_timer_.expires_after(online() ? PROBE_INTERVAL : FAILOVER_PROBE_INTERVAL);
+        probe_timer_.async_wait([this, self = shared_from_this()](const boost::system::error_code& ec) {
+            if (ec || !running_) return;
+            run_probe();
+        });
+    }
+
+    void run_probe() noexcept {
+        if (probing_) return; // Its completion schedules the next one
+        probing_ = true;
+        prober_->probe([this, self = shared_from_this()]() {
+            probing_ = false;
+            if (!running_) return;
+            evaluate_servers();
+            schedule_probe();
+        });
+    }
+
+    // While connected, a clearly faster server is only recommended: moving means a gap and a
+    // new id. While reconnecting, we move to the best server that answers if ours doesn't.
+    void evaluate_servers() noexcept {
+        int best = prober_->best();
+        int current = current_candidate_;
+        if (link_state_ == LinkState::Reconnecting) {
+            if (best >= 0 && best != current && !prober_->results()[current].answering) {
+                logger.log("Session " + std::to_string(id_) + ": " + prober_->results()[current].server +
+                           " does not answer; switching to " + prober_->results()[best].server);
+                use_candidate(best);
+                session_token_ = 0; // Tokens are per server
+                failed_attempts_ = 0;
+                begin_attempt();
             }
+            return;
         }
-        thread_pool_.clear();
-        connected_ = false;
-        logger.log_simple("Disconnected from server");
-        logger.log_simple("Client stopped successfully");
+        int recommended = best >= 0 && best != current && prober_->clearly_better(best, current) ? best : -1;
+        if (recommended >= 0 && recommended != recommended_) {
+            auto results = prober_->results();
+            logger.log("Session " + std::to_string(id_) + ": " + results[recommended].server + " answers faster than " +
+                       results[current].server + " (" + std::to_string(results[recommended].rtt_ns / 1000) + " us vs " +
+                       std::to_string(results[current].rtt_ns / 1000) + " us); start the session there to switch");
+        }
+        recommended_ = recommended;
     }
 
-    bool is_connected() const { return connected_; }
+    // Checks and strips the MAC trailer in password rooms
+    bool open_datagram(std::size_t& bytes) noexcept {
+        std::lock_guard<std::mutex> lock(auth_mutex_);
+        return !auth_.enabled() || auth_.open(json_buffer_.data(), bytes);
+    }
+
+public:
 
     json get_client_list() const {
         std::lock_guard<std::mutex> lock(client_list_mutex_);
@@ -297,58 +897,237 @@ public:
         return last_client_list_;
     }
 
+    uint64_t client_list_version() const {
+        std::lock_guard<std::mutex> lock(client_list_mutex_);
+        return client_list_version_;
+    }
+
     json get_config() const {
         json config;
-        config["server_ip"] = server_endpoint_.address().to_string();
-        config["server_port"] = server_endpoint_.port();
+        {
+            udp::endpoint server = server_endpoint();
+            config["server_ip"] = server.address().to_string();
+            config["server_port"] = server.port();
+        }
+        if (prober_) {
+            config["servers"] = json::array();
+            for (const auto& result : prober_->results()) config["servers"].push_back(result.server);
+        }
         config["nickname"] = nickname_;
         config["midi_in"] = midi_in_port_;
         config["midi_out"] = midi_out_port_;
         config["midi_in_2"] = midi_in_port_2_;
         config["channel"] = static_cast<int64_t>(midi_channel_);
+        config["id"] = id_;
+        config["auth"] = !password_.empty(); // Never the password itself
+        config["transport"] = ump_ ? "ump" : "midi1";
         return config;
     }
 
-private:
-    void send_nickname() noexcept {
-        udp_socket_.send_to(boost::asio::buffer(nickname_), server_endpoint_);
-        if (logger.is_debug_mode()) {
-            logger.log("Connected as " + nickname_ + " to " + server_endpoint_.address().to_string() +
-                       ":" + std::to_string(server_endpoint_.port()) + " on MIDI channel " + std::to_string((int)(midi_channel_ + 1)));
+    // Latest measurements of the candidate servers; empty with a single server
+    json get_relay_status() const {
+        if (!prober_) return json::array();
+        json relays = prober_->results_json();
+        for (std::size_t i = 0; i < relays.size(); ++i) {
+            relays[i]["current"] = static_cast<int>(i) == current_candidate_;
+            relays[i]["recommended"] = static_cast<int>(i) == recommended_;
+        }
+        return relays;
+    }
+
+    json get_clock_status() const {
+        json clock;
+        clock["synchronized"] = clock_sync_.is_synchronized();
+        clock["offset_us"] = clock_sync_.offset_ns() / 1000;
+        clock["rtt_us"] = clock_sync_.rtt_ns() / 1000;
+        clock["drift_ppm"] = clock_sync_.drift_ppm();
+        clock["samples"] = clock_sync_.sample_count();
+        return clock;
+    }
+
+    // {"midi_in": [zones], "midi_in_2": [zones]}, see MidiTransform::parse_zones
+    json get_routing() {
+        json routing;
+        routing["midi_in"] = json::parse(MidiTransform::zones_json(std::atomic_load(&routing_[0])->zones()));
+        routing["midi_in_2"] = json::parse(MidiTransform::zones_json(std::atomic_load(&routing_[1])->zones()));
+        return routing;
+    }
+
+    // Replaces the routing of the inputs named in `routing` (null restores the plain channel
+    // rewrite). Everything is validated before anything changes; throws std::runtime_error.
+    void set_routing(const json& routing) {
+        std::array<std::shared_ptr<const MidiTransform>, 2> updated;
+        std::array<bool, 2> present{false, false};
+        const char* keys[2] = {"midi_in", "midi_in_2"};
+        for (std::size_t input = 0; input < 2; ++input) {
+            if (!routing.contains(keys[input])) continue;
+            present[input] = true;
+            const json& zones = routing.at(keys[input]);
+            updated[input] = std::make_shared<const MidiTransform>(zones.is_null() ? MidiTransform::passthrough(midi_channel_)
+                                                                                  : MidiTransform(MidiTransform::parse_zones(zones.dump())));
+        }
+        std::vector<uint8_t> released;
+        {
+            std::lock_guard<std::mutex> lock(routing_mutex_);
+            for (std::size_t input = 0; input < 2; ++input) {
+                if (!present[input]) continue;
+                for (uint8_t channel : std::atomic_load(&routing_[input])->channels()) {
+                    if (std::find(released.begin(), released.end(), channel) == released.end()) released.push_back(channel);
+                }
+                std::atomic_store(&routing_[input], std::move(updated[input]));
+            }
+        }
+        if (!connected_) return;
+        // Held notes may now map elsewhere; release them so nothing hangs on the old channels
+        auto notes_off = std::make_shared<std::vector<unsigned char>>();
+        for (uint8_t channel : released) {
+            unsigned char all_notes_off[3] = {static_cast<unsigned char>(0xB0 | channel), 123, 0};
+            notes_off->insert(notes_off->end(), all_notes_off, all_notes_off + 3);
+            midi_out_->send(all_notes_off, 3);
+        }
+        if (notes_off->empty() || !online()) return;
+        seal(*notes_off);
+        udp_socket_.async_send_to(boost::asio::buffer(*notes_off), server_endpoint(),
+            [notes_off](const boost::system::error_code& ec, std::size_t) {
+                if (ec) logger.log("Notes-off send error: " + ec.message());
+            });
+    }
+
+    // Asks the server to filter/remap what it forwards to us from one sender, or from
+    // everyone (Subscription::ALL_SENDERS). Kept and re-sent with every client list
+    // request, so a lost datagram heals within CLIENT_LIST_INTERVAL.
+    void subscribe(const Subscription& subscription) {
+        {
+            std::lock_guard<std::mutex> lock(subscriptions_mutex_);
+            subscriptions_[subscription.sender] = subscription;
+        }
+        send_subscription(subscription);
+    }
+
+    // Sender id for a nickname in the last client list; 0 if unknown
+    uint16_t sender_id(const std::string& nickname) const {
+        std::lock_guard<std::mutex> lock(client_list_mutex_);
+        if (!last_client_list_.contains("clients")) return 0;
+        for (const auto& client : last_client_list_.at("clients")) {
+            if (client.value("nickname", "") == nickname) return client.value("id", static_cast<uint16_t>(0));
+        }
+        return 0;
+    }
+
+    json get_subscriptions() {
+        std::lock_guard<std::mutex> lock(subscriptions_mutex_);
+        json list = json::array();
+        for (const auto& [sender, subscription] : subscriptions_) {
+            json channels = json::array();
+            json remap = json::object();
+            for (uint8_t c = 0; c < 16; ++c) {
+                if (subscription.channels & (1u << c)) channels.push_back(c);
+                if (subscription.remap[c] != c) remap[std::to_string(c)] = subscription.remap[c];
+            }
+            list.push_back({{"sender", sender}, {"channels", channels}, {"remap", remap}});
         }
+        return list;
+    }
+
+    // Current time on the shared session clock (the server's timebase)
+    int64_t session_now_ns() const { return clock_sync_.session_now_ns(); }
+
+    // Chrome trace of this process on the session clock, so it lines up with the server's dump
+    std::string get_trace_json() const {
+        boost::system::error_code ec;
+        int pid = udp_socket_.local_endpoint(ec).port();
+        return Trace::chrome_json("MidiJam Client " + nickname_, pid, [this](int64_t local_ns) {
+            return clock_sync_.is_synchronized() ? clock_sync_.to_session(local_ns) : local_ns;
+        });
+    }
+
+    json get_tempo_status() const {
+        TempoState state = clock_generator_.state();
+        json tempo;
+        tempo["bpm"] = state.bpm();
+        tempo["running"] = state.running;
+        tempo["position"] = state.position_at(clock_sync_.session_now_ns()) / TempoState::CLOCKS_PER_BEAT; // In beats
+        return tempo;
+    }
+
+    // Ask the server's tempo master to start/stop/relocate or change tempo (see TempoState::CMD_*)
+    void send_transport(int64_t command, int64_t value) noexcept {
+        if (!online()) return;
+        auto request = std::make_shared<std::vector<char>>(JamProtocol::TRANSPORT_SIZE);
+        JamProtocol::write_tag(request->data(), JamProtocol::TRANSPORT_TAG);
+        JamProtocol::write_i64(request->data() + JamProtocol::TAG_SIZE, command);
+        JamProtocol::write_i64(request->data() + JamProtocol::TAG_SIZE + 8, value);
+        seal(*request);
+        udp_socket_.async_send_to(boost::asio::buffer(*request), server_endpoint(),
+            [request](const boost::system::error_code& ec, std::size_t) {
+                if (ec) logger.log("Transport send error: " + ec.message());
+            });
     }
 
+private:
+    void send_subscription(const Subscription& subscription) noexcept {
+        if (!online()) return; // Sent again once the session is back
+        auto request = std::make_shared<std::vector<char>>(JamProtocol::SUBSCRIBE_SIZE);
+        subscription.encode(request->data());
+        seal(*request);
+        udp_socket_.async_send_to(boost::asio::buffer(*request), server_endpoint(),
+            [request](const boost::system::error_code& ec, std::size_t) {
+                if (ec) logger.log("Subscription send error: " + ec.message());
+            });
+    }
+
+    // Ports come from the shared pool, so several sessions can read the same controller
+    // and play into the same synth
     void setup_midi(int in_port, int out_port, int in_port_2) {
         try {
-            midi_in_.openPort(in_port);
-            midi_in_.ignoreTypes(true, true, true);
-            midi_in_.setCallback(&midi_callback, this);
-            if (in_port_2 >= 0 && in_port_2 != in_port) {
-                midi_in_2_.openPort(in_port_2);
-                midi_in_2_.ignoreTypes(true, true, true);
-                midi_in_2_.setCallback(&midi_callback, this);
-                has_second_input_ = true;
-            }
-            midi_out_.openPort(out_port);
+            midi_out_ = midi_ports_.acquire_output(static_cast<unsigned int>(out_port));
+            int ports[2] = {in_port, in_port_2 != in_port ? in_port_2 : -1};
+            for (std::size_t input = 0; input < 2; ++input) {
+                int port = ports[input];
+                if (port < 0) continue;
+                int token = midi_ports_.subscribe_input(static_cast<unsigned int>(port),
+                    [this, input](const std::vector<unsigned char>& msg) { on_midi_input(input, msg); });
+                midi_inputs_.emplace_back(static_cast<unsigned int>(port), token);
+            }
             logger.log("MIDI ports opened: in=" + std::to_string(in_port) + ", out=" + std::to_string(out_port) +
                        ", in2=" + std::to_string(in_port_2));
-        } catch (const RtMidiError& e) {
+        } catch (const std::exception& e) {
+            release_midi();
             throw std::runtime_error(std::string("MIDI setup error: ") + e.what());
         }
     }
 
+    void release_midi() noexcept {
+        for (const auto& [port, token] : midi_inputs_) {
+            midi_ports_.unsubscribe_input(port, token);
+        }
+        midi_inputs_.clear();
+    }
+
     void start_receive() noexcept {
         auto sender = std::make_shared<udp::endpoint>();
         json_buffer_.fill(0);
         if (logger.is_debug_mode()) {
-            logger.log("Starting async receive from " + server_endpoint_.address().to_string() + ":" + std::to_string(server_endpoint_.port()));
+            logger.log("Starting async receive from " + endpoint_name(server_endpoint()));
         }
         udp_socket_.async_receive_from(
             boost::asio::buffer(json_buffer_), *sender,
-            [this, sender](const boost::system::error_code& ec, std::size_t bytes) {
-                if (ec) {
+            [this, self = shared_from_this(), sender](const boost::system::error_code& ec, std::size_t bytes) {
+                int64_t recv_ns = ClockSync::local_now_ns(); // Taken first for clock sync accuracy
+                if (ec == boost::asio::error::operation_aborted) {
+                    return; // Socket closed by disconnect()
+                } else if (ec) {
                     logger.log("Receive error: " + ec.message() + " (code: " + std::to_string(ec.value()) + ")");
+                } else if (link_state_ == LinkState::Connecting || link_state_ == LinkState::Reconnecting) {
+                    handle_handshake_reply(bytes);
+                } else if (!online()) {
+                    // Failed: nothing to talk about until disconnect()
+                } else if (!open_datagram(bytes)) {
+                    if (logger.is_debug_mode()) {
+                        logger.log("Dropped unauthenticated datagram from " + sender->address().to_string());
+                    }
                 } else if (bytes > 0) {
+                    last_heard_ = std::chrono::steady_clock::now();
                     std::ostringstream log_msg;
                     log_msg << "Received " << bytes << " bytes from "
                             << sender->address().to_string() << ":" << sender->port() << " - Raw: ";
@@ -359,12 +1138,25 @@ private:
                     if (logger.is_debug_mode()) {
                         logger.log(log_msg.str());
                     }
-                    if (bytes == 4 && std::memcmp(json_buffer_.data(), "PING", 4) == 0) {
+                    if (JamProtocol::has_tag(json_buffer_.data(), bytes, JamProtocol::SYNC_REPLY_TAG, JamProtocol::SYNC_REPLY_SIZE)) {
+                        const char* p = json_buffer_.data() + JamProtocol::TAG_SIZE;
+                        clock_sync_.add_sample(JamProtocol::read_i64(p), JamProtocol::read_i64(p + 8),
+                                               JamProtocol::read_i64(p + 16), recv_ns);
+                    } else if (JamProtocol::has_tag(json_buffer_.data(), bytes, JamProtocol::TEMPO_TAG, JamProtocol::TEMPO_SIZE)) {
+                        TempoState state;
+                        if (TempoState::decode(json_buffer_.data(), bytes, state)) {
+                            clock_generator_.update(state);
+                        }
+                    } else if (JamProtocol::has_tag(json_buffer_.data(), bytes, JamProtocol::PING_TAG, JamProtocol::PING_SIZE)) {
                         if (logger.is_debug_mode()) {
                             logger.log("Received PING, sending PONG");
                         }
+                        // Echo the server's timestamp so it can measure the round trip exactly
+                        std::array<char, JamProtocol::PING_SIZE> pong;
+                        std::memcpy(pong.data(), json_buffer_.data(), JamProtocol::PING_SIZE);
+                        JamProtocol::write_tag(pong.data(), JamProtocol::PONG_TAG);
                         boost::system::error_code send_ec;
-                        udp_socket_.send_to(boost::asio::buffer("PONG", 4), server_endpoint_, 0, send_ec);
+                        send_now(pong.data(), pong.size(), send_ec);
                         if (send_ec) {
                             logger.log("PONG send error: " + send_ec.message());
                         } else {
@@ -372,12 +1164,38 @@ private:
                                 logger.log("PONG sent successfully");
                             }
                         }
+                    } else if (JamProtocol::has_tag(json_buffer_.data(), bytes, JamProtocol::SHUTDOWN_TAG, JamProtocol::SHUTDOWN_SIZE)) {
+                        server_closed_ = true;
+                        connection_lost("the server is shutting down");
+                    } else if (JamProtocol::has_tag(json_buffer_.data(), bytes, JamProtocol::SESSION_TAG, JamProtocol::SESSION_SIZE)) {
+                        session_token_ = static_cast<uint64_t>(JamProtocol::read_i64(json_buffer_.data() + JamProtocol::TAG_SIZE));
+                        server_id_ = JamProtocol::read_u16(json_buffer_.data() + JamProtocol::TAG_SIZE + 8);
+                    } else if (is_ack(json_buffer_.data(), bytes)) {
+                        // A retransmitted handshake was answered twice
+                    } else if (JamProtocol::is_sysex_fragment(json_buffer_.data(), bytes)) {
+                        handle_sysex_fragment(bytes);
                     } else if (bytes >= 1 && (json_buffer_[0] & 0x80)) {
                         if (logger.is_debug_mode()) {
                             logger.log("Received MIDI data");
                         }
-                        std::vector<unsigned char> msg(json_buffer_.begin(), json_buffer_.begin() + bytes);
-                        MidiUtils::sendMidiMessage(midi_out_, msg);
+                        MIDIJAM_TRACE_AT(Trace::CLIENT_RECEIVE, recv_ns, json_buffer_.data(), bytes);
+                        // A datagram may carry several messages, possibly using running status
+                        MidiMessage::for_each(reinterpret_cast<const uint8_t*>(json_buffer_.data()), bytes,
+                            [this](const uint8_t* msg, std::size_t len) {
+                                midi_out_->send(msg, len);
+                            });
+                        MIDIJAM_TRACE(Trace::MIDI_OUT, json_buffer_.data(), bytes);
+                    } else if (Ump::is_packet(json_buffer_.data(), bytes)) {
+                        // Our ports speak MIDI 1.0: scale back down at the edge
+                        std::vector<char> midi;
+                        if (Ump::to_midi1(json_buffer_.data(), bytes, midi)) {
+                            MIDIJAM_TRACE_AT(Trace::CLIENT_RECEIVE, recv_ns, midi.data(), midi.size());
+                            MidiMessage::for_each(reinterpret_cast<const uint8_t*>(midi.data()), midi.size(),
+                                [this](const uint8_t* msg, std::size_t len) {
+                                    midi_out_->send(msg, len);
+                                });
+                            MIDIJAM_TRACE(Trace::MIDI_OUT, midi.data(), midi.size());
+                        }
                     } else {
                         std::string json_str(json_buffer_.data(), bytes);
                         if (logger.is_debug_mode()) {
@@ -388,6 +1206,7 @@ private:
                             if (!parsed_json.empty()) {
                                 std::lock_guard<std::mutex> lock(client_list_mutex_);
                                 last_client_list_ = parsed_json;
+                                ++client_list_version_;
                                 if (logger.is_debug_mode()) {
                                     logger.log("Updated client list");
                                 }
@@ -414,9 +1233,121 @@ private:
             });
     }
 
+    // Called from the RtMidi thread: split the dump into fragments and let the io thread pace them out
+    void queue_sysex(const std::vector<unsigned char>& msg) noexcept {
+        size_t count = (msg.size() + JamProtocol::SYSEX_FRAGMENT_PAYLOAD - 1) / JamProtocol::SYSEX_FRAGMENT_PAYLOAD;
+        std::lock_guard<std::mutex> lock(sysex_mutex_);
+        if (count > JamProtocol::SYSEX_MAX_FRAGMENTS || sysex_backlog_ + msg.size() > MAX_SYSEX_BACKLOG) {
+            logger.log("Dropping SysEx of " + std::to_string(msg.size()) + " bytes (too large or backlog full)");
+            return;
+        }
+        uint16_t message_id = next_sysex_id_++;
+        for (size_t i = 0; i < count; ++i) {
+            size_t offset = i * JamProtocol::SYSEX_FRAGMENT_PAYLOAD;
+            size_t len = std::min(JamProtocol::SYSEX_FRAGMENT_PAYLOAD, msg.size() - offset);
+            std::vector<char> fragment(JamProtocol::SYSEX_HEADER_SIZE + len);
+            JamProtocol::write_tag(fragment.data(), JamProtocol::SYSEX_TAG);
+            JamProtocol::write_u16(fragment.data() + JamProtocol::TAG_SIZE, 0); // Source, stamped by the server
+            JamProtocol::write_u16(fragment.data() + JamProtocol::TAG_SIZE + 2, message_id);
+            JamProtocol::write_u16(fragment.data() + JamProtocol::TAG_SIZE + 4, static_cast<uint16_t>(i));
+            JamProtocol::write_u16(fragment.data() + JamProtocol::TAG_SIZE + 6, static_cast<uint16_t>(count));
+            std::memcpy(fragment.data() + JamProtocol::SYSEX_HEADER_SIZE, msg.data() + offset, len);
+            sysex_queue_.push_back(std::move(fragment));
+        }
+        sysex_backlog_ += msg.size();
+        if (!sysex_sending_) {
+            sysex_sending_ = true;
+            boost::asio::post(io_context_, [self = shared_from_this()]() { self->send_next_sysex_fragment(); });
+        }
+    }
+
+    void send_next_sysex_fragment() noexcept {
+        std::vector<char> fragment;
+        {
+            std::lock_guard<std::mutex> lock(sysex_mutex_);
+            if (sysex_queue_.empty() || !running_) {
+                sysex_sending_ = false;
+                return;
+            }
+            fragment = std::move(sysex_queue_.front());
+            sysex_queue_.pop_front();
+            sysex_backlog_ -= std::min(sysex_backlog_, fragment.size() - JamProtocol::SYSEX_HEADER_SIZE);
+        }
+        boost::system::error_code send_ec;
+        send_now(fragment.data(), fragment.size(), send_ec);
+        if (send_ec) {
+            logger.log("SysEx send error: " + send_ec.message());
+        }
+        sysex_timer_.expires_after(SYSEX_FRAGMENT_INTERVAL);
+        sysex_timer_.async_wait([this, self = shared_from_this()](const boost::system::error_code& ec) {
+            if (ec) {
+                std::lock_guard<std::mutex> lock(sysex_mutex_);
+                sysex_sending_ = false;
+                return;
+            }
+            send_next_sysex_fragment();
+        });
+    }
+
+    void handle_sysex_fragment(std::size_t bytes) noexcept {
+        const char* header = json_buffer_.data() + JamProtocol::TAG_SIZE;
+        uint16_t source = JamProtocol::read_u16(header);
+        uint16_t message_id = JamProtocol::read_u16(header + 2);
+        uint16_t index = JamProtocol::read_u16(header + 4);
+        uint16_t count = JamProtocol::read_u16(header + 6);
+        if (count == 0 || count > JamProtocol::SYSEX_MAX_FRAGMENTS || index >= count) return;
+
+        SysexAssembly& assembly = sysex_inbound_[source];
+        if (index == 0) {
+            assembly.message_id = message_id;
+            assembly.next_index = 0;
+            assembly.data.clear();
+        }
+        if (assembly.message_id != message_id || assembly.next_index != index) {
+            // A lost or reordered fragment ruins the dump; wait for the next one to start
+            if (logger.is_debug_mode()) {
+                logger.log("Discarding incomplete SysEx from source " + std::to_string(source));
+            }
+            assembly.data.clear();
+            assembly.next_index = 0;
+            return;
+        }
+        const unsigned char* payload = reinterpret_cast<const unsigned char*>(json_buffer_.data()) + JamProtocol::SYSEX_HEADER_SIZE;
+        assembly.data.insert(assembly.data.end(), payload, payload + (bytes - JamProtocol::SYSEX_HEADER_SIZE));
+        if (++assembly.next_index == count) {
+            if (assembly.data.size() >= 2 && assembly.data.front() == 0xF0 && assembly.data.back() == 0xF7) {
+                midi_out_->send(assembly.data);
+            }
+            sysex_inbound_.erase(source);
+        }
+    }
+
+    void start_clock_sync() noexcept {
+        clock_sync_timer_.expires_after(clock_sync_burst_left_ > 0 ? CLOCK_SYNC_BURST_INTERVAL : CLOCK_SYNC_INTERVAL);
+        clock_sync_timer_.async_wait([this, self = shared_from_this()](const boost::system::error_code& ec) {
+            if (ec || !running_) return;
+            // The replies double as the server's heartbeat
+            if (online() && std::chrono::steady_clock::now() - last_heard_ > SERVER_SILENCE_TIMEOUT) {
+                connection_lost("the server went silent");
+            }
+            if (online()) {
+                if (clock_sync_burst_left_ > 0) --clock_sync_burst_left_;
+                std::array<char, JamProtocol::SYNC_SIZE> request;
+                JamProtocol::write_tag(request.data(), JamProtocol::SYNC_TAG);
+                JamProtocol::write_i64(request.data() + JamProtocol::TAG_SIZE, ClockSync::local_now_ns());
+                boost::system::error_code send_ec;
+                send_now(request.data(), request.size(), send_ec);
+                if (send_ec) {
+                    logger.log("SYNC send error: " + send_ec.message());
+                }
+            }
+            start_clock_sync();
+        });
+    }
+
     void start_client_list_requests() noexcept {
         client_list_timer_.expires_after(CLIENT_LIST_INTERVAL);
-        client_list_timer_.async_wait([this](const boost::system::error_code& ec) {
+        client_list_timer_.async_wait([this, self = shared_from_this()](const boost::system::error_code& ec) {
             if (ec) {
                 if (ec == boost::asio::error::operation_aborted) {
                     if (logger.is_debug_mode()) {
@@ -427,17 +1358,25 @@ private:
                 }
                 return;
             }
-            if (!running_ || !connected_) {
+            if (!running_) {
                 if (logger.is_debug_mode()) {
                     logger.log("CLIST request skipped: running=" + std::to_string(running_) + ", connected=" + std::to_string(connected_));
                 }
                 return;
             }
+            if (!online()) {
+                start_client_list_requests(); // Reconnecting
+                return;
+            }
             if (logger.is_debug_mode()) {
                 logger.log("Sending CLIST request to server");
             }
             boost::system::error_code send_ec;
-            udp_socket_.send_to(boost::asio::buffer("CLIST", 5), server_endpoint_, 0, send_ec);
+            send_now("CLIST", 5, send_ec);
+            {
+                std::lock_guard<std::mutex> lock(subscriptions_mutex_);
+                for (const auto& [sender, subscription] : subscriptions_) send_subscription(subscription);
+            }
             if (send_ec) {
                 logger.log("CLIST send error: " + send_ec.message());
             } else {
@@ -445,7 +1384,7 @@ private:
                     logger.log("CLIST sent successfully, rescheduling");
                 }
             }
-            if (running_ && connected_) {
+            if (running_) {
                 start_client_list_requests(); // Reschedule if still running
             } else {
                 if (logger.is_debug_mode()) {
@@ -457,57 +1396,168 @@ private:
 };
 
 class HttpServer {
+    // A JSON response serialized once per change of the state it was built from
+    struct CachedJson {
+        bool valid = false;
+        uint64_t version = 0;
+        std::string body;
+        std::string etag;
+    };
+
+    // One connection; requests are served in order until the browser closes it or goes idle
+    struct Connection {
+        explicit Connection(tcp::socket socket) : stream(std::move(socket)) {}
+        beast::tcp_stream stream;
+        beast::flat_buffer buffer;
+        http::request<http::string_body> request;
+        http::response<http::string_body> response;
+    };
+
+    // Cached responses of one session's endpoints (key 0: no session, defaults only)
+    struct SessionCache {
+        CachedJson config;
+        CachedJson clients;
+        CachedJson status;
+        std::chrono::steady_clock::time_point status_built;
+    };
+
     boost::asio::io_context& io_context_;
+    boost::asio::io_context& network_context_; // Every session's sockets and timers run here
     tcp::acceptor acceptor_;
-    std::shared_ptr<MidiJamClient> client_;
-    std::filesystem::path static_dir_;
-    json cached_midi_ports_; // Added: Cache for MIDI ports
-    std::chrono::steady_clock::time_point last_midi_update_; // Added: Last update timestamp
-    mutable std::mutex client_mutex_; // Protect access to `client_`
-    static constexpr auto MIDI_UPDATE_INTERVAL = std::chrono::seconds(30); // Added: Update interval
+    MidiPortPool midi_port_pool_; // Outlives the sessions using it
+    std::map<int, std::shared_ptr<MidiJamClient>> sessions_;
+    int default_session_ = 0; // Target of /start, /stop, /status...; 0 if none
+    int next_session_id_ = 1;
+    uint64_t client_generation_ = 0; // Bumped on every start/stop so cached client JSON is rebuilt
+    mutable std::mutex client_mutex_; // Protect access to `sessions_`
+
+    // MIDI ports are enumerated on a background thread; ALSA can block for tens of ms
+    std::mutex midi_ports_mutex_;
+    CachedJson midi_ports_;
+    std::thread midi_ports_thread_;
+    std::condition_variable midi_ports_cv_;
+    bool stopping_ = false;
+    static constexpr auto MIDI_UPDATE_INTERVAL = std::chrono::seconds(5);
+
+    std::mutex json_cache_mutex_; // Taken before client_mutex_
+    std::map<int, SessionCache> json_caches_;
+    static constexpr auto STATUS_CACHE_TTL = std::chrono::milliseconds(250); // Clock and tempo fields drift continuously
+    static constexpr auto KEEP_ALIVE_TIMEOUT = std::chrono::seconds(30);
 public:
-    HttpServer(boost::asio::io_context& ioc, short port = 8080, const std::string& static_dir = "static")
-        : io_context_(ioc), acceptor_(ioc, tcp::endpoint(tcp::v4(), port)), static_dir_(static_dir) {
+    HttpServer(boost::asio::io_context& ioc, boost::asio::io_context& network_context, short port = 8080)
+        : io_context_(ioc), network_context_(network_context), acceptor_(ioc, tcp::endpoint(tcp::v4(), port)) {
         update_midi_ports(); // Initialize MIDI port cache
+        midi_ports_thread_ = std::thread([this]() { refresh_midi_ports(); });
         start_accept();
         logger.log("HTTP server running at http://localhost:" + std::to_string(port));
     }
 
+    ~HttpServer() {
+        {
+            std::lock_guard<std::mutex> lock(midi_ports_mutex_);
+            stopping_ = true;
+        }
+        midi_ports_cv_.notify_all();
+        if (midi_ports_thread_.joinable()) midi_ports_thread_.join();
+        stop_sessions();
+    }
+
+    void stop_sessions() {
+        std::lock_guard<std::mutex> lock(client_mutex_);
+        for (auto& [id, session] : sessions_) {
+            session->disconnect();
+        }
+        sessions_.clear();
+        default_session_ = 0;
+        ++client_generation_;
+    }
+
 private:
     void start_accept() {
-        auto socket = std::make_shared<boost::asio::ip::tcp::socket>(io_context_); // Use io_context_ member
-        acceptor_.async_accept(*socket, [this, socket](boost::system::error_code ec) {
+        acceptor_.async_accept([this](boost::system::error_code ec, tcp::socket socket) {
             if (!ec) {
-                handle_request(socket);
+                read_request(std::make_shared<Connection>(std::move(socket)));
             }
-            boost::asio::post(io_context_, [this]() {
-                std::this_thread::sleep_for(std::chrono::milliseconds(10));
-                start_accept();
-            });
+            if (ec != boost::asio::error::operation_aborted) start_accept();
         });
     }
 
-    void handle_request(std::shared_ptr<tcp::socket> socket) {
-        auto buffer = std::make_shared<beast::flat_buffer>();
-        auto request = std::make_shared<http::request<http::string_body>>();
-        http::async_read(*socket, *buffer, *request,
-            [this, socket, buffer, request](boost::system::error_code ec, std::size_t) {
-                if (!ec) {
-                    process_request(socket, *request);
+    void read_request(std::shared_ptr<Connection> connection) {
+        connection->request = {};
+        connection->stream.expires_after(KEEP_ALIVE_TIMEOUT);
+        http::async_read(connection->stream, connection->buffer, connection->request,
+            [this, connection](boost::system::error_code ec, std::size_t) {
+                if (ec) {
+                    beast::error_code ignored;
+                    connection->stream.socket().shutdown(tcp::socket::shutdown_send, ignored);
+                    return;
                 }
+                connection->response = {};
+                process_request(connection->request, connection->response);
+                connection->response.prepare_payload();
+                http::async_write(connection->stream, connection->response,
+                    [this, connection](boost::system::error_code ec, std::size_t) {
+                        if (ec) return;
+                        if (connection->response.keep_alive()) {
+                            read_request(connection);
+                        } else {
+                            beast::error_code ignored;
+                            connection->stream.socket().shutdown(tcp::socket::shutdown_send, ignored);
+                        }
+                    });
             });
     }
 
-    std::string readFile(const std::filesystem::path& filepath) {
-        std::ifstream file(filepath, std::ios::in);
-        if (!file.is_open()) {
-            logger.log("Failed to open file: " + filepath.string());
-            return "Error: Could not load HTML file.";
+    static std::string make_etag(const std::string& body) {
+        uint64_t hash = 14695981039346656037ull; // FNV-1a
+        for (unsigned char c : body) hash = (hash ^ c) * 1099511628211ull;
+        std::ostringstream etag;
+        etag << '"' << std::hex << hash << '"';
+        return etag.str();
+    }
+
+    static bool accepts_gzip(const http::request<http::string_body>& request) {
+        auto accept = request[http::field::accept_encoding];
+        return accept.find("gzip") != beast::string_view::npos;
+    }
+
+    // 304 if the browser already has this version, otherwise the body (gzipped if possible)
+    static void serve_cached(const http::request<http::string_body>& request, http::response<http::string_body>& response,
+                             beast::string_view content_type, beast::string_view etag,
+                             beast::string_view body, beast::string_view gzip = beast::string_view()) {
+        response.set(http::field::etag, etag);
+        response.set(http::field::cache_control, "no-cache"); // Always revalidate, usually with a 304
+        if (request[http::field::if_none_match] == etag) {
+            response.result(http::status::not_modified);
+            return;
+        }
+        response.result(http::status::ok);
+        response.set(http::field::content_type, content_type);
+        if (!gzip.empty()) {
+            response.set(http::field::vary, "Accept-Encoding");
+            if (accepts_gzip(request)) {
+                response.set(http::field::content_encoding, "gzip");
+                response.body().assign(gzip.data(), gzip.size());
+                return;
+            }
+        }
+        response.body().assign(body.data(), body.size());
+    }
+
+    static void store(CachedJson& cache, uint64_t version, const json& value) {
+        cache.valid = true;
+        cache.version = version;
+        cache.body = value.dump();
+        cache.etag = make_etag(cache.body);
+    }
+
+    void refresh_midi_ports() {
+        std::unique_lock<std::mutex> lock(midi_ports_mutex_);
+        while (!midi_ports_cv_.wait_for(lock, MIDI_UPDATE_INTERVAL, [this]() { return stopping_; })) {
+            lock.unlock();
+            update_midi_ports();
+            lock.lock();
         }
-        std::string content((std::istreambuf_iterator<char>(file)),
-                            std::istreambuf_iterator<char>());
-        file.close();
-        return content;
     }
 
     void update_midi_ports() {
@@ -518,55 +1568,218 @@ private:
         ports["outputs"] = json::array();
         unsigned int in_count = midi_in.getPortCount();
         unsigned int out_count = midi_out.getPortCount();
-        logger.log("MIDI ports detected: inputs=" + std::to_string(in_count) + ", outputs=" + std::to_string(out_count));
         for (unsigned int i = 0; i < in_count; i++) {
             ports["inputs"].push_back(midi_in.getPortName(i));
         }
         for (unsigned int i = 0; i < out_count; i++) {
             ports["outputs"].push_back(midi_out.getPortName(i));
         }
-        cached_midi_ports_ = ports;
-        last_midi_update_ = std::chrono::steady_clock::now();
+        std::string body = ports.dump();
+        std::lock_guard<std::mutex> lock(midi_ports_mutex_);
+        if (midi_ports_.valid && midi_ports_.body == body) return;
+        logger.log("MIDI ports detected: inputs=" + std::to_string(in_count) + ", outputs=" + std::to_string(out_count));
+        midi_ports_.valid = true;
+        ++midi_ports_.version;
+        midi_ports_.etag = make_etag(body);
+        midi_ports_.body = std::move(body);
     }
 
-    void process_request(std::shared_ptr<tcp::socket> socket, http::request<http::string_body>& request) {
-        http::response<http::string_body> response;
+    // "/sessions/{id}" or "/sessions/{id}/status" etc.; `action` gets the part after the id
+    static bool parse_session_target(const std::string& target, int& id, std::string& action) {
+        static const std::string PREFIX = "/sessions/";
+        if (target.compare(0, PREFIX.size(), PREFIX) != 0) return false;
+        size_t end = target.find('/', PREFIX.size());
+        std::string digits = target.substr(PREFIX.size(), end == std::string::npos ? std::string::npos : end - PREFIX.size());
+        if (digits.empty() || digits.size() > 9 || digits.find_first_not_of("0123456789") != std::string::npos) {
+            id = -1; // Never a valid session, so the request gets a 404
+        } else {
+            id = std::stoi(digits);
+        }
+        action = end == std::string::npos ? std::string() : target.substr(end);
+        return true;
+    }
+
+    static Subscription parse_subscription(const MidiJamClient& client, const json& body) {
+        Subscription subscription;
+        if (body.contains("sender")) {
+            const json& sender = body.at("sender");
+            int id = sender.is_string() ? client.sender_id(sender.get<std::string>()) : sender.get<int>();
+            if (id <= 0 || id > 0xFFFF) throw std::runtime_error("Unknown sender " + sender.dump());
+            subscription.sender = static_cast<uint16_t>(id);
+        }
+        if (body.contains("channels")) {
+            subscription.channels = 0;
+            for (const auto& channel : body.at("channels")) {
+                int c = channel.get<int>();
+                if (c < 0 || c > 15) throw std::runtime_error("Channel out of range: " + std::to_string(c));
+                subscription.channels |= static_cast<uint16_t>(1u << c);
+            }
+        }
+        if (body.value("mute", false)) subscription.channels = 0;
+        if (body.contains("remap")) {
+            for (const auto& [from, to] : body.at("remap").items()) {
+                int source = std::stoi(from);
+                int target = to.get<int>();
+                if (source < 0 || source > 15 || target < 0 || target > 15) {
+                    throw std::runtime_error("Invalid remap entry: \"" + from + "\": " + to.dump());
+                }
+                subscription.remap[source] = static_cast<uint8_t>(target);
+            }
+        }
+        return subscription;
+    }
+
+    // Caller holds client_mutex_. Id 0 means the default session.
+    std::shared_ptr<MidiJamClient> session_for(int id) const {
+        auto it = sessions_.find(id ? id : default_session_);
+        return it == sessions_.end() ? nullptr : it->second;
+    }
+
+    // ["10.0.0.5:5000", ...]: candidate servers, as IP literals like "server_ip"
+    static std::vector<udp::endpoint> parse_servers(const json& servers) {
+        if (!servers.is_array() || servers.empty() || servers.size() > ServerProber::MAX_CANDIDATES) {
+            throw std::runtime_error("\"servers\" must list 1 to " + std::to_string(ServerProber::MAX_CANDIDATES) + " \"ip:port\" entries");
+        }
+        std::vector<udp::endpoint> endpoints;
+        for (const json& server : servers) {
+            std::string text = server.get<std::string>();
+            std::size_t colon = text.rfind(':');
+            int port = colon == std::string::npos ? 0 : std::atoi(text.c_str() + colon + 1);
+            if (port <= 0 || port > 65535) throw std::runtime_error("Invalid server \"" + text + "\"; expected ip:port");
+            endpoints.emplace_back(boost::asio::ip::make_address(text.substr(0, colon)), static_cast<unsigned short>(port));
+        }
+        return endpoints;
+    }
+
+    // Connects a new session; throws if the config is incomplete or the server doesn't answer
+    int start_session(const json& config, bool replace_default) {
+        std::vector<udp::endpoint> candidates;
+        if (config.contains("servers")) candidates = parse_servers(config.at("servers"));
+        std::string server_ip = candidates.empty() ? config.at("server_ip").get<std::string>() : candidates[0].address().to_string();
+        short server_port = candidates.empty() ? static_cast<short>(config.at("server_port").get<int64_t>())
+                                               : static_cast<short>(candidates[0].port());
+        std::string nickname = config.at("nickname").get<std::string>();
+        int midi_in_port = static_cast<int>(config.at("midi_in").get<int64_t>());
+        int midi_out_port = static_cast<int>(config.at("midi_out").get<int64_t>());
+        int midi_in_port_2 = static_cast<int>(config.at("midi_in_2").get<int64_t>());
+        uint8_t midi_channel = static_cast<uint8_t>(config.at("channel").get<int64_t>());
+        std::string password = config.value("password", "");
+        std::string transport = config.value("transport", "midi1");
+        if (transport != "midi1" && transport != "ump") {
+            throw std::runtime_error("Invalid transport \"" + transport + "\"; expected \"midi1\" or \"ump\"");
+        }
+        int id;
+        std::shared_ptr<MidiJamClient> replaced;
+        {
+            std::lock_guard<std::mutex> cache_lock(json_cache_mutex_);
+            std::lock_guard<std::mutex> lock(client_mutex_);
+            if (replace_default && default_session_) {
+                replaced = sessions_.at(default_session_);
+                sessions_.erase(default_session_);
+                json_caches_.erase(default_session_);
+                default_session_ = 0;
+                ++client_generation_;
+            }
+            id = next_session_id_++;
+        }
+        // Connecting retries with backoff and may probe servers first, so no lock is held
+        // until the session is published; other requests keep being served meanwhile
+        if (replaced) replaced->disconnect(); // Free its ports and server slot before the new one claims them
+        auto session = std::make_shared<MidiJamClient>(network_context_, midi_port_pool_, id, server_ip, server_port,
+            nickname, midi_in_port, midi_out_port, midi_in_port_2, midi_channel, password);
+        if (config.contains("routing")) session->set_routing(config.at("routing"));
+        if (candidates.size() > 1) session->set_candidates(std::move(candidates));
+        session->set_ump(transport == "ump");
+        session->connect();
+        std::lock_guard<std::mutex> cache_lock(json_cache_mutex_);
+        std::lock_guard<std::mutex> lock(client_mutex_);
+        sessions_[id] = session;
+        if (!default_session_ || replace_default) default_session_ = id;
+        ++client_generation_;
+        return id;
+    }
+
+    void process_request(const http::request<http::string_body>& request, http::response<http::string_body>& response) {
         response.version(request.version());
         response.set(http::field::server, "MidiJam Client");
-        response.keep_alive(false);
+        response.keep_alive(request.keep_alive());
         try {
+            // Per-session endpoints live under /sessions/{id}; the original ones act on the default session
+            std::string target(request.target());
+            std::string action = target;
+            int session_id = 0;
+            bool addressed = parse_session_target(target, session_id, action);
+            if (addressed) {
+                std::lock_guard<std::mutex> lock(client_mutex_);
+                if (!sessions_.count(session_id)) {
+                    response.result(http::status::not_found);
+                    response.body() = "Unknown session!";
+                    return;
+                }
+            }
             // Handle GET requests
-            if (request.method() == http::verb::get && request.target() == "/") {
-                // Serve the main HTML page
-                response.result(http::status::ok);
-                response.set(http::field::content_type, "text/html");
-                response.body() = readFile(static_dir_ / "index.html");
-            } else if (request.method() == http::verb::get && request.target() == "/midi-ports") {
+            const EmbeddedAsset* asset = request.method() == http::verb::get
+                ? find_embedded_asset(std::string_view(request.target().data(), request.target().size())) : nullptr;
+            if (asset) {
+                // The web UI is compiled into the binary; the browser revalidates with If-None-Match
+                serve_cached(request, response,
+                             beast::string_view(asset->content_type.data(), asset->content_type.size()),
+                             beast::string_view(asset->etag.data(), asset->etag.size()),
+                             beast::string_view(reinterpret_cast<const char*>(asset->data), asset->size),
+                             beast::string_view(reinterpret_cast<const char*>(asset->gzip), asset->gzip_size));
+            } else if (request.method() == http::verb::get && target == "/midi-ports") {
                 // Return the list of available MIDI ports as JSON
-                response.result(http::status::ok);
-                response.set(http::field::content_type, "application/json");
-                if (std::chrono::steady_clock::now() - last_midi_update_ > MIDI_UPDATE_INTERVAL) {
-                    update_midi_ports(); // Refresh MIDI port cache if outdated
+                std::lock_guard<std::mutex> lock(midi_ports_mutex_);
+                serve_cached(request, response, "application/json", midi_ports_.etag, midi_ports_.body);
+            } else if (request.method() == http::verb::get && target == "/sessions") {
+                // Every session with its routing: {"default": 1, "sessions": [{"id": 1, "isConnected": true, "config": {...}}]}
+                std::lock_guard<std::mutex> lock(client_mutex_);
+                json list;
+                list["default"] = default_session_;
+                list["sessions"] = json::array();
+                for (const auto& [id, session] : sessions_) {
+                    list["sessions"].push_back({{"id", id}, {"isConnected", session->is_connected()}, {"config", session->get_config()}});
                 }
-                response.body() = cached_midi_ports_.dump(); // Serialize using Nlohmann
-            } else if (request.method() == http::verb::get && request.target() == "/status") {
-                // Return the connection status of the client
                 response.result(http::status::ok);
                 response.set(http::field::content_type, "application/json");
-                json status;
-                {
-                    std::lock_guard<std::mutex> lock(client_mutex_);
-                    status["isConnected"] = client_ && client_->is_connected();
+                response.set(http::field::cache_control, "no-store");
+                response.body() = list.dump();
+            } else if (request.method() == http::verb::get && action == "/status") {
+                // Return the connection status of the client
+                std::lock_guard<std::mutex> cache_lock(json_cache_mutex_);
+                auto now = std::chrono::steady_clock::now();
+                std::lock_guard<std::mutex> lock(client_mutex_);
+                auto client = session_for(session_id);
+                SessionCache& cache = json_caches_[client ? client->id() : 0];
+                if (!cache.status.valid || cache.status.version != client_generation_ || now - cache.status_built > STATUS_CACHE_TTL) {
+                    json status;
+                    status["isConnected"] = client && client->is_connected();
+                    if (client && client->is_connected()) {
+                        status["id"] = client->id();
+                        status["serverClosed"] = client->server_closed();
+                        status["link"] = client->link_state_name();
+                        status["reconnects"] = client->reconnects();
+                        status["serverId"] = client->server_id();
+                        status["relays"] = client->get_relay_status();
+                        status["clock"] = client->get_clock_status();
+                        status["tempo"] = client->get_tempo_status();
+                    }
+                    store(cache.status, client_generation_, status);
+                    cache.status_built = now;
                 }
-                response.body() = status.dump(); // Serialize using Nlohmann
-            } else if (request.method() == http::verb::get && request.target() == "/config") {
                 response.result(http::status::ok);
                 response.set(http::field::content_type, "application/json");
-                json config;
-                {
-                    std::lock_guard<std::mutex> lock(client_mutex_);
-                    if (client_ && client_->is_connected()) {
-                        config = client_->get_config();
+                response.set(http::field::cache_control, "no-store");
+                response.body() = cache.status.body;
+            } else if (request.method() == http::verb::get && action == "/config") {
+                std::lock_guard<std::mutex> cache_lock(json_cache_mutex_);
+                std::lock_guard<std::mutex> lock(client_mutex_);
+                auto client = session_for(session_id);
+                SessionCache& cache = json_caches_[client ? client->id() : 0];
+                if (!cache.config.valid || cache.config.version != client_generation_) {
+                    json config;
+                    if (client && client->is_connected()) {
+                        config = client->get_config();
                     } else {
                         // Provide defaults when no client is connected
                         config["server_ip"] = "127.0.0.1";
@@ -577,17 +1790,21 @@ private:
                         config["midi_in_2"] = -1; // No second input by default
                         config["channel"] = 0;  // Default to channel 1 (0-based)
                     }
+                    store(cache.config, client_generation_, config);
                 }
-                response.body() = config.dump(); // Serialize using Nlohmann
-            } else if (request.method() == http::verb::get && request.target() == "/clients") {
+                serve_cached(request, response, "application/json", cache.config.etag, cache.config.body);
+            } else if (request.method() == http::verb::get && action == "/clients") {
                 // Return the list of connected clients from the server
-                response.result(http::status::ok);
-                response.set(http::field::content_type, "application/json");
-                json client_list;
-                {
-                    std::lock_guard<std::mutex> lock(client_mutex_);
-                    if (client_) {
-                        auto client_list_value = client_->get_client_list();
+                std::lock_guard<std::mutex> cache_lock(json_cache_mutex_);
+                std::lock_guard<std::mutex> lock(client_mutex_);
+                auto client = session_for(session_id);
+                SessionCache& cache = json_caches_[client ? client->id() : 0];
+                // Generation in the high bits, list version in the low bits
+                uint64_t version = (client_generation_ << 40) | (client ? client->client_list_version() : 0);
+                if (!cache.clients.valid || cache.clients.version != version) {
+                    json client_list;
+                    if (client) {
+                        auto client_list_value = client->get_client_list();
                         if (!client_list_value.empty()) {
                             client_list = client_list_value;
                         } else {
@@ -596,43 +1813,47 @@ private:
                     } else {
                         client_list["clients"] = json::array(); // Return an empty array if no client is connected
                     }
+                    store(cache.clients, version, client_list);
                 }
-                response.body() = client_list.dump(); // Serialize using Nlohmann
+                serve_cached(request, response, "application/json", cache.clients.etag, cache.clients.body);
             }
             // Handle POST requests
-            else if (request.method() == http::verb::post && request.target() == "/stop") {
-                // Stop the client if it's running
+            else if ((request.method() == http::verb::post && target == "/stop") ||
+                     (request.method() == http::verb::delete_ && addressed && action.empty())) {
+                // Stop the default session, or the one addressed by DELETE /sessions/{id}
+                std::lock_guard<std::mutex> cache_lock(json_cache_mutex_);
                 std::lock_guard<std::mutex> lock(client_mutex_);
-                if (client_) {
-                    client_->disconnect();
-                    client_.reset();
+                int id = addressed ? session_id : default_session_;
+                auto it = sessions_.find(id);
+                if (it != sessions_.end()) {
+                    it->second->disconnect();
+                    sessions_.erase(it);
+                    json_caches_.erase(id);
+                    if (default_session_ == id) default_session_ = sessions_.empty() ? 0 : sessions_.begin()->first;
+                    ++client_generation_;
                     response.result(http::status::ok);
                     response.body() = "Client disconnected!";
                     if (logger.is_debug_mode()) {
-                        logger.log("Client stopped successfully");
+                        logger.log("Session " + std::to_string(id) + " stopped successfully");
                     }
                 } else {
                     response.result(http::status::bad_request);
                     response.body() = "No active client to disconnect!";
                 }
             }
-            else if (request.method() == http::verb::post && request.target() == "/start") {
+            else if (request.method() == http::verb::post && (target == "/start" || target == "/sessions")) {
+                // /start replaces the default session; POST /sessions adds one alongside the others
                 try {
-                    auto config = json::parse(request.body()); // Parse using Nlohmann
-                    std::string server_ip = config.at("server_ip").get<std::string>();
-                    short server_port = static_cast<short>(config.at("server_port").get<int64_t>());
-                    std::string nickname = config.at("nickname").get<std::string>();
-                    int midi_in_port = static_cast<int>(config.at("midi_in").get<int64_t>());
-                    int midi_out_port = static_cast<int>(config.at("midi_out").get<int64_t>());
-                    int midi_in_port_2 = static_cast<int>(config.at("midi_in_2").get<int64_t>());
-                    uint8_t midi_channel = static_cast<uint8_t>(config.at("channel").get<int64_t>());
-                    std::lock_guard<std::mutex> lock(client_mutex_);
-                    client_ = std::make_shared<MidiJamClient>(server_ip, server_port, nickname,
-                        midi_in_port, midi_out_port, midi_in_port_2, midi_channel);
+                    int id = start_session(json::parse(request.body()), target == "/start");
                     response.result(http::status::ok);
-                    response.body() = "Client connected!";
+                    if (target == "/start") {
+                        response.body() = "Client connected!";
+                    } else {
+                        response.set(http::field::content_type, "application/json");
+                        response.body() = json{{"id", id}}.dump();
+                    }
                     if (logger.is_debug_mode()) {
-                        logger.log("Client started successfully");
+                        logger.log("Session " + std::to_string(id) + " started successfully");
                     }
                 } catch (const std::exception& e) {
                     response.result(http::status::bad_request);
@@ -640,6 +1861,106 @@ private:
                     logger.log("Connection error: " + std::string(e.what()));
                 }
             }
+            else if (request.method() == http::verb::post && target == "/probe") {
+                // {"servers": ["ip:port", ...]}: one probe burst, to recommend a server before starting
+                auto prober = std::make_shared<ServerProber>(network_context_, parse_servers(json::parse(request.body()).at("servers")));
+                auto probed = std::make_shared<std::promise<void>>();
+                auto done = probed->get_future();
+                boost::asio::post(network_context_, [prober, probed]() { prober->probe([probed]() { probed->set_value(); }); });
+                done.wait();
+                boost::asio::post(network_context_, [prober]() { prober->close(); });
+                response.result(http::status::ok);
+                response.set(http::field::content_type, "application/json");
+                response.body() = json{{"servers", prober->results_json()}, {"best", prober->best()}}.dump();
+            }
+            else if (request.method() == http::verb::post && action == "/transport") {
+                // Transport control for the room: {"command": "start"|"stop"|"continue"|"tempo", "bpm": 120}
+                std::lock_guard<std::mutex> lock(client_mutex_);
+                auto client = session_for(session_id);
+                auto body = json::parse(request.body());
+                std::string command = body.at("command").get<std::string>();
+                if (!client || !client->is_connected()) {
+                    response.result(http::status::bad_request);
+                    response.body() = "No active client!";
+                } else if (command == "start" || command == "stop" || command == "continue") {
+                    client->send_transport(command == "start" ? TempoState::CMD_START :
+                                           command == "stop" ? TempoState::CMD_STOP : TempoState::CMD_CONTINUE, 0);
+                    response.result(http::status::ok);
+                    response.body() = "Transport " + command + " requested";
+                } else if (command == "tempo") {
+                    client->send_transport(TempoState::CMD_TEMPO, static_cast<int64_t>(body.at("bpm").get<double>() * 1000.0));
+                    response.result(http::status::ok);
+                    response.body() = "Tempo change requested";
+                } else {
+                    response.result(http::status::bad_request);
+                    response.body() = "Unknown transport command!";
+                }
+            }
+            else if (action == "/routing" && (request.method() == http::verb::get || request.method() == http::verb::post)) {
+                // Per-input split/layer/transpose/velocity/CC routing, see MidiTransform::parse_zones
+                std::lock_guard<std::mutex> lock(client_mutex_);
+                auto client = session_for(session_id);
+                if (!client) {
+                    response.result(http::status::bad_request);
+                    response.body() = "No active client!";
+                } else {
+                    if (request.method() == http::verb::post) {
+                        try {
+                            client->set_routing(json::parse(request.body()));
+                        } catch (const std::exception& e) {
+                            response.result(http::status::bad_request);
+                            response.body() = "Invalid routing: " + std::string(e.what());
+                            return;
+                        }
+                    }
+                    response.result(http::status::ok);
+                    response.set(http::field::content_type, "application/json");
+                    response.set(http::field::cache_control, "no-store");
+                    response.body() = client->get_routing().dump();
+                }
+            }
+            else if (action == "/subscriptions" && (request.method() == http::verb::get || request.method() == http::verb::post)) {
+                // What the server forwards to this session: {"sender": id|nickname (omit for everyone),
+                // "channels": [0, 1], "mute": true, "remap": {"0": 4}}
+                std::lock_guard<std::mutex> lock(client_mutex_);
+                auto client = session_for(session_id);
+                if (!client || !client->is_connected()) {
+                    response.result(http::status::bad_request);
+                    response.body() = "No active client!";
+                    return;
+                }
+                if (request.method() == http::verb::post) {
+                    try {
+                        client->subscribe(parse_subscription(*client, json::parse(request.body())));
+                    } catch (const std::exception& e) {
+                        response.result(http::status::bad_request);
+                        response.body() = "Invalid subscription: " + std::string(e.what());
+                        return;
+                    }
+                }
+                response.result(http::status::ok);
+                response.set(http::field::content_type, "application/json");
+                response.set(http::field::cache_control, "no-store");
+                response.body() = client->get_subscriptions().dump();
+            }
+            else if (request.method() == http::verb::get && action == "/trace") {
+                // Chrome trace JSON (load in chrome://tracing or Perfetto)
+                response.result(http::status::ok);
+                response.set(http::field::content_type, "application/json");
+                std::lock_guard<std::mutex> lock(client_mutex_);
+                auto client = session_for(session_id);
+                response.body() = client ? client->get_trace_json()
+                                         : Trace::chrome_json("MidiJam Client", 1, [](int64_t local_ns) { return local_ns; });
+            }
+            else if (request.method() == http::verb::post && target == "/trace") {
+                // {"enabled": true|false, "clear": true}
+                auto body = json::parse(request.body());
+                if (body.value("clear", false)) Trace::clear();
+                if (body.contains("enabled")) Trace::set_enabled(body.at("enabled").get<bool>());
+                response.result(http::status::ok);
+                response.set(http::field::content_type, "application/json");
+                response.body() = json{{"enabled", Trace::enabled()}}.dump();
+            }
             else {
                 // Handle unknown endpoints
                 response.result(http::status::not_found);
@@ -651,24 +1972,17 @@ private:
             response.body() = "Server error: " + std::string(e.what());
             logger.log("HTTP server error: " + std::string(e.what()));
         }
-        // Send the response back to the client
-        response.prepare_payload();
-        http::async_write(*socket, response, [socket](boost::system::error_code, std::size_t) {});
     }
 };
 
 boost::asio::io_context* global_io_context = nullptr;
-std::shared_ptr<MidiJamClient> global_client = nullptr;
+HttpServer* global_server = nullptr;
 
 void signal_handler(int signal) {
     if (signal == SIGINT) {
         logger.log("[Client] SIGINT received! Shutting down...");
-        {
-            std::lock_guard<std::mutex> lock(*reinterpret_cast<std::mutex*>(&global_client)); // Ensure thread safety
-            if (global_client) {
-                global_client->disconnect();
-                global_client.reset();
-            }
+        if (global_server) {
+            global_server->stop_sessions(); // Say QUIT to every room
         }
         if (global_io_context) {
             global_io_context->stop();
@@ -684,7 +1998,8 @@ int main(int argc, char* argv[]) {
         for (int i = 1; i < argc; ++i) {
             if (std::string(argv[i]) == "-debug") {
                 debug_mode = true;
-                break;
+            } else if (std::string(argv[i]) == "-trace") {
+                Trace::set_enabled(true); // Dump with GET /trace
             }
         }
         logger.set_debug_mode(debug_mode);
@@ -695,15 +2010,14 @@ int main(int argc, char* argv[]) {
         std::vector<std::thread> io_threads;
         int thread_count = std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 1); // Leave 1 core for OS
         for (int i = 0; i < thread_count; ++i) {
-            io_threads.emplace_back([&io_context]() {
-                while (!io_context.stopped()) {
-                    size_t tasks = io_context.poll(); // Process tasks without busy-waiting
-                    if (tasks == 0) std::this_thread::sleep_for(std::chrono::milliseconds(10)); // Sleep when idle
-                }
-            });
+            io_threads.emplace_back([&io_context]() { io_context.run(); }); // Blocks while idle; the work guard keeps it alive
         }
-        HttpServer server(io_context, 8080, "static");
-        global_client = nullptr;
+        // All sessions share one network thread, kept apart from the HTTP threads
+        boost::asio::io_context network_context;
+        auto network_work = boost::asio::make_work_guard(network_context);
+        std::thread network_thread([&network_context]() { network_context.run(); });
+        HttpServer server(io_context, network_context, 8080);
+        global_server = &server;
         std::string url = "http://localhost:8080";
 #ifdef _WIN32
         int result = system(("start " + url).c_str());
@@ -719,10 +2033,11 @@ int main(int argc, char* argv[]) {
         for (auto& t : io_threads) {
             if (t.joinable()) t.join();
         }
-        if (global_client) {
-            global_client->disconnect();
-            global_client.reset();
-        }
+        server.stop_sessions();
+        global_server = nullptr;
+        network_work.reset();
+        network_context.stop();
+        network_thread.join();
     } catch (const std::exception& e) {
         logger.log("Main error: " + std::string(e.what()));
         std::cerr << "Error: " << e.what() << "\n";
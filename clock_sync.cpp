@@ -0,0 +1,131 @@
+#include "clock_sync.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+void ClockSync::add_sample(int64_t t0, int64_t t1, int64_t t2, int64_t t3) {
+    int64_t rtt = (t3 - t0) - (t2 - t1);
+    if (rtt < 0 || t3 < t0) return; // Clock went backwards or corrupted reply
+    Sample sample{t0 + (t3 - t0) / 2, ((t1 - t0) + (t2 - t3)) / 2, rtt};
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    // A sample far from the current prediction means the server clock stepped (e.g. we
+    // reconnected to a different server); start over. Queuing beyond the best round trip
+    // can shift an offset by at most half the extra delay, so that much is forgiven. One
+    // trustworthy sample is proof enough; congested ones must agree STEP_CONFIRM times in a
+    // row, so a step still shows while the path is busy and the old minimum is in the window.
+    if (synced_) {
+        int64_t residual = sample.offset - (to_session_locked(sample.local_mid) - sample.local_mid);
+        int64_t queuing = std::max<int64_t>(0, rtt - min_rtt_) / 2;
+        if (std::llabs(residual) > STEP_THRESHOLD_NS + queuing) {
+            int sign = residual > 0 ? 1 : -1;
+            step_streak_ = step_streak_ * sign > 0 ? step_streak_ + sign : sign;
+        } else {
+            step_streak_ = 0;
+        }
+        bool trusted = rtt <= min_rtt_ + RTT_SLACK_NS;
+        if ((trusted && step_streak_ != 0) || std::abs(step_streak_) >= STEP_CONFIRM) {
+            samples_.clear();
+            synced_ = false;
+            step_streak_ = 0;
+        }
+    }
+    samples_.push_back(sample);
+    if (samples_.size() > MAX_SAMPLES) samples_.pop_front();
+    update_estimate();
+}
+
+void ClockSync::reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    samples_.clear();
+    ref_local_ = 0;
+    ref_offset_ = 0;
+    drift_ = 0.0;
+    min_rtt_ = -1;
+    synced_ = false;
+    step_streak_ = 0;
+}
+
+void ClockSync::update_estimate() {
+    min_rtt_ = samples_.front().rtt;
+    for (const auto& s : samples_) min_rtt_ = std::min(min_rtt_, s.rtt);
+
+    // Min-RTT filter: keep samples whose round trip is close to the best one
+    int64_t limit = min_rtt_ + min_rtt_ / 4 + RTT_SLACK_NS;
+    std::vector<const Sample*> good;
+    for (const auto& s : samples_) {
+        if (s.rtt <= limit) good.push_back(&s);
+    }
+
+    // Least-squares fit of offset against local time, centred on the means
+    double mean_t = 0.0, mean_o = 0.0;
+    int64_t base_t = good.front()->local_mid;
+    int64_t base_o = good.front()->offset;
+    for (const auto* s : good) {
+        mean_t += static_cast<double>(s->local_mid - base_t);
+        mean_o += static_cast<double>(s->offset - base_o);
+    }
+    mean_t /= good.size();
+    mean_o /= good.size();
+
+    double drift = 0.0;
+    int64_t span = good.back()->local_mid - good.front()->local_mid;
+    if (good.size() >= 3 && span >= MIN_DRIFT_SPAN_NS) {
+        double num = 0.0, den = 0.0;
+        for (const auto* s : good) {
+            double dt = static_cast<double>(s->local_mid - base_t) - mean_t;
+            double dof = static_cast<double>(s->offset - base_o) - mean_o;
+            num += dt * dof;
+            den += dt * dt;
+        }
+        if (den > 0.0) drift = std::clamp(num / den, -MAX_DRIFT, MAX_DRIFT);
+    }
+
+    ref_local_ = base_t + static_cast<int64_t>(std::llround(mean_t));
+    ref_offset_ = base_o + static_cast<int64_t>(std::llround(mean_o));
+    drift_ = drift;
+    synced_ = samples_.size() >= MIN_SAMPLES;
+}
+
+int64_t ClockSync::to_session_locked(int64_t local_ns) const {
+    return local_ns + ref_offset_ + static_cast<int64_t>(std::llround(drift_ * static_cast<double>(local_ns - ref_local_)));
+}
+
+bool ClockSync::is_synchronized() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return synced_;
+}
+
+int64_t ClockSync::to_session(int64_t local_ns) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return to_session_locked(local_ns);
+}
+
+int64_t ClockSync::to_local(int64_t session_ns) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Invert session = local + offset + drift * (local - ref_local)
+    double local = (static_cast<double>(session_ns - ref_offset_ - ref_local_)) / (1.0 + drift_);
+    return ref_local_ + static_cast<int64_t>(std::llround(local));
+}
+
+int64_t ClockSync::offset_ns() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int64_t now = local_now_ns();
+    return to_session_locked(now) - now;
+}
+
+int64_t ClockSync::rtt_ns() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return min_rtt_;
+}
+
+double ClockSync::drift_ppm() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return drift_ * 1e6;
+}
+
+std::size_t ClockSync::sample_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return samples_.size();
+}
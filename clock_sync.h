@@ -0,0 +1,62 @@
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <deque>
+#include <mutex>
+
+// NTP-style offset/drift estimator mapping the local steady clock onto the
+// server's session clock. Each exchange yields t0 (client send), t1 (server
+// receive), t2 (server send) and t3 (client receive); only samples close to the
+// minimum round trip are trusted, since queuing delay is what makes offsets lie.
+class ClockSync {
+public:
+    static int64_t local_now_ns() noexcept {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void add_sample(int64_t t0, int64_t t1, int64_t t2, int64_t t3);
+    void reset();
+
+    bool is_synchronized() const;
+    int64_t to_session(int64_t local_ns) const;
+    int64_t to_local(int64_t session_ns) const;
+    int64_t session_now_ns() const { return to_session(local_now_ns()); }
+
+    int64_t offset_ns() const;  // session - local, evaluated now
+    int64_t rtt_ns() const;     // minimum round trip in the window, -1 if unknown
+    double drift_ppm() const;
+    std::size_t sample_count() const;
+
+private:
+    struct Sample {
+        int64_t local_mid;  // local time halfway through the exchange
+        int64_t offset;
+        int64_t rtt;
+    };
+
+    static constexpr std::size_t MAX_SAMPLES = 64;
+    static constexpr std::size_t MIN_SAMPLES = 4;  // samples before the clock is trusted
+    static constexpr int64_t RTT_SLACK_NS = 100000;  // 100 us on top of the min-RTT filter
+    static constexpr int64_t STEP_THRESHOLD_NS = 50000000;  // 50 ms jump resets the window
+    static constexpr int STEP_CONFIRM = 3;  // Consecutive congested samples that must agree on a step
+    static constexpr int64_t MIN_DRIFT_SPAN_NS = 10000000000LL;  // 10 s before fitting drift
+    static constexpr double MAX_DRIFT = 500e-6;  // clamp to +-500 ppm
+
+    void update_estimate();  // requires mutex_ held
+    int64_t to_session_locked(int64_t local_ns) const;
+
+    std::deque<Sample> samples_;
+    int64_t ref_local_ = 0;
+    int64_t ref_offset_ = 0;
+    double drift_ = 0.0;
+    int64_t min_rtt_ = -1;
+    bool synced_ = false;
+    int step_streak_ = 0;  // Latest samples contradicting the estimate, all in one direction
+    mutable std::mutex mutex_;
+};
+
+#endif
@@ -0,0 +1,154 @@
+#include "egress_queue.h"
+#include "jam_protocol.h"
+#include "midi_message.h"
+#include "ump.h"
+#include <algorithm>
+
+// Controllers that only mean something together with their neighbours: Bank Select
+// (0/32), which the next Program Change depends on, and the RPN/NRPN parameter numbers
+// and data entry (6/38, 96-101). They share the Program Change lane so they stay in
+// order with it, and are never merged: two CC 6 values may be for different parameters.
+static bool is_sequenced_controller(uint8_t controller) noexcept {
+    return controller == 0 || controller == 32 || controller == 6 || controller == 38 ||
+           (controller >= 96 && controller <= 101);
+}
+
+// Sustain, sostenuto, soft pedal and the channel mode messages must not be merged away either
+static bool is_realtime_controller(uint8_t controller) noexcept {
+    return controller == 64 || controller == 66 || controller == 67 || controller >= 120 ||
+           is_sequenced_controller(controller);
+}
+
+// One complete channel message
+static EgressQueue::Lane midi1_lane(const uint8_t* msg, int32_t& coalesce_key) noexcept {
+    using Lane = EgressQueue::Lane;
+    uint8_t status = msg[0];
+    uint8_t data1 = msg[1];
+    switch (MidiMessage::type(status)) {
+        case 0x80: case 0x90: case 0xC0:
+            return Lane::Realtime;
+        case 0xB0:
+            if (is_realtime_controller(data1)) return Lane::Realtime;
+            coalesce_key = (status << 8) | data1;
+            return Lane::Continuous;
+        case 0xA0:
+            coalesce_key = (status << 8) | data1;
+            return Lane::Continuous;
+        default: // Channel pressure, pitch bend
+            coalesce_key = status << 8;
+            return Lane::Continuous;
+    }
+}
+
+// Same lanes and keys as the MIDI 1.0 bytes it translates to; registered and assignable
+// controllers key on their bank and index, above the 16-bit MIDI 1.0 keys. Those are whole
+// parameter changes in one message, so unlike CC 6/38 they can be merged.
+static EgressQueue::Lane ump_lane(uint32_t word, int32_t& coalesce_key) noexcept {
+    using Lane = EgressQueue::Lane;
+    if (!Ump::is_channel_voice(word)) return Lane::Realtime;
+    uint8_t status = Ump::status(word);
+    uint8_t index1 = Ump::index1(word);
+    int32_t group = Ump::group(word) << 24; // Each group is its own 16 channels
+    switch (status >> 4) {
+        case 0x8: case 0x9: case 0xC:
+            return Lane::Realtime;
+        case 0xB:
+            if (is_realtime_controller(index1)) return Lane::Realtime;
+            coalesce_key = group | (status << 8) | index1;
+            return Lane::Continuous;
+        case 0xA:
+            coalesce_key = group | (status << 8) | index1;
+            return Lane::Continuous;
+        case 0xD: case 0xE:
+            coalesce_key = group | (status << 8);
+            return Lane::Continuous;
+        case 0x2: case 0x3:
+            coalesce_key = group | (status << 16) | (index1 << 8) | Ump::index2(word);
+            return Lane::Continuous;
+        default: // Per-note controllers and management
+            return Lane::Realtime;
+    }
+}
+
+EgressQueue::Lane EgressQueue::classify(const char* data, std::size_t bytes, int32_t& coalesce_key) noexcept {
+    coalesce_key = NO_COALESCE;
+    if (bytes == 0) return Lane::Bulk;
+    if (JamProtocol::is_sysex_fragment(data, bytes)) return Lane::Bulk;
+    if (Ump::is_packet(data, bytes)) return classify_ump(data, bytes, coalesce_key);
+
+    uint8_t status = static_cast<uint8_t>(data[0]);
+    if (!MidiMessage::is_channel_message(status)) return Lane::Realtime;
+    if (bytes == MidiMessage::expected_length(status)) return midi1_lane(reinterpret_cast<const uint8_t*>(data), coalesce_key);
+    // Several messages: never merged, and in the Realtime lane if any of them belongs there,
+    // so nothing they carry can be overtaken by a later note or program change
+    Lane lane = Lane::Continuous;
+    MidiMessage::for_each(reinterpret_cast<const uint8_t*>(data), bytes, [&lane](const uint8_t* msg, std::size_t) {
+        int32_t ignored = NO_COALESCE;
+        if (!MidiMessage::is_channel_message(msg[0]) || midi1_lane(msg, ignored) == Lane::Realtime) lane = Lane::Realtime;
+    });
+    return lane;
+}
+
+EgressQueue::Lane EgressQueue::classify_ump(const char* data, std::size_t bytes, int32_t& coalesce_key) noexcept {
+    uint32_t word = Ump::read_word(data + JamProtocol::TAG_SIZE);
+    if (bytes == JamProtocol::TAG_SIZE + 4 * Ump::word_count(word)) return ump_lane(word, coalesce_key);
+    Lane lane = Lane::Continuous;
+    Ump::for_each(data, bytes, [&lane](const uint32_t* words, std::size_t) {
+        int32_t ignored = NO_COALESCE;
+        if (ump_lane(words[0], ignored) == Lane::Realtime) lane = Lane::Realtime;
+    });
+    return lane;
+}
+
+std::deque<EgressQueue::Packet>& EgressQueue::lane_queue(Lane lane) noexcept {
+    switch (lane) {
+        case Lane::Realtime: return realtime_;
+        case Lane::Continuous: return continuous_;
+        default: return bulk_;
+    }
+}
+
+bool EgressQueue::push(Packet packet, Lane lane) {
+    if (lane == Lane::Continuous && packet.coalesce_key != NO_COALESCE) {
+        for (auto& queued : continuous_) {
+            if (queued.coalesce_key == packet.coalesce_key) {
+                queued = std::move(packet); // Only the latest value matters
+                return true;
+            }
+        }
+    }
+    if (size() >= max_depth_) {
+        bool evicted = false;
+        for (int victim = static_cast<int>(Lane::Bulk); victim >= static_cast<int>(lane); --victim) {
+            auto& queue = lane_queue(static_cast<Lane>(victim));
+            if (!queue.empty()) {
+                queue.pop_front();
+                evicted = true;
+                break;
+            }
+        }
+        ++overflow_drops_;
+        if (!evicted) return false;
+    }
+    lane_queue(lane).push_back(std::move(packet));
+    peak_size_ = std::max(peak_size_, size());
+    return false;
+}
+
+bool EgressQueue::pop(Packet& packet, std::chrono::steady_clock::time_point now) {
+    for (Lane lane : {Lane::Realtime, Lane::Continuous, Lane::Bulk}) {
+        auto& queue = lane_queue(lane);
+        auto max_age = lane == Lane::Bulk ? BULK_MAX_AGE : max_age_;
+        while (!queue.empty()) {
+            if (now - queue.front().enqueued > max_age) {
+                queue.pop_front();
+                ++stale_drops_;
+                continue;
+            }
+            packet = std::move(queue.front());
+            queue.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
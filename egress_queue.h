@@ -0,0 +1,91 @@
+#ifndef EGRESS_QUEUE_H
+#define EGRESS_QUEUE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <vector>
+
+// Classic token bucket; realtime traffic may overdraw down to -burst so notes keep
+// flowing a little longer than the controller spam that emptied the bucket.
+class TokenBucket {
+public:
+    static constexpr double DEFAULT_RATE = 1000.0; // Packets per second...
+    static constexpr double DEFAULT_BURST = 200.0; // ...with this much burst on top
+
+    explicit TokenBucket(double rate_per_sec = DEFAULT_RATE, double burst = DEFAULT_BURST) noexcept
+        : rate_(rate_per_sec), burst_(burst), tokens_(burst), last_(std::chrono::steady_clock::now()) {}
+
+    bool consume(std::chrono::steady_clock::time_point now, bool allow_overdraft) noexcept {
+        double elapsed = std::chrono::duration<double>(now - last_).count();
+        last_ = now;
+        tokens_ += elapsed * rate_;
+        if (tokens_ > burst_) tokens_ = burst_;
+        double floor = allow_overdraft ? -burst_ : 0.0;
+        if (tokens_ - 1.0 < floor) return false;
+        tokens_ -= 1.0;
+        return true;
+    }
+
+private:
+    double rate_;
+    double burst_;
+    double tokens_;
+    std::chrono::steady_clock::time_point last_;
+};
+
+// Per-peer outbound queue with three priority lanes. Notes and pedals leave first,
+// continuous controllers are coalesced to their latest value while the peer is
+// backed up, and bulk traffic (SysEx fragments) goes last. The queue is bounded in
+// depth and age: a late note is worse than a lost one, so stale packets are dropped.
+class EgressQueue {
+public:
+    enum class Lane { Realtime = 0, Continuous = 1, Bulk = 2 };
+    static constexpr int32_t NO_COALESCE = -1;
+    static constexpr std::size_t DEFAULT_MAX_DEPTH = 256;
+    static constexpr auto DEFAULT_MAX_AGE = std::chrono::milliseconds(100);
+    static constexpr auto BULK_MAX_AGE = std::chrono::milliseconds(2000); // SysEx and client lists tolerate delay
+
+    struct Packet {
+        std::shared_ptr<const std::vector<char>> data; // Shared by every peer of one fan-out
+        std::chrono::steady_clock::time_point enqueued;
+        int32_t coalesce_key = NO_COALESCE;
+    };
+
+    // Picks the lane (and coalescing key for single continuous messages) of a datagram
+    static Lane classify(const char* data, std::size_t bytes, int32_t& coalesce_key) noexcept;
+
+    explicit EgressQueue(std::size_t max_depth = DEFAULT_MAX_DEPTH,
+                         std::chrono::milliseconds max_age = DEFAULT_MAX_AGE) noexcept
+        : max_depth_(max_depth), max_age_(max_age) {}
+
+    // Returns true if the packet replaced an older one with the same coalescing key.
+    // When full, the oldest packet of the lowest lane not above `lane` makes room;
+    // if every queued packet outranks the new one, the new one is dropped.
+    bool push(Packet packet, Lane lane);
+    // Skips (and counts) packets that waited longer than their lane's max age
+    bool pop(Packet& packet, std::chrono::steady_clock::time_point now);
+    bool empty() const noexcept { return size() == 0; }
+    std::size_t size() const noexcept { return realtime_.size() + continuous_.size() + bulk_.size(); }
+
+    std::size_t peak_size() const noexcept { return peak_size_; }
+    uint64_t stale_drops() const noexcept { return stale_drops_; }
+    uint64_t overflow_drops() const noexcept { return overflow_drops_; }
+
+private:
+    static Lane classify_ump(const char* data, std::size_t bytes, int32_t& coalesce_key) noexcept;
+    std::deque<Packet>& lane_queue(Lane lane) noexcept;
+
+    std::deque<Packet> realtime_;
+    std::deque<Packet> continuous_;
+    std::deque<Packet> bulk_;
+    std::size_t max_depth_;
+    std::chrono::milliseconds max_age_;
+    std::size_t peak_size_ = 0;
+    uint64_t stale_drops_ = 0;
+    uint64_t overflow_drops_ = 0;
+};
+
+#endif
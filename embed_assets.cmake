@@ -0,0 +1,108 @@
+# Generates a header embedding every file in ASSET_DIR into the client binary, as
+# constexpr byte arrays (plain and gzipped) with a path lookup table.
+#   cmake -DASSET_DIR=<static dir> -DOUTPUT=<header> -DWORK_DIR=<scratch dir> -P embed_assets.cmake
+# Gzip needs CMake 3.18+ (raw archives); older versions embed only the plain bytes.
+if(NOT ASSET_DIR OR NOT OUTPUT OR NOT WORK_DIR)
+    message(FATAL_ERROR "embed_assets.cmake needs -DASSET_DIR, -DOUTPUT and -DWORK_DIR")
+endif()
+
+function(to_byte_array FILE VAR)
+    file(READ "${FILE}" HEX HEX)
+    string(REGEX REPLACE "(................................)" "\\1\n" HEX "${HEX}") # 16 bytes per line
+    string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," HEX "${HEX}")
+    set(${VAR} "${HEX}" PARENT_SCOPE)
+endfunction()
+
+function(content_type_for NAME VAR)
+    string(REGEX MATCH "\\.[^.]*$" EXT "${NAME}")
+    string(TOLOWER "${EXT}" EXT)
+    set(TYPE "application/octet-stream")
+    if(EXT STREQUAL ".html")
+        set(TYPE "text/html; charset=utf-8")
+    elseif(EXT STREQUAL ".css")
+        set(TYPE "text/css")
+    elseif(EXT STREQUAL ".js")
+        set(TYPE "application/javascript")
+    elseif(EXT STREQUAL ".json")
+        set(TYPE "application/json")
+    elseif(EXT STREQUAL ".svg")
+        set(TYPE "image/svg+xml")
+    elseif(EXT STREQUAL ".png")
+        set(TYPE "image/png")
+    elseif(EXT STREQUAL ".ico")
+        set(TYPE "image/x-icon")
+    endif()
+    set(${VAR} "${TYPE}" PARENT_SCOPE)
+endfunction()
+
+file(MAKE_DIRECTORY "${WORK_DIR}")
+file(GLOB ASSETS LIST_DIRECTORIES false "${ASSET_DIR}/*")
+list(SORT ASSETS)
+
+set(ARRAYS "")
+set(TABLE "")
+set(INDEX 0)
+foreach(ASSET ${ASSETS})
+    get_filename_component(NAME "${ASSET}" NAME)
+    content_type_for("${NAME}" TYPE)
+    file(SHA1 "${ASSET}" HASH)
+    string(SUBSTRING "${HASH}" 0 16 HASH)
+    to_byte_array("${ASSET}" BYTES)
+    string(APPEND ARRAYS "static constexpr unsigned char ASSET_${INDEX}[] = {\n${BYTES}};\n")
+
+    set(GZIP "nullptr, 0")
+    if(NOT CMAKE_VERSION VERSION_LESS 3.18)
+        set(GZ "${WORK_DIR}/${NAME}.gz")
+        file(ARCHIVE_CREATE OUTPUT "${GZ}" PATHS "${ASSET}" FORMAT raw COMPRESSION GZip)
+        to_byte_array("${GZ}" GZ_BYTES)
+        string(APPEND ARRAYS "static constexpr unsigned char ASSET_${INDEX}_GZ[] = {\n${GZ_BYTES}};\n")
+        set(GZIP "ASSET_${INDEX}_GZ, sizeof(ASSET_${INDEX}_GZ)")
+    endif()
+
+    set(ENTRY "\"${TYPE}\", \"\\\"${HASH}\\\"\", ASSET_${INDEX}, sizeof(ASSET_${INDEX}), ${GZIP}}")
+    string(APPEND TABLE "    {\"/${NAME}\", ${ENTRY},\n")
+    if(NAME STREQUAL "index.html")
+        string(APPEND TABLE "    {\"/\", ${ENTRY},\n")
+    endif()
+    math(EXPR INDEX "${INDEX} + 1")
+endforeach()
+
+set(CONTENT "// Generated by embed_assets.cmake from ${ASSET_DIR} -- do not edit
+#ifndef EMBEDDED_ASSETS_H
+#define EMBEDDED_ASSETS_H
+
+#include <cstddef>
+#include <string_view>
+
+struct EmbeddedAsset {
+    std::string_view path;
+    std::string_view content_type;
+    std::string_view etag;
+    const unsigned char* data;
+    std::size_t size;
+    const unsigned char* gzip; // nullptr if the build couldn't compress
+    std::size_t gzip_size;
+};
+
+${ARRAYS}
+static constexpr EmbeddedAsset EMBEDDED_ASSETS[] = {
+${TABLE}    {\"\", \"\", \"\", nullptr, 0, nullptr, 0} // Sentinel, keeps the array non-empty
+};
+
+static constexpr const EmbeddedAsset* find_embedded_asset(std::string_view path) {
+    for (const auto& asset : EMBEDDED_ASSETS) {
+        if (asset.data && asset.path == path) return &asset;
+    }
+    return nullptr;
+}
+
+#endif
+")
+
+# Only touch the header when something changed, so the client isn't rebuilt needlessly
+if(EXISTS "${OUTPUT}")
+    file(READ "${OUTPUT}" OLD_CONTENT)
+endif()
+if(NOT "${OLD_CONTENT}" STREQUAL "${CONTENT}")
+    file(WRITE "${OUTPUT}" "${CONTENT}")
+endif()
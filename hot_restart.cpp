@@ -0,0 +1,159 @@
+#include "hot_restart.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#ifdef __linux__
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+std::vector<std::string> HotRestart::strip_handoff(const std::vector<std::string>& arguments) {
+    std::vector<std::string> stripped;
+    for (std::size_t i = 0; i < arguments.size(); ++i) {
+        if (arguments[i] == "-handoff") {
+            ++i; // And its value
+            continue;
+        }
+        stripped.push_back(arguments[i]);
+    }
+    return stripped;
+}
+
+#ifdef __linux__
+
+// Descriptors open right now; listed before fork since the child may not allocate
+static std::vector<int> open_descriptors() {
+    std::vector<int> fds;
+    if (DIR* dir = opendir("/proc/self/fd")) {
+        int own = dirfd(dir);
+        while (dirent* entry = readdir(dir)) {
+            if (entry->d_name[0] < '0' || entry->d_name[0] > '9') continue;
+            int fd = std::atoi(entry->d_name);
+            if (fd != own) fds.push_back(fd);
+        }
+        closedir(dir);
+    } else {
+        for (int fd = 0; fd < 4096; ++fd) fds.push_back(fd);
+    }
+    return fds;
+}
+
+int HotRestart::spawn(const std::vector<std::string>& arguments, const std::string& snapshot,
+                      const std::vector<int>& inherited_fds, std::chrono::seconds timeout, std::string& error) {
+    // Already unlinked: the snapshot holds session keys, so it never gets a name on disk
+    std::FILE* file = std::tmpfile();
+    if (!file) {
+        error = std::string("cannot create snapshot file: ") + std::strerror(errno);
+        return -1;
+    }
+    int snapshot_fd = fileno(file);
+    if (std::fwrite(snapshot.data(), 1, snapshot.size(), file) != snapshot.size() || std::fflush(file) != 0 ||
+        lseek(snapshot_fd, 0, SEEK_SET) != 0) {
+        error = std::string("cannot write snapshot: ") + std::strerror(errno);
+        std::fclose(file);
+        return -1;
+    }
+    int ready[2];
+    if (pipe(ready) != 0) {
+        error = std::string("cannot create pipe: ") + std::strerror(errno);
+        std::fclose(file);
+        return -1;
+    }
+
+    std::vector<std::string> args = strip_handoff(arguments);
+    args.push_back("-handoff");
+    args.push_back(std::to_string(snapshot_fd) + "," + std::to_string(ready[1]));
+    std::vector<char*> argv;
+    for (auto& arg : args) argv.push_back(&arg[0]);
+    argv.push_back(nullptr);
+    std::vector<int> keep = inherited_fds;
+    keep.push_back(snapshot_fd);
+    keep.push_back(ready[1]);
+    std::vector<int> to_close;
+    for (int fd : open_descriptors()) {
+        if (fd > 2 && std::find(keep.begin(), keep.end(), fd) == keep.end()) to_close.push_back(fd);
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        // Only async-signal-safe calls from here on
+        for (int fd : to_close) close(fd);
+        for (int fd : keep) fcntl(fd, F_SETFD, 0);
+        execvp(argv[0], argv.data());
+        _exit(127);
+    }
+    int fork_errno = errno;
+    close(ready[1]);
+    std::fclose(file);
+    if (pid < 0) {
+        close(ready[0]);
+        error = std::string("fork failed: ") + std::strerror(fork_errno);
+        return -1;
+    }
+
+    pollfd waiting{ready[0], POLLIN, 0};
+    int polled;
+    do {
+        polled = poll(&waiting, 1, static_cast<int>(std::chrono::milliseconds(timeout).count()));
+    } while (polled < 0 && errno == EINTR);
+    char byte = 0;
+    ssize_t got = polled > 0 ? read(ready[0], &byte, 1) : 0;
+    close(ready[0]);
+    if (got == 1) return pid;
+
+    // Closed pipe: the child died (or exec failed); timeout: it hangs. Never leave two servers running.
+    error = polled == 0 ? "new process did not become ready within " + std::to_string(timeout.count()) + " s"
+                        : "new process exited before becoming ready";
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+    return -1;
+}
+
+std::string HotRestart::read_snapshot(int fd) {
+    std::string snapshot;
+    char chunk[4096];
+    ssize_t got;
+    while ((got = read(fd, chunk, sizeof(chunk))) != 0) {
+        if (got < 0) {
+            if (errno == EINTR) continue;
+            int read_errno = errno;
+            close(fd);
+            throw std::runtime_error(std::string("Cannot read handoff snapshot: ") + std::strerror(read_errno));
+        }
+        snapshot.append(chunk, static_cast<std::size_t>(got));
+    }
+    close(fd);
+    return snapshot;
+}
+
+void HotRestart::notify_ready(int fd) {
+    char byte = 1;
+    ssize_t written = write(fd, &byte, 1);
+    close(fd);
+    if (written != 1) throw std::runtime_error("Cannot signal readiness to the previous server process");
+}
+
+#else
+
+int HotRestart::spawn(const std::vector<std::string>&, const std::string&, const std::vector<int>&,
+                      std::chrono::seconds, std::string& error) {
+    error = "hot restart is not supported on this platform";
+    return -1;
+}
+
+std::string HotRestart::read_snapshot(int) {
+    throw std::runtime_error("Hot restart is not supported on this platform");
+}
+
+void HotRestart::notify_ready(int) {
+    throw std::runtime_error("Hot restart is not supported on this platform");
+}
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef HOT_RESTART_H
+#define HOT_RESTART_H
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Process handoff for deploying a new server binary without dropping the jam. The old
+// process starts the new one with its sockets and a state snapshot; the new one adopts
+// both and reports ready, and only then does the old one exit. If the new process fails
+// to come up, the old one keeps serving. POSIX only (fork/exec and fd inheritance).
+class HotRestart {
+public:
+#ifdef __linux__
+    static constexpr bool SUPPORTED = true;
+#else
+    static constexpr bool SUPPORTED = false;
+#endif
+
+    // Runs `arguments` (argv[0] resolved through PATH) plus "-handoff <snapshot_fd>,<ready_fd>",
+    // with `inherited_fds` kept open across exec and every other descriptor closed. Returns the
+    // child's pid once it called notify_ready(), or -1 with `error` set; a child that is still
+    // running when `timeout` expires is killed.
+    static int spawn(const std::vector<std::string>& arguments, const std::string& snapshot,
+                     const std::vector<int>& inherited_fds, std::chrono::seconds timeout, std::string& error);
+
+    // New process side; both throw std::runtime_error on failure
+    static std::string read_snapshot(int fd);
+    static void notify_ready(int fd);
+
+    // `arguments` without an earlier "-handoff" pair, so repeated restarts don't stack them
+    static std::vector<std::string> strip_handoff(const std::vector<std::string>& arguments);
+};
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef JAM_PROTOCOL_H
+#define JAM_PROTOCOL_H
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+// Wire helpers shared by the server and the client.
+// Control messages start with a 4-byte ASCII tag (always < 0x80, so they never
+// collide with raw MIDI status bytes), followed by fixed-size little-endian fields.
+class JamProtocol {
+public:
+    static constexpr std::size_t TAG_SIZE = 4;
+
+    // Clock synchronization (client -> server): tag + client send time t0
+    static constexpr const char* SYNC_TAG = "SYNC";
+    static constexpr std::size_t SYNC_SIZE = TAG_SIZE + 8;
+    // Clock synchronization reply (server -> client): tag + t0 + server receive t1 + server send t2
+    static constexpr const char* SYNC_REPLY_TAG = "SYNR";
+    static constexpr std::size_t SYNC_REPLY_SIZE = TAG_SIZE + 3 * 8;
+    // Heartbeat ping (server -> client): tag + server send time; the PONG echoes it back
+    static constexpr const char* PING_TAG = "PING";
+    static constexpr const char* PONG_TAG = "PONG";
+    static constexpr std::size_t PING_SIZE = TAG_SIZE + 8;
+    // Room tempo/transport state (server -> client), see TempoState
+    static constexpr const char* TEMPO_TAG = "TMPO";
+    static constexpr std::size_t TEMPO_SIZE = TAG_SIZE + 6 * 8;
+    // Transport request (client -> server): tag + command + value
+    static constexpr const char* TRANSPORT_TAG = "TRAN";
+    static constexpr std::size_t TRANSPORT_SIZE = TAG_SIZE + 2 * 8;
+    // SysEx fragment: tag + source client id + message id + fragment index + fragment count + payload.
+    // The sender leaves the source at 0; the server stamps it so receivers can reassemble per sender.
+    static constexpr const char* SYSEX_TAG = "SYSX";
+    static constexpr std::size_t SYSEX_HEADER_SIZE = TAG_SIZE + 4 * 2;
+    static constexpr std::size_t SYSEX_FRAGMENT_PAYLOAD = 256;
+    static constexpr std::size_t SYSEX_MAX_FRAGMENTS = 1024; // Caps a single dump at 256 KB
+    // Subscription (receiver -> server): tag + sender id (0: default) + channel mask + 16-byte channel remap
+    static constexpr const char* SUBSCRIBE_TAG = "SUBS";
+    static constexpr std::size_t SUBSCRIBE_SIZE = TAG_SIZE + 2 * 2 + 16;
+    // Shutdown notice (server -> client): the server is going away, don't wait for a timeout
+    static constexpr const char* SHUTDOWN_TAG = "SHUT";
+    static constexpr std::size_t SHUTDOWN_SIZE = TAG_SIZE;
+    // Relay link hello (node -> upstream node it joined): tag + node id
+    static constexpr const char* LINK_TAG = "LINK";
+    static constexpr std::size_t LINK_SIZE = TAG_SIZE + 4;
+    // Relayed packet between nodes: tag + origin node + sequence + origin client id + hops left + payload
+    static constexpr const char* RELAY_TAG = "RLAY";
+    static constexpr std::size_t RELAY_HEADER_SIZE = TAG_SIZE + 4 + 4 + 2 + 1;
+    // Session token (server -> client, after every ACK): tag + token + the client's id
+    static constexpr const char* SESSION_TAG = "SESS";
+    static constexpr std::size_t SESSION_SIZE = TAG_SIZE + 8 + 2;
+    // Resume (client -> server): tag + token; re-attaches a session that was lost or moved address.
+    // The server answers ACK + SESS, or GONE if it no longer holds the session. In password
+    // rooms GONE carries Auth::gone_proof for the token, so a stranger can't force a rejoin.
+    static constexpr const char* RESUME_TAG = "RSUM";
+    static constexpr std::size_t RESUME_SIZE = TAG_SIZE + 8;
+    static constexpr const char* GONE_TAG = "GONE";
+    static constexpr std::size_t GONE_SIZE = TAG_SIZE;
+    // Latency probe (anyone -> server) and its echo (PROR): tag + sender's send time + sender's
+    // cookie. Answered without state or locks, and never turns the sender into a client.
+    static constexpr const char* PROBE_TAG = "PROB";
+    static constexpr const char* PROBE_REPLY_TAG = "PROR";
+    static constexpr std::size_t PROBE_SIZE = TAG_SIZE + 8 + 4;
+    // MIDI 2.0 Universal MIDI Packets (either direction): tag + 32-bit words, see Ump
+    static constexpr const char* UMP_TAG = "UMP2";
+    // MIDI format a client wants to receive (client -> server, after every join): tag + format.
+    // Clients that never send it get raw MIDI 1.0 bytes.
+    static constexpr const char* FORMAT_TAG = "FRMT";
+    static constexpr std::size_t FORMAT_SIZE = TAG_SIZE + 2;
+    static constexpr uint16_t FORMAT_MIDI1 = 0;
+    static constexpr uint16_t FORMAT_UMP = 1;
+
+    static bool has_tag(const char* data, std::size_t bytes, const char* tag, std::size_t size) noexcept {
+        return bytes == size && std::memcmp(data, tag, TAG_SIZE) == 0;
+    }
+
+    // For messages with a fixed header followed by variable data (a nickname, say)
+    static bool has_header(const char* data, std::size_t bytes, const char* tag, std::size_t header_size) noexcept {
+        return bytes >= header_size && std::memcmp(data, tag, TAG_SIZE) == 0;
+    }
+
+    static void write_tag(char* out, const char* tag) noexcept {
+        std::memcpy(out, tag, TAG_SIZE);
+    }
+
+    static void write_i64(char* out, int64_t value) noexcept {
+        uint64_t v = static_cast<uint64_t>(value);
+        for (int i = 0; i < 8; ++i) {
+            out[i] = static_cast<char>((v >> (8 * i)) & 0xFF);
+        }
+    }
+
+    static void write_u16(char* out, uint16_t value) noexcept {
+        out[0] = static_cast<char>(value & 0xFF);
+        out[1] = static_cast<char>(value >> 8);
+    }
+
+    static uint16_t read_u16(const char* in) noexcept {
+        return static_cast<uint16_t>(static_cast<uint8_t>(in[0]) | (static_cast<uint8_t>(in[1]) << 8));
+    }
+
+    static void write_u32(char* out, uint32_t value) noexcept {
+        for (int i = 0; i < 4; ++i) out[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+
+    static uint32_t read_u32(const char* in) noexcept {
+        uint32_t v = 0;
+        for (int i = 0; i < 4; ++i) v |= static_cast<uint32_t>(static_cast<uint8_t>(in[i])) << (8 * i);
+        return v;
+    }
+
+    static bool is_sysex_fragment(const char* data, std::size_t bytes) noexcept {
+        return bytes > SYSEX_HEADER_SIZE && bytes <= SYSEX_HEADER_SIZE + SYSEX_FRAGMENT_PAYLOAD &&
+               std::memcmp(data, SYSEX_TAG, TAG_SIZE) == 0;
+    }
+
+    static int64_t read_i64(const char* in) noexcept {
+        uint64_t v = 0;
+        for (int i = 0; i < 8; ++i) {
+            v |= static_cast<uint64_t>(static_cast<uint8_t>(in[i])) << (8 * i);
+        }
+        return static_cast<int64_t>(v);
+    }
+};
+
+#endif
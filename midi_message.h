@@ -0,0 +1,86 @@
+#ifndef MIDI_MESSAGE_H
+#define MIDI_MESSAGE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+
+// MIDI 1.0 byte-stream helpers that don't depend on RtMidi, so the server can use them too.
+class MidiMessage {
+public:
+    static constexpr bool is_status(uint8_t byte) noexcept { return (byte & 0x80) != 0; }
+    static constexpr bool is_channel_message(uint8_t status) noexcept { return status >= 0x80 && status < 0xF0; }
+    static constexpr bool is_realtime(uint8_t status) noexcept { return status >= 0xF8; }
+    static constexpr uint8_t channel(uint8_t status) noexcept { return status & 0x0F; }
+    static constexpr uint8_t type(uint8_t status) noexcept { return status & 0xF0; }
+
+    // Total length including the status byte; 0 for SysEx, which runs until 0xF7
+    static constexpr std::size_t expected_length(uint8_t status) noexcept {
+        switch (status & 0xF0) {
+            case 0x80: case 0x90: case 0xA0: case 0xB0: case 0xE0:
+                return 3;
+            case 0xC0: case 0xD0:
+                return 2;
+            default:
+                break;
+        }
+        switch (status) {
+            case 0xF0: return 0;
+            case 0xF1: case 0xF3: return 2;
+            case 0xF2: return 3;
+            default: return 1; // F6 tune request, F7 stray EOX, F4/F5 undefined, realtime
+        }
+    }
+
+    // Splits a byte stream into complete messages, expanding running status so every
+    // message handed to `f(const uint8_t* msg, std::size_t len)` starts with a status byte.
+    // Realtime bytes may be interleaved anywhere; truncated messages are dropped.
+    template <typename F>
+    static void for_each(const uint8_t* data, std::size_t bytes, F&& f) {
+        uint8_t running_status = 0;
+        std::size_t i = 0;
+        while (i < bytes) {
+            uint8_t byte = data[i];
+            if (is_realtime(byte)) {
+                f(data + i, 1);
+                ++i;
+                continue;
+            }
+            if (byte == 0xF0) {
+                std::size_t end = i + 1;
+                while (end < bytes && data[end] != 0xF7) ++end;
+                if (end == bytes) return; // Unterminated SysEx
+                f(data + i, end - i + 1);
+                running_status = 0;
+                i = end + 1;
+                continue;
+            }
+            uint8_t status = byte;
+            std::size_t start = i;
+            if (is_status(byte)) {
+                ++i;
+            } else if (running_status != 0) {
+                status = running_status;
+            } else {
+                ++i; // Stray data byte without a status to run on
+                continue;
+            }
+            std::size_t length = expected_length(status);
+            if (length == 0) return; // Only SysEx, handled above; keeps data_bytes in 0..2
+            std::size_t data_bytes = length - 1;
+            if (i + data_bytes > bytes) return;
+            if (start == i) {
+                std::array<uint8_t, 3> expanded{status, 0, 0};
+                for (std::size_t d = 0; d < data_bytes; ++d) expanded[d + 1] = data[i + d];
+                f(expanded.data(), data_bytes + 1);
+            } else {
+                f(data + start, data_bytes + 1);
+            }
+            i += data_bytes;
+            // Channel messages set running status; system common messages cancel it
+            running_status = is_channel_message(status) ? status : 0;
+        }
+    }
+};
+
+#endif
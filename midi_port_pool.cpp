@@ -0,0 +1,80 @@
+#include "midi_port_pool.h"
+#include "midi_utils.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+SharedMidiOutput::SharedMidiOutput(unsigned int port) : port_(port) {
+    try {
+        out_.openPort(port);
+    } catch (const RtMidiError& e) {
+        throw std::runtime_error("Cannot open MIDI output " + std::to_string(port) + ": " + e.what());
+    }
+}
+
+void SharedMidiOutput::send(const std::vector<unsigned char>& message) {
+    send(message.data(), message.size());
+}
+
+void SharedMidiOutput::send(const unsigned char* message, std::size_t size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    MidiUtils::sendMidiMessage(out_, message, size);
+}
+
+int MidiPortPool::subscribe_input(unsigned int port, InputHandler handler) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& input = inputs_[port];
+    if (!input) {
+        auto fresh = std::make_unique<SharedInput>();
+        try {
+            fresh->in.openPort(port);
+            fresh->in.ignoreTypes(false, true, true); // SysEx goes out on the bulk lane
+            fresh->in.setCallback(&input_callback, fresh.get());
+        } catch (const RtMidiError& e) {
+            inputs_.erase(port);
+            throw std::runtime_error("Cannot open MIDI input " + std::to_string(port) + ": " + e.what());
+        }
+        input = std::move(fresh);
+    }
+    int token = next_token_++;
+    std::lock_guard<std::mutex> handlers_lock(input->mutex);
+    input->handlers.emplace_back(token, std::move(handler));
+    return token;
+}
+
+void MidiPortPool::unsubscribe_input(unsigned int port, int token) {
+    std::unique_ptr<SharedInput> closing;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = inputs_.find(port);
+        if (it == inputs_.end()) return;
+        SharedInput& input = *it->second;
+        {
+            std::lock_guard<std::mutex> handlers_lock(input.mutex);
+            input.handlers.erase(std::remove_if(input.handlers.begin(), input.handlers.end(),
+                [token](const auto& entry) { return entry.first == token; }), input.handlers.end());
+            if (!input.handlers.empty()) return;
+        }
+        closing = std::move(it->second);
+        inputs_.erase(it);
+    }
+    closing->in.cancelCallback(); // Outside our locks: RtMidi waits for a running callback
+    closing->in.closePort();
+}
+
+std::shared_ptr<SharedMidiOutput> MidiPortPool::acquire_output(unsigned int port) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (auto existing = outputs_[port].lock()) return existing;
+    auto output = std::make_shared<SharedMidiOutput>(port);
+    outputs_[port] = output;
+    return output;
+}
+
+void MidiPortPool::input_callback(double, std::vector<unsigned char>* message, void* user_data) noexcept {
+    if (!message || message->empty() || !user_data) return;
+    auto* input = static_cast<SharedInput*>(user_data);
+    std::lock_guard<std::mutex> lock(input->mutex);
+    for (auto& [token, handler] : input->handlers) {
+        handler(*message);
+    }
+}
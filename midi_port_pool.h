@@ -0,0 +1,56 @@
+#ifndef MIDI_PORT_POOL_H
+#define MIDI_PORT_POOL_H
+
+#include "rtmidi/RtMidi.h"
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// An output port shared by every session routed to it; RtMidi isn't thread safe,
+// so sends from the RtMidi, network and clock threads are serialized here.
+class SharedMidiOutput {
+public:
+    explicit SharedMidiOutput(unsigned int port);
+    void send(const std::vector<unsigned char>& message);
+    void send(const unsigned char* message, std::size_t size);
+    unsigned int port() const { return port_; }
+
+private:
+    unsigned int port_;
+    std::mutex mutex_;
+    RtMidiOut out_;
+};
+
+// Opens each MIDI port once per process and shares it between sessions. An input
+// fans its messages out to every subscribed session; a port closes again when its
+// last user goes away.
+class MidiPortPool {
+public:
+    using InputHandler = std::function<void(const std::vector<unsigned char>&)>;
+
+    // Returns a token for unsubscribe_input. Throws std::runtime_error if the port can't be opened.
+    int subscribe_input(unsigned int port, InputHandler handler);
+    // Once this returns, the handler is not running and will not be called again
+    void unsubscribe_input(unsigned int port, int token);
+
+    std::shared_ptr<SharedMidiOutput> acquire_output(unsigned int port);
+
+private:
+    struct SharedInput {
+        RtMidiIn in;
+        std::mutex mutex; // Guards handlers; held while dispatching
+        std::vector<std::pair<int, InputHandler>> handlers;
+    };
+
+    static void input_callback(double, std::vector<unsigned char>* message, void* user_data) noexcept;
+
+    std::mutex mutex_;
+    std::map<unsigned int, std::unique_ptr<SharedInput>> inputs_;
+    std::map<unsigned int, std::weak_ptr<SharedMidiOutput>> outputs_;
+    int next_token_ = 1;
+};
+
+#endif
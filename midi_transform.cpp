@@ -0,0 +1,181 @@
+#include "midi_transform.h"
+#include "third_party/nlohmann/json.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+using json = nlohmann::json;
+
+// Message types by table index
+static constexpr int NOTE_OFF = 0, NOTE_ON = 1, POLY_PRESSURE = 2, CONTROL_CHANGE = 3;
+
+MidiTransform::Zone::Zone() {
+    for (int i = 0; i < 128; ++i) {
+        velocity_curve[i] = static_cast<uint8_t>(i);
+        cc_map[i] = static_cast<int16_t>(i);
+    }
+}
+
+MidiTransform::MidiTransform(std::vector<Zone> zones) : zones_(std::move(zones)) {
+    if (zones_.size() > MAX_ZONES) {
+        throw std::runtime_error("At most " + std::to_string(MAX_ZONES) + " zones per input");
+    }
+    compiled_.resize(zones_.size());
+    for (std::size_t z = 0; z < zones_.size(); ++z) {
+        const Zone& zone = zones_[z];
+        CompiledZone& compiled = compiled_[z];
+        compiled.status_channel = zone.channel & 0x0F;
+        for (int type = 0; type < 8; ++type) {
+            for (int value = 0; value < 128; ++value) {
+                uint8_t gate = zone.pass_other;
+                uint8_t data1 = static_cast<uint8_t>(value);
+                uint8_t data2 = static_cast<uint8_t>(value);
+                if (type == NOTE_OFF || type == NOTE_ON || type == POLY_PRESSURE) {
+                    int note = value + zone.transpose;
+                    bool in_zone = value >= zone.low_note && value <= zone.high_note && note >= 0 && note <= 127;
+                    gate = in_zone && (type != POLY_PRESSURE || zone.pass_other);
+                    data1 = static_cast<uint8_t>(std::clamp(note, 0, 127));
+                    // Velocity 0 is a note off and must stay one; anything else must not become one
+                    if (type == NOTE_ON) data2 = value ? std::max<uint8_t>(1, zone.velocity_curve[value]) : 0;
+                } else if (type == CONTROL_CHANGE) {
+                    gate = zone.cc_map[value] != DROP;
+                    data1 = static_cast<uint8_t>(zone.cc_map[value] & 0x7F);
+                } else if (type == 7) {
+                    gate = 0; // System messages never reach the transform
+                }
+                compiled.gate[type][value] = gate;
+                compiled.data1[type][value] = data1;
+                compiled.data2[type][value] = data2;
+            }
+        }
+    }
+}
+
+MidiTransform MidiTransform::passthrough(uint8_t channel) {
+    Zone zone;
+    zone.channel = channel;
+    return MidiTransform({zone});
+}
+
+std::size_t MidiTransform::process(const uint8_t* message, std::size_t size, Message* out) const noexcept {
+    const uint8_t type = (message[0] >> 4) & 7;
+    const uint8_t status = message[0] & 0xF0;
+    const uint8_t data1 = size > 1 ? message[1] & 0x7F : 0;
+    const uint8_t data2 = size > 2 ? message[2] & 0x7F : 0;
+    const uint8_t out_size = static_cast<uint8_t>(std::min<std::size_t>(size, 3));
+    std::size_t count = 0;
+    for (const CompiledZone& zone : compiled_) {
+        // Always written; only kept (by advancing count) if the zone's gate is open
+        Message& routed = out[count];
+        routed.bytes[0] = status | zone.status_channel;
+        routed.bytes[1] = zone.data1[type][data1];
+        routed.bytes[2] = zone.data2[type][data2];
+        routed.size = out_size;
+        count += zone.gate[type][data1];
+    }
+    return count;
+}
+
+std::vector<uint8_t> MidiTransform::channels() const {
+    std::vector<uint8_t> channels;
+    for (const Zone& zone : zones_) {
+        if (std::find(channels.begin(), channels.end(), zone.channel) == channels.end()) channels.push_back(zone.channel);
+    }
+    return channels;
+}
+
+static int field_in_range(const json& zone, const char* field, int fallback, int low, int high) {
+    if (!zone.contains(field)) return fallback;
+    if (!zone.at(field).is_number_integer()) throw std::runtime_error(std::string("Zone field '") + field + "' must be an integer");
+    int value = zone.at(field).get<int>();
+    if (value < low || value > high) {
+        throw std::runtime_error(std::string("Zone field '") + field + "' out of range: " + std::to_string(value));
+    }
+    return value;
+}
+
+static std::array<uint8_t, 128> velocity_curve(const json& spec) {
+    std::array<uint8_t, 128> curve;
+    if (spec.is_array()) {
+        if (spec.size() != 128) throw std::runtime_error("Velocity table needs 128 entries");
+        for (int i = 0; i < 128; ++i) {
+            int value = spec.at(i).get<int>();
+            if (value < 0 || value > 127) throw std::runtime_error("Velocity table entry out of range: " + std::to_string(value));
+            curve[i] = static_cast<uint8_t>(value);
+        }
+        return curve;
+    }
+    if (spec.is_number_integer()) {
+        int fixed = spec.get<int>();
+        if (fixed < 1 || fixed > 127) throw std::runtime_error("Fixed velocity out of range: " + std::to_string(fixed));
+        curve.fill(static_cast<uint8_t>(fixed));
+        return curve;
+    }
+    std::string name = spec.is_string() ? spec.get<std::string>() : "";
+    double exponent = name == "linear" ? 1.0 : name == "soft" ? 0.5 : name == "hard" ? 2.0 : 0.0;
+    if (exponent == 0.0) throw std::runtime_error("Unknown velocity curve: " + spec.dump());
+    for (int i = 0; i < 128; ++i) {
+        curve[i] = static_cast<uint8_t>(std::lround(127.0 * std::pow(i / 127.0, exponent)));
+    }
+    return curve;
+}
+
+std::vector<MidiTransform::Zone> MidiTransform::parse_zones(const std::string& json_text) {
+    json spec;
+    try {
+        spec = json::parse(json_text);
+    } catch (const json::exception& e) {
+        throw std::runtime_error(std::string("Invalid routing JSON: ") + e.what());
+    }
+    if (!spec.is_array()) throw std::runtime_error("Routing must be an array of zones");
+    if (spec.size() > MAX_ZONES) throw std::runtime_error("At most " + std::to_string(MAX_ZONES) + " zones per input");
+    std::vector<Zone> zones;
+    for (const auto& item : spec) {
+        if (!item.is_object()) throw std::runtime_error("Each zone must be an object");
+        Zone zone;
+        zone.channel = static_cast<uint8_t>(field_in_range(item, "channel", 0, 0, 15));
+        zone.low_note = static_cast<uint8_t>(field_in_range(item, "low", 0, 0, 127));
+        zone.high_note = static_cast<uint8_t>(field_in_range(item, "high", 127, 0, 127));
+        zone.transpose = field_in_range(item, "transpose", 0, -127, 127);
+        if (zone.low_note > zone.high_note) throw std::runtime_error("Zone 'low' is above 'high'");
+        if (item.contains("velocity")) zone.velocity_curve = velocity_curve(item.at("velocity"));
+        if (!item.value("controllers", true)) zone.cc_map.fill(static_cast<int16_t>(DROP));
+        if (item.contains("cc_map")) {
+            for (const auto& [source, target] : item.at("cc_map").items()) {
+                int from = -1;
+                try {
+                    from = std::stoi(source);
+                } catch (const std::exception&) {
+                }
+                int to = target.is_number_integer() ? target.get<int>() : -2;
+                if (from < 0 || from > 127 || to < DROP || to > 127) {
+                    throw std::runtime_error("Invalid cc_map entry: \"" + source + "\": " + target.dump());
+                }
+                zone.cc_map[from] = static_cast<int16_t>(to);
+            }
+        }
+        zone.pass_other = item.value("other", true);
+        zones.push_back(zone);
+    }
+    return zones;
+}
+
+std::string MidiTransform::zones_json(const std::vector<Zone>& zones) {
+    json spec = json::array();
+    for (const Zone& zone : zones) {
+        json item;
+        item["channel"] = zone.channel;
+        item["low"] = zone.low_note;
+        item["high"] = zone.high_note;
+        item["transpose"] = zone.transpose;
+        item["velocity"] = zone.velocity_curve;
+        json cc_map = json::object();
+        for (int i = 0; i < 128; ++i) {
+            if (zone.cc_map[i] != i) cc_map[std::to_string(i)] = zone.cc_map[i];
+        }
+        item["cc_map"] = cc_map;
+        item["other"] = zone.pass_other;
+        spec.push_back(item);
+    }
+    return spec.dump();
+}
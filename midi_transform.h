@@ -0,0 +1,70 @@
+#ifndef MIDI_TRANSFORM_H
+#define MIDI_TRANSFORM_H
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Routing for one MIDI input: a list of zones, each producing at most one copy of every
+// incoming channel message. Zones with disjoint note ranges make a keyboard split,
+// overlapping ones layer. Zones are compiled into per-message-type lookup tables, so
+// processing a message is a handful of loads per zone with no branches on the settings.
+class MidiTransform {
+public:
+    static constexpr std::size_t MAX_ZONES = 8;
+    static constexpr int DROP = -1; // cc_map entry that filters the controller out
+
+    struct Zone {
+        uint8_t channel = 0;     // 0-based output channel
+        uint8_t low_note = 0;    // Inclusive note range, before transposing
+        uint8_t high_note = 127;
+        int transpose = 0;       // Semitones; notes pushed outside 0-127 are dropped
+        std::array<uint8_t, 128> velocity_curve; // Note-on velocity lookup
+        std::array<int16_t, 128> cc_map;         // Target controller, or DROP
+        bool pass_other = true;  // Pitch bend, pressure and program change
+
+        Zone();
+    };
+
+    // A channel message after routing; size is 2 or 3
+    struct Message {
+        std::array<uint8_t, 3> bytes;
+        uint8_t size;
+    };
+
+    MidiTransform() = default; // No zones: every message is dropped
+    explicit MidiTransform(std::vector<Zone> zones);
+
+    // All notes on one channel, unchanged; what a session does without explicit routing
+    static MidiTransform passthrough(uint8_t channel);
+
+    // Routes one channel message (status byte first) into `out`, which must hold
+    // MAX_ZONES messages. Returns how many were written.
+    std::size_t process(const uint8_t* message, std::size_t size, Message* out) const noexcept;
+
+    const std::vector<Zone>& zones() const noexcept { return zones_; }
+    std::vector<uint8_t> channels() const; // Output channels in use, each once
+
+    // JSON array of zones, e.g. [{"channel": 1, "low": 0, "high": 59, "transpose": -12,
+    // "velocity": "soft", "cc_map": {"1": 11, "64": -1}, "controllers": true, "other": true}].
+    // "velocity" is "linear", "soft", "hard", a fixed value or a 128-entry table. Throws
+    // std::runtime_error naming the offending field.
+    static std::vector<Zone> parse_zones(const std::string& json_text);
+    static std::string zones_json(const std::vector<Zone>& zones);
+
+private:
+    // Indexed by (status >> 4) & 7, i.e. note off through pitch bend, then by data byte 1
+    struct CompiledZone {
+        uint8_t status_channel;
+        uint8_t gate[8][128];  // 1 if the zone emits this message
+        uint8_t data1[8][128]; // Mapped note or controller number
+        uint8_t data2[8][128]; // Mapped velocity; identity elsewhere
+    };
+
+    std::vector<Zone> zones_;
+    std::vector<CompiledZone> compiled_;
+};
+
+#endif
@@ -41,4 +41,12 @@ void MidiUtils::sendMidiMessage(RtMidiOut& midiOut, const std::vector<unsigned c
     } catch (...) {
         std::cerr << "Failed to send MIDI message\n";
     }
+}
+
+void MidiUtils::sendMidiMessage(RtMidiOut& midiOut, const unsigned char* message, size_t size) {
+    try {
+        midiOut.sendMessage(message, size);
+    } catch (...) {
+        std::cerr << "Failed to send MIDI message\n";
+    }
 }
\ No newline at end of file
@@ -10,6 +10,7 @@ public:
     static void listDevices(RtMidiIn& midiIn, RtMidiOut& midiOut);
     static unsigned int selectInputDevice(RtMidiIn& midiIn);
     static void sendMidiMessage(RtMidiOut& midiOut, const std::vector<unsigned char>& message);
+    static void sendMidiMessage(RtMidiOut& midiOut, const unsigned char* message, size_t size);
 };
 
 #endif
@@ -0,0 +1,63 @@
+#include "probe_stats.h"
+#include <algorithm>
+#include <vector>
+
+void ProbeStats::add_reply(int64_t rtt_ns) {
+    samples_.push_back(std::max<int64_t>(rtt_ns, 0));
+    if (samples_.size() > WINDOW) samples_.pop_front();
+}
+
+void ProbeStats::add_loss() {
+    samples_.push_back(-1);
+    if (samples_.size() > WINDOW) samples_.pop_front();
+}
+
+bool ProbeStats::reachable() const noexcept {
+    return std::any_of(samples_.begin(), samples_.end(), [](int64_t rtt) { return rtt >= 0; });
+}
+
+int64_t ProbeStats::median_rtt_ns() const {
+    std::vector<int64_t> replies;
+    for (int64_t rtt : samples_) {
+        if (rtt >= 0) replies.push_back(rtt);
+    }
+    if (replies.empty()) return -1;
+    auto middle = replies.begin() + replies.size() / 2;
+    std::nth_element(replies.begin(), middle, replies.end());
+    return *middle;
+}
+
+int64_t ProbeStats::jitter_ns() const {
+    int64_t previous = -1;
+    int64_t total = 0;
+    int64_t count = 0;
+    for (int64_t rtt : samples_) {
+        if (rtt < 0) continue;
+        if (previous >= 0) {
+            total += rtt > previous ? rtt - previous : previous - rtt;
+            ++count;
+        }
+        previous = rtt;
+    }
+    return count > 0 ? total / count : 0;
+}
+
+double ProbeStats::loss() const noexcept {
+    if (samples_.empty()) return 0.0;
+    auto lost = std::count(samples_.begin(), samples_.end(), -1);
+    return static_cast<double>(lost) / static_cast<double>(samples_.size());
+}
+
+int64_t ProbeStats::score_ns() const {
+    int64_t median = median_rtt_ns();
+    if (median < 0) return UNREACHABLE;
+    return median + 2 * jitter_ns() + static_cast<int64_t>(loss() * LOSS_PENALTY_NS);
+}
+
+bool ProbeStats::clearly_better(const ProbeStats& candidate, const ProbeStats& current) {
+    int64_t ours = current.score_ns();
+    int64_t theirs = candidate.score_ns();
+    if (theirs == UNREACHABLE) return false;
+    if (ours == UNREACHABLE) return true;
+    return theirs < ours - ours / 5 && ours - theirs > 5000000;
+}
@@ -0,0 +1,35 @@
+#ifndef PROBE_STATS_H
+#define PROBE_STATS_H
+
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+
+// Latency estimate for one candidate server from PROB echoes: the median of the recent
+// round trips, their jitter (mean change between consecutive replies, as in RFC 3550)
+// and the share of probes that went unanswered. Single-threaded; callers lock.
+class ProbeStats {
+public:
+    static constexpr std::size_t WINDOW = 32; // Most recent probes kept
+    static constexpr int64_t LOSS_PENALTY_NS = 200000000; // Score cost of losing every probe
+    static constexpr int64_t UNREACHABLE = INT64_MAX;
+
+    void add_reply(int64_t rtt_ns);
+    void add_loss();
+
+    bool reachable() const noexcept; // At least one reply in the window
+    int64_t median_rtt_ns() const;   // -1 without replies
+    int64_t jitter_ns() const;       // 0 with fewer than two replies
+    double loss() const noexcept;    // 0..1
+    std::size_t probes() const noexcept { return samples_.size(); }
+
+    // Lower is better: median + 2 x jitter + loss x LOSS_PENALTY_NS; UNREACHABLE without replies
+    int64_t score_ns() const;
+    // True if `candidate` beats `current` by enough to be worth a switch: 20% and 5 ms
+    static bool clearly_better(const ProbeStats& candidate, const ProbeStats& current);
+
+private:
+    std::deque<int64_t> samples_; // Round trips, oldest first; -1 for a lost probe
+};
+
+#endif
@@ -0,0 +1,61 @@
+#include "relay.h"
+#include "jam_protocol.h"
+#include <cstring>
+
+void RelayFrame::encode(std::vector<char>& out) const {
+    out.resize(JamProtocol::RELAY_HEADER_SIZE + payload_size);
+    char* p = out.data();
+    JamProtocol::write_tag(p, JamProtocol::RELAY_TAG);
+    JamProtocol::write_u32(p + JamProtocol::TAG_SIZE, origin_node);
+    JamProtocol::write_u32(p + JamProtocol::TAG_SIZE + 4, sequence);
+    JamProtocol::write_u16(p + JamProtocol::TAG_SIZE + 8, origin_client);
+    p[JamProtocol::TAG_SIZE + 10] = static_cast<char>(hops);
+    if (payload_size > 0) std::memcpy(p + JamProtocol::RELAY_HEADER_SIZE, payload, payload_size);
+}
+
+bool RelayFrame::decode(const char* data, std::size_t bytes, RelayFrame& frame) noexcept {
+    if (!JamProtocol::has_header(data, bytes, JamProtocol::RELAY_TAG, JamProtocol::RELAY_HEADER_SIZE + 1)) return false;
+    const char* p = data + JamProtocol::TAG_SIZE;
+    RelayFrame decoded;
+    decoded.origin_node = JamProtocol::read_u32(p);
+    decoded.sequence = JamProtocol::read_u32(p + 4);
+    decoded.origin_client = JamProtocol::read_u16(p + 8);
+    decoded.hops = static_cast<uint8_t>(p[10]);
+    decoded.payload = data + JamProtocol::RELAY_HEADER_SIZE;
+    decoded.payload_size = bytes - JamProtocol::RELAY_HEADER_SIZE;
+    if (decoded.origin_node == 0 || decoded.hops == 0 || decoded.hops > MAX_HOPS) return false;
+    frame = decoded;
+    return true;
+}
+
+bool RelayFilter::accept(uint32_t origin, uint32_t sequence, std::chrono::steady_clock::time_point now) {
+    auto [it, inserted] = origins_.try_emplace(origin);
+    Origin& state = it->second;
+    state.last_seen = now;
+    if (inserted) {
+        state.highest = sequence;
+        state.window = 1;
+        return true;
+    }
+    // Signed distance, so the sequence may wrap
+    int32_t ahead = static_cast<int32_t>(sequence - state.highest);
+    if (ahead > 0) {
+        state.window = ahead >= 64 ? 1 : (state.window << ahead) | 1;
+        state.highest = sequence;
+        return true;
+    }
+    uint32_t age = static_cast<uint32_t>(-static_cast<int64_t>(ahead));
+    if (age >= 64 || (state.window & (1ull << age))) return false;
+    state.window |= 1ull << age;
+    return true;
+}
+
+void RelayFilter::expire(std::chrono::steady_clock::time_point now, std::chrono::steady_clock::duration idle) {
+    for (auto it = origins_.begin(); it != origins_.end();) {
+        if (now - it->second.last_seen > idle) {
+            it = origins_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
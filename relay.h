@@ -0,0 +1,50 @@
+#ifndef RELAY_H
+#define RELAY_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+// Server-to-server federation. A room can span several relay nodes: each node links to
+// at most one upstream node, so the nodes form a tree, and every MIDI event crosses each
+// link once inside an RLAY frame before the receiving node fans it out to its own clients.
+// Frames carry the originating node and a per-node sequence number; nodes drop frames
+// they have seen before and count down a hop limit, so a misconfigured cycle cannot loop.
+struct RelayFrame {
+    static constexpr uint8_t MAX_HOPS = 8; // Longest chain of links an event may cross
+
+    uint32_t origin_node = 0;
+    uint32_t sequence = 0;      // Per origin node, bumped for every event it relays
+    uint16_t origin_client = 0; // Sender id on the origin node
+    uint8_t hops = 0;           // Links left to cross, including the one it arrived on
+    const char* payload = nullptr;
+    std::size_t payload_size = 0;
+
+    // `out` becomes the whole frame, header and payload
+    void encode(std::vector<char>& out) const;
+    // Points payload into `data`; false for anything but a well-formed frame
+    static bool decode(const char* data, std::size_t bytes, RelayFrame& frame) noexcept;
+};
+
+// Duplicate suppression: per origin node, the highest sequence seen and a 64-frame
+// window below it, like PacketAuth's replay window.
+class RelayFilter {
+public:
+    // False if this frame was seen already or is too old to tell
+    bool accept(uint32_t origin, uint32_t sequence, std::chrono::steady_clock::time_point now);
+    // Forgets origins idle for longer than `idle`
+    void expire(std::chrono::steady_clock::time_point now, std::chrono::steady_clock::duration idle);
+    std::size_t origins() const noexcept { return origins_.size(); }
+
+private:
+    struct Origin {
+        uint32_t highest = 0;
+        uint64_t window = 0; // Bit i: highest - i was seen
+        std::chrono::steady_clock::time_point last_seen;
+    };
+    std::unordered_map<uint32_t, Origin> origins_;
+};
+
+#endif
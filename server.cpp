@@ -11,8 +11,32 @@
 #include <ctime>   // For std::time_t, std::ctime
 #include <mutex>   // For std::mutex
 #include <algorithm>
+#include <atomic>
 #include <csignal> // For signal handling
+#include <cstring> // For std::strerror
+#include <cstdio>
+#include <fstream>
+#include <functional>
 #include "third_party/nlohmann/json.hpp"
+#include "jam_protocol.h"
+#include "clock_sync.h"
+#include "tempo_clock.h"
+#include "midi_message.h"
+#include "egress_queue.h"
+#include "subscription.h"
+#include "ump.h"
+#include "auth.h"
+#include "hot_restart.h"
+#include "relay.h"
+#include "server_config.h"
+#include "server_metrics.h"
+#include "trace.h"
+#include "uring_io.h"
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#endif
 
 using boost::asio::ip::udp;
 using json = nlohmann::json;
@@ -61,6 +85,25 @@ struct Client {
     std::chrono::steady_clock::time_point last_midi_activity;  // For MIDI activity
     std::chrono::steady_clock::time_point last_ping_sent; // New: Timestamp of last ping
     int64_t latency_ms = -1; // New: Latency in milliseconds (-1 if unknown)
+    int64_t rtt_us = -1; // Round trip from the timestamped PING/PONG exchange (-1 if unknown)
+    uint16_t id = 0; // Stamped on forwarded SysEx fragments so receivers can reassemble per sender
+    std::string key; // "ip:port", the clients_ map key
+    std::size_t listener = 0; // Index of the socket the client joined on; replies go out from it
+
+    TokenBucket ingress_limit;
+    uint64_t throttled_packets = 0; // Dropped by ingress_limit
+    std::chrono::steady_clock::time_point last_throttle_log;
+    EgressQueue egress; // Packets waiting for this client while a send is in flight
+    bool send_in_flight = false;
+    uint64_t coalesced_packets = 0; // Controller updates merged in egress before reaching this client
+    SubscriptionTable subscriptions; // Which senders and channels this client wants to hear
+    uint64_t filtered_packets = 0; // Forwarded packets its subscriptions removed entirely
+    PacketAuth auth; // Seals and opens its datagrams when the room has a password
+    uint64_t join_nonce = 0; // Client nonce of the AUTH that admitted it, to recognise retransmits
+    uint32_t relay_node = 0; // Set once a downstream relay node sent LINK: it gets RLAY frames, not raw MIDI
+    bool upstream = false; // Our own link to the upstream relay node
+    uint64_t session_token = 0; // Sent in SESS; an RSUM with it re-attaches this session
+    bool ump = false; // Asked for UMP datagrams with FRMT; raw MIDI 1.0 otherwise
 
     Client() noexcept
         : endpoint(), channel(0), nickname("unknown"),
@@ -75,53 +118,545 @@ struct Client {
 };
 
 class MidiJamServer {
-    static constexpr size_t BUFFER_SIZE = 128;
-    static constexpr auto HEARTBEAT_TIMEOUT = std::chrono::seconds(20);  // Timeout for connection
+    static constexpr size_t BUFFER_SIZE = 512; // Fits a full SysEx fragment, relayed
+    static_assert(BUFFER_SIZE >= JamProtocol::RELAY_HEADER_SIZE + JamProtocol::SYSEX_HEADER_SIZE + JamProtocol::SYSEX_FRAGMENT_PAYLOAD +
+                  PacketAuth::TRAILER_SIZE, "Relayed SysEx fragment would be truncated");
     static constexpr auto MIDI_ACTIVITY_TIMEOUT = std::chrono::seconds(2);  // Timeout for MIDI activity
-    static constexpr auto HEARTBEAT_INTERVAL = std::chrono::seconds(5);
+    static constexpr int64_t MIN_START_LEAD_NS = 50000000;   // Schedule Start at least 50 ms ahead...
+    static constexpr int64_t MAX_START_LEAD_NS = 500000000;  // ...and at most 500 ms, depending on the slowest client
+    static constexpr auto DRAIN_TIMEOUT = std::chrono::seconds(1); // Flushing egress queues before exit or handoff
+    static constexpr auto HANDOFF_READY_TIMEOUT = std::chrono::seconds(10); // For the new process on hot restart
+    static constexpr int SNAPSHOT_VERSION = 1;
+    static constexpr auto LINK_RETRY_INTERVAL = std::chrono::seconds(1); // Joining the upstream node
+    static constexpr auto LINK_SYNC_INTERVAL = std::chrono::seconds(1); // Clock sync (and keepalive) on the upstream link...
+    static constexpr auto LINK_FAST_SYNC_INTERVAL = std::chrono::milliseconds(250); // ...until the first estimate
+    static constexpr int64_t TEMPO_RESYNC_NS = 1000000; // Re-broadcast the upstream tempo when our mapping moves by more
+    static constexpr auto REMOTE_SENDER_TIMEOUT = std::chrono::minutes(10); // Forget relayed senders idle this long
+    static constexpr auto RESUME_WINDOW = std::chrono::minutes(5); // A timed-out session can be resumed this long
+
+    // One UDP socket per configured port, each with its own receive loop and buffer
+    struct Listener {
+        explicit Listener(boost::asio::io_context& io) : socket(io) {}
+        udp::socket socket;
+        std::array<char, BUFFER_SIZE> buffer;
+    };
 
+    const ServerConfig config_;
     boost::asio::io_context io_context_;
-    udp::socket socket_;
+    std::vector<std::unique_ptr<Listener>> listeners_;
     std::unordered_map<std::string, Client> clients_;
-    std::array<char, BUFFER_SIZE> buffer_;
+    std::unordered_map<uint64_t, std::string> live_sessions_; // Session token -> key in clients_; see erase_client
+    std::mutex clients_mutex_; // Guards clients_ and tempo_ across the io threads
     boost::asio::steady_timer cleanup_timer_;
     boost::asio::steady_timer ping_timer_;
     bool is_running_ = true; // Flag to control server loop
+    TempoState tempo_; // Room tempo master state, distributed to clients as TMPO
+    uint16_t next_client_id_ = 1;
+    ServerMetrics metrics_;
+    std::unique_ptr<MetricsEndpoint> metrics_endpoint_;
+    const std::vector<std::string> arguments_; // Our command line, re-run on hot restart (without -password)
+    boost::asio::signal_set signals_;
+    boost::asio::steady_timer drain_timer_;
+    std::atomic<bool> accepting_{true}; // Cleared on shutdown/handoff: receive loops stop re-arming
+    std::atomic<int> active_receives_{0}; // Receive loops still armed or in their handler
+    std::unique_ptr<UringIo> uring_; // -io uring; null on Asio
+    bool password_ = false; // Room has a password: configured, or its key handed over by hot restart
+    bool hand_over_room_key_ = false; // It came from -password, which the next process doesn't get
+    SipKey room_key_; // Derived from the password; unused without one
+    SipKey cookie_key_; // Keys the stateless server nonces in CHAL
+
+    // Relay federation: players on other nodes appear here under local alias ids
+    struct RemoteSender {
+        uint16_t id = 0;
+        uint32_t node = 0;
+        uint16_t origin_id = 0; // Its id on its own node
+        uint8_t channel = 0;
+        std::chrono::steady_clock::time_point last_seen;
+    };
+    uint32_t node_id_ = 0; // Random per server, carried over on hot restart
+    uint32_t relay_sequence_ = 0;
+    RelayFilter relay_filter_;
+    std::unordered_map<uint64_t, RemoteSender> remote_senders_; // By origin node << 16 | origin id
+    udp::endpoint upstream_endpoint_;
+    std::string upstream_key_; // Its clients_ key; the entry exists while the link is up
+    uint64_t link_nonce_ = 0; // Client nonce of our pending JOIN upstream
+    PacketAuth link_auth_; // Session keys derived from the upstream's CHAL, until its ACK
+    ClockSync upstream_clock_; // Upstream session clock, to translate its tempo anchors onto ours
+    TempoState upstream_tempo_; // Latest TMPO from upstream, in its clock
+    bool have_upstream_tempo_ = false;
+    TempoState adopted_tempo_; // The upstream TMPO we last passed on, in its clock
+    bool link_denied_ = false; // Logged once per outage, not on every retry
+    boost::asio::steady_timer link_timer_;
+
+    // Timed-out sessions, by token: their id and subscriptions wait for an RSUM
+    struct ParkedSession {
+        Client client;
+        std::chrono::steady_clock::time_point parked;
+    };
+    std::unordered_map<uint64_t, ParkedSession> parked_sessions_;
 
 public:
-    MidiJamServer(short port = 5000)
-        : socket_(io_context_, udp::endpoint(udp::v4(), port)),
+    // `arguments` is the full command line, kept for hot restart
+    MidiJamServer(const ServerConfig& config, std::vector<std::string> arguments)
+        : config_(config),
           cleanup_timer_(io_context_),
-          ping_timer_(io_context_) {
-        socket_.set_option(boost::asio::socket_base::reuse_address(true));
-        socket_.set_option(boost::asio::socket_base::receive_buffer_size(65536));
-        socket_.set_option(boost::asio::socket_base::send_buffer_size(65536));
-        start_receive();
+          ping_timer_(io_context_),
+          arguments_(ServerConfig::strip_password(arguments)),
+          signals_(io_context_),
+          drain_timer_(io_context_),
+          link_timer_(io_context_) {
+        tempo_.version = 1;
+        do {
+            node_id_ = static_cast<uint32_t>(Auth::random_u64());
+        } while (node_id_ == 0);
+        if (!config_.upstream.empty()) resolve_upstream();
+        tempo_.bpm_milli = static_cast<int64_t>(config_.initial_bpm * 1000.0);
+        json handoff;
+        if (config_.handoff_fd >= 0) {
+            try {
+                handoff = json::parse(HotRestart::read_snapshot(config_.handoff_fd));
+            } catch (const json::exception& e) {
+                throw std::runtime_error(std::string("Invalid handoff snapshot: ") + e.what());
+            }
+            if (handoff.value("version", 0) != SNAPSHOT_VERSION) throw std::runtime_error("Unsupported handoff snapshot version");
+        }
+        if (handoff.contains("room_key")) {
+            // Stands in for the -password flag, which hot restart leaves off our command line
+            room_key_ = SipKey{handoff.at("room_key").at(0).get<uint64_t>(), handoff.at("room_key").at(1).get<uint64_t>()};
+            password_ = true;
+            hand_over_room_key_ = true;
+        } else if (!config_.password.empty()) {
+            room_key_ = Auth::room_key(config_.password);
+            password_ = true;
+            hand_over_room_key_ = config_.password_in_args;
+        }
+        if (password_) {
+            cookie_key_ = SipKey{Auth::random_u64(), Auth::random_u64()};
+            logger.log("Room password set; clients must authenticate");
+        }
+        for (uint16_t port : config_.ports) {
+            listeners_.push_back(open_listener(port, inherited_fd(handoff, port)));
+        }
+        if (!handoff.is_null()) {
+            // Ports dropped from the new config
+            for (const auto& inherited : handoff.at("listeners")) {
+                uint16_t port = inherited.at("port").get<uint16_t>();
+                if (std::find(config_.ports.begin(), config_.ports.end(), port) == config_.ports.end()) {
+                    logger.log("UDP port " + std::to_string(port) + " is no longer configured; closing it");
+                    boost::system::error_code ec;
+                    udp::socket(io_context_, udp::v4(), inherited.at("fd").get<int>()).close(ec);
+                }
+            }
+            restore_state(handoff);
+        }
+        if (config_.io_backend == "uring") start_uring();
+        for (std::size_t i = 0; i < listeners_.size(); ++i) {
+            start_receive(i);
+        }
+        if (!config_.trace_file.empty()) {
+            if (!Trace::COMPILED_IN) logger.log("Tracing was compiled out (MIDIJAM_TRACING=OFF); the trace will be empty");
+            Trace::set_enabled(true);
+        }
+        start_metrics(handoff);
         start_cleanup();
         start_ping();
-        logger.log("Server started on UDP port " + std::to_string(port));
+        start_signals();
+        if (!config_.upstream.empty()) {
+            logger.log("Relay node " + node_name(node_id_) + " linking to upstream " + config_.upstream);
+            start_link(std::chrono::milliseconds(0));
+        }
+        if (!handoff.is_null()) {
+            HotRestart::notify_ready(config_.handoff_ready_fd);
+            logger.log("Took over " + std::to_string(clients_.size()) + " client(s) from the previous server process");
+        }
     }
 
     void run() {
+        unsigned int count = config_.worker_threads;
+        if (count == 0) count = std::max(1u, std::thread::hardware_concurrency());
+        logger.log("Running " + std::to_string(count) + " worker thread(s)" + (uring_ ? " and an io_uring thread" : ""));
+        std::thread ring_thread;
+        if (uring_) {
+            ring_thread = std::thread([this]() { uring_->run(); });
+            if (!config_.cpu_affinity.empty()) pin_thread(ring_thread, config_.cpu_affinity[0]);
+        }
         std::vector<std::thread> threads;
-        for (size_t i = 0; i < std::thread::hardware_concurrency(); ++i) {
+        for (unsigned int i = 0; i < count; ++i) {
             threads.emplace_back([this]() { io_context_.run(); });
+            if (!config_.cpu_affinity.empty()) {
+                pin_thread(threads.back(), config_.cpu_affinity[i % config_.cpu_affinity.size()]);
+            }
         }
         for (auto& t : threads) {
             if (t.joinable()) t.join();
         }
+        if (ring_thread.joinable()) ring_thread.join();
     }
 
     void stop() {
         is_running_ = false;
+        accepting_ = false;
+        drain_timer_.cancel();
+        link_timer_.cancel();
+        signals_.cancel();
         cleanup_timer_.cancel();
         ping_timer_.cancel();
-        socket_.close();
+        if (metrics_endpoint_) metrics_endpoint_->stop();
+        if (!config_.trace_file.empty()) write_trace();
+        if (uring_) uring_->stop();
+        for (auto& listener : listeners_) {
+            boost::system::error_code ec;
+            listener->socket.close(ec);
+        }
         io_context_.stop();
         logger.log("Server stopped.");
     }
 
 private:
+    // With `inherited_fd`, adopts the bound socket a previous process handed over
+    std::unique_ptr<Listener> open_listener(uint16_t port, int inherited_fd = -1) {
+        auto listener = std::make_unique<Listener>(io_context_);
+        udp::socket& socket = listener->socket;
+        if (inherited_fd >= 0) {
+            socket.assign(udp::v4(), inherited_fd);
+        } else {
+            socket.open(udp::v4());
+            socket.set_option(boost::asio::socket_base::reuse_address(true));
+            socket.bind(udp::endpoint(udp::v4(), port));
+        }
+        socket.set_option(boost::asio::socket_base::receive_buffer_size(config_.receive_buffer_size));
+        socket.set_option(boost::asio::socket_base::send_buffer_size(config_.send_buffer_size));
+        if (config_.busy_poll_us > 0) {
+#if defined(__linux__) && defined(SO_BUSY_POLL)
+            int value = config_.busy_poll_us;
+            if (setsockopt(socket.native_handle(), SOL_SOCKET, SO_BUSY_POLL, &value, sizeof(value)) != 0) {
+                logger.log("SO_BUSY_POLL not applied on port " + std::to_string(port) + ": " + std::strerror(errno));
+            }
+#else
+            logger.log("SO_BUSY_POLL is not supported on this platform; ignoring busy_poll_us");
+#endif
+        }
+        // The kernel may clamp (or double) the requested sizes, so report what we actually got
+        boost::asio::socket_base::receive_buffer_size rcvbuf;
+        boost::asio::socket_base::send_buffer_size sndbuf;
+        socket.get_option(rcvbuf);
+        socket.get_option(sndbuf);
+        logger.log(std::string(inherited_fd >= 0 ? "Adopted" : "Server started on") + " UDP port " + std::to_string(port) + " (rcvbuf=" + std::to_string(rcvbuf.value()) +
+                   ", sndbuf=" + std::to_string(sndbuf.value()) + ")");
+        return listener;
+    }
+
+    static int inherited_fd(const json& handoff, uint16_t port) {
+        if (handoff.is_null()) return -1;
+        for (const auto& inherited : handoff.at("listeners")) {
+            if (inherited.at("port").get<uint16_t>() == port) return inherited.at("fd").get<int>();
+        }
+        return -1;
+    }
+
+    void start_metrics(const json& handoff) {
+        int fd = -1;
+        if (!handoff.is_null() && handoff.contains("metrics")) {
+            const json& metrics = handoff.at("metrics");
+            fd = metrics.at("fd").get<int>();
+            if (metrics.at("address").get<std::string>() != config_.metrics_address ||
+                metrics.at("port").get<uint16_t>() != config_.metrics_port) {
+                boost::system::error_code ec;
+                boost::asio::ip::tcp::socket(io_context_, boost::asio::ip::tcp::v4(), fd).close(ec);
+                fd = -1;
+            }
+        }
+        if (config_.metrics_port == 0) return;
+        metrics_endpoint_ = std::make_unique<MetricsEndpoint>(io_context_, config_.metrics_address, config_.metrics_port,
+            [this]() { return render_metrics(); }, fd);
+        logger.log("Metrics at http://" + config_.metrics_address + ":" + std::to_string(config_.metrics_port) + "/metrics");
+    }
+
+    // SIGINT/SIGTERM: tell clients and flush, then exit. SIGUSR2: hot restart.
+    void start_signals() {
+        signals_.add(SIGINT);
+        signals_.add(SIGTERM);
+#ifdef __linux__
+        signals_.add(SIGUSR2);
+#endif
+        signals_.async_wait([this](const boost::system::error_code& ec, int signal) {
+            if (ec) return;
+#ifdef __linux__
+            if (signal == SIGUSR2) {
+                hot_restart();
+                start_signals();
+                return;
+            }
+#endif
+            shutdown();
+            start_signals(); // A second signal skips the drain
+        });
+    }
+
+    // Stop taking packets: cancel the pending receives and let the handlers wind down
+    void stop_receiving() {
+        accepting_ = false;
+        cleanup_timer_.cancel();
+        ping_timer_.cancel();
+        link_timer_.cancel();
+        cancel_receives();
+    }
+
+    void cancel_receives() noexcept {
+        for (std::size_t i = 0; i < listeners_.size(); ++i) {
+            if (uring_) uring_->stop_receive(i);
+            boost::system::error_code ec;
+            listeners_[i]->socket.cancel(ec);
+        }
+    }
+
+    void resume_receiving() {
+        accepting_ = true;
+        for (std::size_t i = 0; i < listeners_.size(); ++i) start_receive(i);
+        start_cleanup();
+        start_ping();
+        if (!config_.upstream.empty()) start_link(std::chrono::milliseconds(0));
+    }
+
+    // Runs `then` once no receive handler is active and every egress queue is empty,
+    // or after DRAIN_TIMEOUT
+    void when_drained(std::chrono::steady_clock::time_point deadline, std::function<void()> then) {
+        bool drained = active_receives_ == 0 && (!uring_ || uring_->active_receives() == 0);
+        if (!drained) {
+            // A handler may have re-armed just before accepting_ was cleared
+            cancel_receives();
+        }
+        {
+            std::lock_guard<std::mutex> lock(clients_mutex_);
+            for (const auto& [key, client] : clients_) {
+                drained = drained && !client.send_in_flight && client.egress.empty();
+            }
+        }
+        if (drained || std::chrono::steady_clock::now() >= deadline) {
+            then();
+            return;
+        }
+        drain_timer_.expires_after(std::chrono::milliseconds(5));
+        drain_timer_.async_wait([this, deadline, then](const boost::system::error_code& ec) {
+            if (!ec) when_drained(deadline, then);
+        });
+    }
+
+    void shutdown() {
+        if (!accepting_) {
+            logger.log("Stopping without waiting for the drain");
+            stop();
+            return;
+        }
+        stop_receiving();
+        std::size_t count = 0;
+        {
+            std::lock_guard<std::mutex> lock(clients_mutex_);
+            auto notice = std::make_shared<const std::vector<char>>(JamProtocol::SHUTDOWN_TAG,
+                JamProtocol::SHUTDOWN_TAG + JamProtocol::SHUTDOWN_SIZE);
+            auto quit = std::make_shared<const std::vector<char>>(std::initializer_list<char>{'Q', 'U', 'I', 'T'});
+            for (auto& [key, client] : clients_) enqueue(client, client.upstream ? quit : notice, EgressQueue::Lane::Realtime);
+            count = clients_.size();
+        }
+        logger.log("Shutting down; notifying " + std::to_string(count) + " client(s)");
+        when_drained(std::chrono::steady_clock::now() + DRAIN_TIMEOUT, [this]() { stop(); });
+    }
+
+    void hot_restart() {
+        if (!accepting_) return;
+        if (!HotRestart::SUPPORTED) {
+            logger.log("Hot restart is not supported on this platform");
+            return;
+        }
+        logger.log("Hot restart: draining before handing over");
+        stop_receiving();
+        when_drained(std::chrono::steady_clock::now() + DRAIN_TIMEOUT, [this]() { hand_off(); });
+    }
+
+    // Nothing is received or queued any more; the clients' sessions move to the new process
+    void hand_off() {
+        json snapshot = save_state();
+        std::vector<int> fds;
+        for (std::size_t i = 0; i < listeners_.size(); ++i) {
+            int fd = listeners_[i]->socket.native_handle();
+            snapshot["listeners"].push_back({{"port", config_.ports[i]}, {"fd", fd}});
+            fds.push_back(fd);
+        }
+        if (metrics_endpoint_) {
+            int fd = metrics_endpoint_->native_handle();
+            snapshot["metrics"] = {{"address", config_.metrics_address}, {"port", config_.metrics_port}, {"fd", fd}};
+            fds.push_back(fd);
+        }
+        std::string error;
+        int pid = HotRestart::spawn(arguments_, snapshot.dump(), fds, HANDOFF_READY_TIMEOUT, error);
+        if (pid < 0) {
+            logger.log("Hot restart failed (" + error + "); resuming");
+            resume_receiving();
+            return;
+        }
+        logger.log("Handed " + std::to_string(snapshot.at("clients").size()) + " client(s) over to process " + std::to_string(pid));
+        stop();
+    }
+
+    // Room and client registry; session clocks are CLOCK_MONOTONIC, so times stay valid across exec
+    json save_state() {
+        std::lock_guard<std::mutex> lock(clients_mutex_);
+        json state;
+        state["version"] = SNAPSHOT_VERSION;
+        state["listeners"] = json::array();
+        state["next_client_id"] = next_client_id_;
+        state["tempo"] = {{"version", tempo_.version}, {"run_id", tempo_.run_id}, {"anchor_ns", tempo_.anchor_ns},
+                          {"anchor_tick", tempo_.anchor_tick}, {"bpm_milli", tempo_.bpm_milli}, {"running", tempo_.running}};
+        state["cookie_key"] = {cookie_key_.k0, cookie_key_.k1};
+        state["room_check"] = Auth::siphash(room_key_, "room", 4); // Tells the new process if the password changed
+        if (hand_over_room_key_) state["room_key"] = {room_key_.k0, room_key_.k1};
+        state["node_id"] = node_id_;
+        state["relay_sequence"] = relay_sequence_;
+        state["upstream"] = config_.upstream;
+        state["remote_senders"] = json::array();
+        for (const auto& [key, remote] : remote_senders_) {
+            state["remote_senders"].push_back({{"id", remote.id}, {"node", remote.node}, {"origin_id", remote.origin_id},
+                                               {"channel", remote.channel}});
+        }
+        state["clients"] = json::array();
+        for (const auto& [key, client] : clients_) {
+            json saved;
+            saved["address"] = client.endpoint.address().to_string();
+            saved["port"] = client.endpoint.port();
+            saved["listener_port"] = config_.ports[client.listener];
+            saved["channel"] = client.channel;
+            saved["nickname"] = client.nickname;
+            saved["id"] = client.id;
+            saved["latency_ms"] = client.latency_ms;
+            saved["rtt_us"] = client.rtt_us;
+            saved["throttled"] = client.throttled_packets;
+            saved["coalesced"] = client.coalesced_packets;
+            saved["filtered"] = client.filtered_packets;
+            saved["relay_node"] = client.relay_node;
+            saved["upstream"] = client.upstream;
+            saved["session_token"] = client.session_token;
+            saved["ump"] = client.ump;
+            saved["subscriptions"] = json::array();
+            for (const Subscription& subscription : client.subscriptions.entries()) {
+                saved["subscriptions"].push_back({{"sender", subscription.sender}, {"channels", subscription.channels},
+                                                  {"remap", subscription.remap}});
+            }
+            if (client.auth.enabled()) {
+                PacketAuth::State auth = client.auth.state();
+                saved["auth"] = {{"send_key", {auth.send_key.k0, auth.send_key.k1}},
+                                 {"receive_key", {auth.receive_key.k0, auth.receive_key.k1}},
+                                 {"send_sequence", auth.send_sequence}, {"highest_received", auth.highest_received},
+                                 {"received_window", auth.received_window}, {"join_nonce", client.join_nonce}};
+            }
+            state["clients"].push_back(saved);
+        }
+        return state;
+    }
+
+    void restore_state(const json& state) {
+        std::lock_guard<std::mutex> lock(clients_mutex_);
+        next_client_id_ = state.at("next_client_id").get<uint16_t>();
+        const json& tempo = state.at("tempo");
+        tempo_.version = tempo.at("version").get<int64_t>();
+        tempo_.run_id = tempo.at("run_id").get<int64_t>();
+        tempo_.anchor_ns = tempo.at("anchor_ns").get<int64_t>();
+        tempo_.anchor_tick = tempo.at("anchor_tick").get<int64_t>();
+        tempo_.bpm_milli = tempo.at("bpm_milli").get<int64_t>();
+        tempo_.running = tempo.at("running").get<bool>();
+        bool same_room = state.at("room_check").get<uint64_t>() == Auth::siphash(room_key_, "room", 4);
+        if (password_ && same_room) {
+            cookie_key_ = SipKey{state.at("cookie_key").at(0).get<uint64_t>(), state.at("cookie_key").at(1).get<uint64_t>()};
+        }
+        // Older snapshots have no relay state
+        if (state.value("node_id", 0u) != 0) node_id_ = state.at("node_id").get<uint32_t>();
+        relay_sequence_ = state.value("relay_sequence", 0u);
+        bool same_upstream = state.value("upstream", std::string()) == config_.upstream;
+        auto now = std::chrono::steady_clock::now();
+        for (const json& saved : state.value("remote_senders", json::array())) {
+            RemoteSender remote;
+            remote.id = saved.at("id").get<uint16_t>();
+            remote.node = saved.at("node").get<uint32_t>();
+            remote.origin_id = saved.at("origin_id").get<uint16_t>();
+            remote.channel = saved.at("channel").get<uint8_t>();
+            remote.last_seen = now;
+            remote_senders_[remote_key(remote.node, remote.origin_id)] = remote;
+        }
+        for (const json& saved : state.at("clients")) {
+            auto port = std::find(config_.ports.begin(), config_.ports.end(), saved.at("listener_port").get<uint16_t>());
+            bool upstream = saved.value("upstream", false);
+            if (port == config_.ports.end() || saved.contains("auth") != password_ || !same_room ||
+                (upstream && !same_upstream)) {
+                // Its port is gone, or the password or upstream changed: it has to join again
+                logger.log("Not taking over " + saved.at("nickname").get<std::string>() + ": configuration changed");
+                continue;
+            }
+            udp::endpoint endpoint(boost::asio::ip::make_address(saved.at("address").get<std::string>()),
+                                   saved.at("port").get<uint16_t>());
+            std::string key = endpoint.address().to_string() + ":" + std::to_string(endpoint.port());
+            if (upstream && key != upstream_key_) {
+                logger.log("Not taking over the upstream link: " + config_.upstream + " now resolves elsewhere");
+                continue;
+            }
+            Client& client = clients_.try_emplace(key, endpoint, saved.at("channel").get<uint8_t>(),
+                                                  saved.at("nickname").get<std::string>()).first->second;
+            client.id = saved.at("id").get<uint16_t>();
+            client.key = key;
+            client.listener = static_cast<std::size_t>(port - config_.ports.begin());
+            client.latency_ms = saved.at("latency_ms").get<int64_t>();
+            client.rtt_us = saved.at("rtt_us").get<int64_t>();
+            client.throttled_packets = saved.at("throttled").get<uint64_t>();
+            client.coalesced_packets = saved.at("coalesced").get<uint64_t>();
+            client.filtered_packets = saved.at("filtered").get<uint64_t>();
+            client.relay_node = saved.value("relay_node", 0u);
+            client.upstream = upstream;
+            client.session_token = saved.value("session_token", static_cast<uint64_t>(0));
+            if (client.session_token != 0) live_sessions_[client.session_token] = key;
+            client.ump = saved.value("ump", false);
+            client.ingress_limit = TokenBucket(config_.ingress_rate, config_.ingress_burst);
+            client.egress = EgressQueue(config_.egress_max_depth, config_.egress_max_age);
+            for (const json& entry : saved.at("subscriptions")) {
+                Subscription subscription;
+                subscription.sender = entry.at("sender").get<uint16_t>();
+                subscription.channels = entry.at("channels").get<uint16_t>();
+                subscription.remap = entry.at("remap").get<std::array<uint8_t, 16>>();
+                client.subscriptions.set(subscription);
+            }
+            if (saved.contains("auth")) {
+                const json& auth = saved.at("auth");
+                PacketAuth::State state;
+                state.send_key = SipKey{auth.at("send_key").at(0).get<uint64_t>(), auth.at("send_key").at(1).get<uint64_t>()};
+                state.receive_key = SipKey{auth.at("receive_key").at(0).get<uint64_t>(), auth.at("receive_key").at(1).get<uint64_t>()};
+                state.send_sequence = auth.at("send_sequence").get<uint32_t>();
+                state.highest_received = auth.at("highest_received").get<uint32_t>();
+                state.received_window = auth.at("received_window").get<uint64_t>();
+                client.auth = PacketAuth(state);
+                client.join_nonce = auth.at("join_nonce").get<uint64_t>();
+            }
+        }
+    }
+
+    // The server's steady clock is the session clock, so timestamps need no mapping
+    void write_trace() const {
+        std::ofstream file(config_.trace_file);
+        file << Trace::chrome_json("MidiJam Server", 0, [](int64_t local_ns) { return local_ns; });
+        logger.log(file ? "Trace written to " + config_.trace_file : "Failed to write trace to " + config_.trace_file);
+    }
+
+    static void pin_thread(std::thread& thread, int cpu) {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        int rc = pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+        if (rc != 0) {
+            logger.log("Failed to pin worker to CPU " + std::to_string(cpu) + ": " + std::strerror(rc));
+        }
+#else
+        (void)thread;
+        logger.log("CPU affinity is not supported on this platform; ignoring CPU " + std::to_string(cpu));
+#endif
+    }
+
     // Helper function to log raw data
     void log_data(const std::string& direction, const udp::endpoint& endpoint, const char* buffer, std::size_t bytes) {
         std::ostringstream log_msg;
@@ -145,69 +680,651 @@ private:
         logger.log_verbose(log_msg.str());
     }
 
-    void start_receive() noexcept {
+    void start_receive(std::size_t index) noexcept {
+        if (uring_) {
+            uring_->start_receive(index); // Multishot: stays armed until cancelled
+            return;
+        }
         auto sender = std::make_shared<udp::endpoint>();
-        socket_.async_receive_from(
-            boost::asio::buffer(buffer_), *sender,
-            [this, sender](const boost::system::error_code& ec, std::size_t bytes) {
-                if (!ec && bytes > 0) {
-                    // Log the incoming data
-                    log_data("Received", *sender, buffer_.data(), bytes);
-
-                    handle_packet(*sender, bytes);
-                }
-                if (is_running_) start_receive(); // Conditionally restart receive
+        Listener& listener = *listeners_[index];
+        ++active_receives_;
+        listener.socket.async_receive_from(
+            boost::asio::buffer(listener.buffer), *sender,
+            [this, sender, index, &listener](const boost::system::error_code& ec, std::size_t bytes) {
+                int64_t recv_ns = ClockSync::local_now_ns(); // Session clock receive time, taken first
+                if (!ec && bytes > 0) on_datagram(index, listener.buffer.data(), bytes, *sender, recv_ns);
+                --active_receives_;
+                if (is_running_ && accepting_) start_receive(index); // Conditionally restart receive
             });
     }
 
-	void handle_packet(const udp::endpoint& sender, std::size_t bytes) noexcept {
+    // -io uring: the listeners' datagrams and client sends go through one io_uring instead
+    // of Asio. Handshake and probe replies still use the Asio sockets, which share the
+    // descriptors. Stays on Asio where the kernel can't do it.
+    void start_uring() {
+        try {
+            uring_ = std::make_unique<UringIo>(BUFFER_SIZE,
+                [this](std::size_t index, char* data, std::size_t bytes, const sockaddr* from, std::size_t from_size) {
+                    int64_t recv_ns = ClockSync::local_now_ns();
+                    udp::endpoint sender;
+                    if (from_size > sender.capacity()) return;
+                    std::memcpy(sender.data(), from, from_size);
+                    sender.resize(from_size);
+                    on_datagram(index, data, bytes, sender, recv_ns);
+                });
+            for (auto& listener : listeners_) uring_->add_socket(listener->socket.native_handle());
+            logger.log("Network I/O: io_uring");
+        } catch (const std::exception& e) {
+            uring_.reset();
+            logger.log(std::string("io_uring unavailable (") + e.what() + "); using Asio");
+        }
+    }
+
+    // A received datagram, from either backend; `data` may be overwritten
+    void on_datagram(std::size_t index, char* data, std::size_t bytes, const udp::endpoint& sender, int64_t recv_ns) noexcept {
+        if (static_cast<uint8_t>(data[0]) & 0x80) {
+            MIDIJAM_TRACE_AT(Trace::SERVER_RECEIVE, recv_ns, data, bytes);
+        }
+        metrics_.add(ServerMetrics::RECEIVED_PACKETS);
+        metrics_.add(ServerMetrics::RECEIVED_BYTES, bytes);
+        // Log the incoming data
+        log_data("Received", sender, data, bytes);
+
+        if (JamProtocol::has_tag(data, bytes, JamProtocol::PROBE_TAG, JamProtocol::PROBE_SIZE)) {
+            answer_probe(*listeners_[index], data, sender);
+        } else {
+            std::lock_guard<std::mutex> lock(clients_mutex_);
+            handle_packet(index, data, sender, bytes, recv_ns);
+        }
+        metrics_.observe(ServerMetrics::HANDLE_DURATION, ClockSync::local_now_ns() - recv_ns);
+    }
+
+    // Echoes a PROB as PROR, the same size, so probes can't amplify. Clients probe several
+    // candidate servers before and during a session; this touches no client state, takes no
+    // lock and sends synchronously, so it needs no buffer beyond the receive buffer.
+    void answer_probe(Listener& listener, char* data, const udp::endpoint& sender) noexcept {
+        JamProtocol::write_tag(data, JamProtocol::PROBE_REPLY_TAG);
+        boost::system::error_code ec;
+        listener.socket.send_to(boost::asio::buffer(data, JamProtocol::PROBE_SIZE), sender, 0, ec);
+        if (ec) {
+            metrics_.add(ServerMetrics::SEND_ERRORS);
+        } else {
+            metrics_.add(ServerMetrics::PROBES_ANSWERED);
+        }
+    }
+
+	void handle_packet(std::size_t listener, char* data, const udp::endpoint& sender, std::size_t bytes, int64_t recv_ns) noexcept {
 		std::string sender_key = sender.address().to_string() + ":" + std::to_string(sender.port());
 
-		if (bytes == 4 && std::strncmp(buffer_.data(), "QUIT", 4) == 0) {
+		if (!upstream_key_.empty() && sender_key == upstream_key_) {
+			// Checked first: its handshake replies are not sealed, and it is not one of our clients
+			handle_upstream(data, bytes, recv_ns);
+			return;
+		}
+
+		// Ahead of the password gate: the session it names may no longer be at this address
+		std::size_t resume_size = JamProtocol::RESUME_SIZE + (password_ ? PacketAuth::TRAILER_SIZE : 0);
+		if (JamProtocol::has_tag(data, bytes, JamProtocol::RESUME_TAG, resume_size)) {
+			handle_resume(listener, data, sender, sender_key, bytes);
+			return;
+		}
+
+		if (password_) {
+			if (JamProtocol::has_header(data, bytes, Auth::JOIN_TAG, Auth::JOIN_HEADER_SIZE) ||
+				JamProtocol::has_header(data, bytes, Auth::AUTH_TAG, Auth::AUTH_HEADER_SIZE)) {
+				handle_join(listener, data, sender, sender_key, bytes);
+				return;
+			}
+			// Everything else must come from an admitted client and carry a valid trailer
+			auto it = clients_.find(sender_key);
+			if (it == clients_.end() || !it->second.auth.open(data, bytes)) {
+				logger.log_verbose("Dropped unauthenticated datagram from " + sender_key);
+				metrics_.add(ServerMetrics::AUTH_REJECTED);
+				return;
+			}
+		}
+
+		if (bytes == 4 && std::strncmp(data, "QUIT", 4) == 0) {
 			if (auto it = clients_.find(sender_key); it != clients_.end()) {
 				logger.log("Client disconnected: " + it->second.nickname + " @ " + sender_key);
-				clients_.erase(it);
+				forget_subscriptions_to(it->second.id);
+				erase_client(it);
+				metrics_.add(ServerMetrics::CLIENTS_QUIT);
+			}
+			return;
+		}
+
+		if (bytes == 5 && std::strncmp(data, "CLIST", 5) == 0) {
+			if (auto it = clients_.find(sender_key); it != clients_.end()) {
+				send_client_list(it->second);
+			}
+			return;
+		}
+
+		if (JamProtocol::has_tag(data, bytes, JamProtocol::TRANSPORT_TAG, JamProtocol::TRANSPORT_SIZE)) {
+			if (auto it = clients_.find(sender_key); it != clients_.end()) {
+				it->second.last_heartbeat = std::chrono::steady_clock::now();
+				if (auto link = clients_.find(upstream_key_); link != clients_.end()) {
+					// The root node owns the room tempo; we follow its TMPO like everyone else
+					relay_to(link->second, local_frame(it->second, data, bytes), EgressQueue::Lane::Realtime);
+				} else {
+					const char* p = data + JamProtocol::TAG_SIZE;
+					apply_transport(it->second, JamProtocol::read_i64(p), JamProtocol::read_i64(p + 8), recv_ns);
+				}
+			}
+			return;
+		}
+
+		// Relay links: never from strangers, so neither can create a client
+		if (JamProtocol::has_tag(data, bytes, JamProtocol::LINK_TAG, JamProtocol::LINK_SIZE)) {
+			if (auto it = clients_.find(sender_key); it != clients_.end()) {
+				Client& client = it->second;
+				client.last_heartbeat = std::chrono::steady_clock::now();
+				uint32_t node = JamProtocol::read_u32(data + JamProtocol::TAG_SIZE);
+				if (node != 0 && node != client.relay_node) {
+					client.relay_node = node;
+					forget_subscriptions_to(client.id); // It relays other players now, it doesn't play
+					logger.log("Relay node " + node_name(node) + " linked: " + client.nickname + " @ " + sender_key);
+				}
+			}
+			return;
+		}
+		if (JamProtocol::has_header(data, bytes, JamProtocol::RELAY_TAG, JamProtocol::RELAY_HEADER_SIZE)) {
+			RelayFrame frame;
+			auto it = clients_.find(sender_key);
+			if (it != clients_.end() && it->second.relay_node != 0 && RelayFrame::decode(data, bytes, frame)) {
+				it->second.last_heartbeat = std::chrono::steady_clock::now();
+				handle_relay(it->second, frame);
 			}
 			return;
 		}
 
-		if (bytes == 5 && std::strncmp(buffer_.data(), "CLIST", 5) == 0) {
-			send_client_list(sender);
+		if (JamProtocol::has_tag(data, bytes, JamProtocol::SYNC_TAG, JamProtocol::SYNC_SIZE)) {
+			// Only registered clients get clock sync replies, so we can't be used as a reflector
+			if (auto it = clients_.find(sender_key); it != clients_.end()) {
+				it->second.last_heartbeat = std::chrono::steady_clock::now();
+				send_sync_reply(it->second, JamProtocol::read_i64(data + JamProtocol::TAG_SIZE), recv_ns);
+			}
 			return;
 		}
 
-		auto [it, inserted] = clients_.try_emplace(sender_key, sender, 0, std::string(buffer_.data(), bytes));
+		if (JamProtocol::has_tag(data, bytes, JamProtocol::FORMAT_TAG, JamProtocol::FORMAT_SIZE)) {
+			if (auto it = clients_.find(sender_key); it != clients_.end()) {
+				it->second.last_heartbeat = std::chrono::steady_clock::now();
+				it->second.ump = JamProtocol::read_u16(data + JamProtocol::TAG_SIZE) == JamProtocol::FORMAT_UMP;
+				logger.log_verbose(it->second.nickname + " receives " + (it->second.ump ? "UMP" : "MIDI 1.0 bytes"));
+			}
+			return;
+		}
+
+		Subscription subscription;
+		if (Subscription::decode(data, bytes, subscription)) {
+			if (auto it = clients_.find(sender_key); it != clients_.end()) {
+				it->second.last_heartbeat = std::chrono::steady_clock::now();
+				it->second.subscriptions.set(subscription);
+				char mask[8];
+				std::snprintf(mask, sizeof(mask), "%04x", subscription.channels);
+				logger.log_verbose("Subscription from " + it->second.nickname + ": sender " + std::to_string(subscription.sender) +
+					", channels 0x" + mask);
+			}
+			return;
+		}
+
+		if (!clients_.count(sender_key) && !is_nickname(data, bytes)) {
+			// Late traffic from a session we dropped: it has to resume or rejoin, not become a
+			// client named after a PONG or a note
+			logger.log_verbose("Dropped datagram from unknown sender " + sender_key);
+			return;
+		}
+		auto [it, inserted] = clients_.try_emplace(sender_key, sender, 0, std::string(data, bytes));
 		Client& client = it->second;
 		client.last_heartbeat = std::chrono::steady_clock::now();
 
 		if (inserted) {
-			logger.log("New client connected: " + client.nickname + " @ " + sender_key);
-
-			// Send ACK to the client
-			socket_.async_send_to( // Fixed: Replace `udp_socket_` with `socket_`
-				boost::asio::buffer("ACK", 3), client.endpoint,
-				[](const boost::system::error_code& ec, std::size_t) {
-					if (ec) logger.log_verbose("ACK send error: " + ec.message());
-				});
-
-			client.last_ping_sent = std::chrono::steady_clock::now(); // Set initial ping time
-			socket_.async_send_to(boost::asio::buffer("PING", 4), client.endpoint,
-				[](const boost::system::error_code& ec, std::size_t) {
-					if (ec) logger.log_verbose("Ping send error: " + ec.message());
-				});
-		} else if (bytes == 4 && std::strncmp(buffer_.data(), "PONG", 4) == 0) {
+			client.key = sender_key;
+			welcome(client, listener);
+		} else if (JamProtocol::has_tag(data, bytes, JamProtocol::PONG_TAG, JamProtocol::PING_SIZE)) {
+			// Timestamped PONG: the echoed send time makes the RTT immune to overlapping pings
+			int64_t sent_ns = JamProtocol::read_i64(data + JamProtocol::TAG_SIZE);
+			if (sent_ns > 0 && recv_ns >= sent_ns) {
+				client.rtt_us = (recv_ns - sent_ns) / 1000;
+				client.latency_ms = client.rtt_us / 1000;
+				metrics_.observe(ServerMetrics::CLIENT_RTT, recv_ns - sent_ns);
+			}
+		} else if (bytes == 4 && std::strncmp(data, "PONG", 4) == 0) {
 			if (client.last_ping_sent != std::chrono::steady_clock::time_point()) {
 				auto now = std::chrono::steady_clock::now();
 				client.latency_ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - client.last_ping_sent).count();
 			}
-		} else if (bytes > 0 && (static_cast<uint8_t>(buffer_[0]) & 0xF0) >= 0x80) {
-			client.channel = static_cast<uint8_t>(buffer_[0]) & 0x0F;
+		} else if (bytes > 0 && static_cast<uint8_t>(data[0]) >= 0xF8) {
+			// System realtime (clock, start/stop) is generated locally by each client from TMPO
+			logger.log_verbose("Dropped system realtime byte from " + client.nickname);
+		} else if (JamProtocol::is_sysex_fragment(data, bytes)) {
+			// Fragments arrive already paced by the sender; stamp the source and fan out
+			if (!admit(client, EgressQueue::Lane::Bulk)) return;
+			JamProtocol::write_u16(data + JamProtocol::TAG_SIZE, client.id);
+			client.last_midi_activity = std::chrono::steady_clock::now();
+			forward_midi(&client, client.id, data, bytes, EgressQueue::Lane::Bulk, EgressQueue::NO_COALESCE, local_frame(client, data, bytes));
+		} else if (bytes > 0 && (static_cast<uint8_t>(data[0]) & 0xF0) >= 0x80) {
+			int32_t coalesce_key;
+			EgressQueue::Lane lane = EgressQueue::classify(data, bytes, coalesce_key);
+			if (!admit(client, lane)) return;
+			MidiMessage::for_each(reinterpret_cast<const uint8_t*>(data), bytes,
+				[&client](const uint8_t* msg, std::size_t) {
+					if (MidiMessage::is_channel_message(msg[0])) client.channel = MidiMessage::channel(msg[0]);
+				});
+			client.last_midi_activity = std::chrono::steady_clock::now();
+			forward_midi(&client, client.id, data, bytes, lane, coalesce_key, local_frame(client, data, bytes));
+		} else if (Ump::is_packet(data, bytes)) {
+			// The same checks as raw MIDI, with word loads instead of a status-byte walk
+			uint32_t first = Ump::read_word(data + JamProtocol::TAG_SIZE);
+			if (Ump::message_type(first) == Ump::TYPE_SYSTEM && MidiMessage::is_realtime(Ump::status(first))) {
+				logger.log_verbose("Dropped system realtime message from " + client.nickname);
+				return;
+			}
+			int32_t coalesce_key;
+			EgressQueue::Lane lane = EgressQueue::classify(data, bytes, coalesce_key);
+			if (!admit(client, lane)) return;
+			Ump::for_each(data, bytes, [&client](const uint32_t* words, std::size_t) {
+				if (Ump::is_channel_voice(words[0])) client.channel = Ump::channel(words[0]);
+			});
 			client.last_midi_activity = std::chrono::steady_clock::now();
-			forward_midi(sender_key, bytes);
+			forward_midi(&client, client.id, data, bytes, lane, coalesce_key, local_frame(client, data, bytes));
 		}
 	}
 
-	void send_client_list(const udp::endpoint& sender) noexcept {
+    // What an open-room join looks like: text, not MIDI or one of the tagged messages
+    static bool is_nickname(const char* data, std::size_t bytes) noexcept {
+        return bytes > 0 && !(static_cast<uint8_t>(data[0]) & 0x80) &&
+               !JamProtocol::has_header(data, bytes, JamProtocol::PONG_TAG, JamProtocol::TAG_SIZE) &&
+               !JamProtocol::has_header(data, bytes, JamProtocol::UMP_TAG, JamProtocol::TAG_SIZE) &&
+               !JamProtocol::has_header(data, bytes, JamProtocol::FORMAT_TAG, JamProtocol::TAG_SIZE) &&
+               !JamProtocol::is_sysex_fragment(data, bytes);
+    }
+
+    // First-time setup of a newly admitted client, then the ACK that completes its handshake
+    void welcome(Client& client, std::size_t listener) noexcept {
+        client.id = next_client_id_++;
+        if (next_client_id_ == 0) next_client_id_ = 1; // 0 means "unstamped"
+        do {
+            client.session_token = Auth::random_u64();
+        } while (client.session_token == 0);
+        live_sessions_[client.session_token] = client.key;
+        client.listener = listener;
+        client.ingress_limit = TokenBucket(config_.ingress_rate, config_.ingress_burst);
+        client.egress = EgressQueue(config_.egress_max_depth, config_.egress_max_age);
+        logger.log("New client connected: " + client.nickname + " @ " + client.key);
+        metrics_.add(ServerMetrics::CLIENTS_JOINED);
+
+        acknowledge(client);
+        send_ping(client); // Initial ping
+        send_tempo(client);
+    }
+
+    // ACK, then the token that lets the client resume this session
+    void acknowledge(Client& client) noexcept {
+        enqueue(client, std::make_shared<const std::vector<char>>(std::initializer_list<char>{'A', 'C', 'K'}),
+            EgressQueue::Lane::Realtime);
+        auto session = std::make_shared<std::vector<char>>(JamProtocol::SESSION_SIZE);
+        JamProtocol::write_tag(session->data(), JamProtocol::SESSION_TAG);
+        JamProtocol::write_i64(session->data() + JamProtocol::TAG_SIZE, static_cast<int64_t>(client.session_token));
+        JamProtocol::write_u16(session->data() + JamProtocol::TAG_SIZE + 8, client.id);
+        enqueue(client, std::move(session), EgressQueue::Lane::Realtime);
+    }
+
+    // RSUM: re-attaches a session at the sender's current address, with its id and
+    // subscriptions, in one round trip, so a client whose address changed (a new NAT mapping,
+    // say) carries on at once. With a password the RSUM must be sealed with the session's
+    // keys, which proves it comes from the session's owner. In open rooms the token is the
+    // only credential, so there a live session only answers at its own address and can move
+    // once it has timed out and been parked.
+    void handle_resume(std::size_t listener, const char* data, const udp::endpoint& sender, const std::string& sender_key,
+                       std::size_t bytes) noexcept {
+        uint64_t token = static_cast<uint64_t>(JamProtocol::read_i64(data + JamProtocol::TAG_SIZE));
+        auto live = find_session(token);
+        auto parked = parked_sessions_.find(token);
+        Client* session = live != clients_.end() ? &live->second : parked != parked_sessions_.end() ? &parked->second.client : nullptr;
+        if (token == 0 || !session) {
+            logger.log_verbose("Cannot resume session for " + sender_key + ": unknown token");
+            send_gone(listener, sender, token);
+            return;
+        }
+        if (session->auth.enabled()) {
+            if (!session->auth.open(data, bytes)) {
+                logger.log_verbose("Dropped unauthenticated RSUM from " + sender_key);
+                metrics_.add(ServerMetrics::AUTH_REJECTED);
+                return;
+            }
+        } else if (live != clients_.end() && live->first != sender_key) {
+            // No reply: a genuine client keeps retrying and gets the session once it is parked
+            logger.log_verbose("Refused RSUM from " + sender_key + " for the live session of " + live->first);
+            metrics_.add(ServerMetrics::AUTH_REJECTED);
+            return;
+        }
+        if (live != clients_.end() && live->first == sender_key) {
+            // Still here at the same address: our ACK was lost, or only the client lost track of us
+            live->second.last_heartbeat = std::chrono::steady_clock::now();
+            acknowledge(live->second);
+            return;
+        }
+
+        Client client = std::move(*session);
+        if (live != clients_.end()) {
+            erase_client(live);
+        } else {
+            parked_sessions_.erase(parked);
+        }
+        if (auto stale = clients_.find(sender_key); stale != clients_.end()) {
+            // An earlier session from this address, superseded by the one coming back
+            forget_subscriptions_to(stale->second.id);
+            erase_client(stale);
+        }
+        std::string previous_key = client.key;
+        client.endpoint = sender;
+        client.key = sender_key;
+        client.listener = listener;
+        client.last_heartbeat = std::chrono::steady_clock::now();
+        client.ingress_limit = TokenBucket(config_.ingress_rate, config_.ingress_burst);
+        client.egress = EgressQueue(config_.egress_max_depth, config_.egress_max_age);
+        client.send_in_flight = false; // A send still pending went to the old address
+        Client& resumed = clients_.emplace(sender_key, std::move(client)).first->second;
+        live_sessions_[resumed.session_token] = sender_key;
+        logger.log("Client resumed: " + resumed.nickname + " (id " + std::to_string(resumed.id) + ") @ " + sender_key +
+                   (previous_key != sender_key ? " (was " + previous_key + ")" : ""));
+        metrics_.add(ServerMetrics::CLIENTS_RESUMED);
+
+        acknowledge(resumed);
+        send_ping(resumed);
+        send_tempo(resumed);
+    }
+
+    // The live client holding `token`, or clients_.end(). Requires clients_mutex_.
+    std::unordered_map<std::string, Client>::iterator find_session(uint64_t token) noexcept {
+        auto indexed = live_sessions_.find(token);
+        if (token == 0 || indexed == live_sessions_.end()) return clients_.end();
+        auto it = clients_.find(indexed->second);
+        return it != clients_.end() && it->second.session_token == token ? it : clients_.end();
+    }
+
+    // Every removal from clients_ goes through here, so live_sessions_ never points at a
+    // client that has gone. Requires clients_mutex_.
+    std::unordered_map<std::string, Client>::iterator erase_client(std::unordered_map<std::string, Client>::iterator it) noexcept {
+        auto indexed = live_sessions_.find(it->second.session_token);
+        if (indexed != live_sessions_.end() && indexed->second == it->first) live_sessions_.erase(indexed);
+        return clients_.erase(it);
+    }
+
+    // Server nonce for a JOIN: a MAC of the sender's address, its nonce and the current
+    // 30 s epoch, so a challenge can be checked later without storing anything per sender
+    uint64_t challenge_cookie(const std::string& sender_key, uint64_t client_nonce, int64_t epoch) const noexcept {
+        std::string input = sender_key;
+        char numbers[16];
+        JamProtocol::write_i64(numbers, static_cast<int64_t>(client_nonce));
+        JamProtocol::write_i64(numbers + 8, epoch);
+        input.append(numbers, sizeof(numbers));
+        return Auth::siphash(cookie_key_, input.data(), input.size());
+    }
+
+    // The server no longer holds `token`; password rooms prove it with the room key
+    void send_gone(std::size_t listener, const udp::endpoint& to, uint64_t token) noexcept {
+        auto gone = std::make_shared<std::vector<char>>(JamProtocol::GONE_TAG, JamProtocol::GONE_TAG + JamProtocol::GONE_SIZE);
+        if (password_) {
+            gone->resize(JamProtocol::GONE_SIZE + Auth::MAC_SIZE);
+            JamProtocol::write_i64(gone->data() + JamProtocol::GONE_SIZE, static_cast<int64_t>(Auth::gone_proof(room_key_, token)));
+        }
+        send_handshake(listener, to, std::move(gone));
+    }
+
+    // Handshake replies go straight out, since the sender is not a client (yet)
+    void send_handshake(std::size_t listener, const udp::endpoint& to, std::shared_ptr<const std::vector<char>> packet) noexcept {
+        listeners_[listener]->socket.async_send_to(boost::asio::buffer(*packet), to,
+            [packet](const boost::system::error_code& ec, std::size_t) {
+                if (ec) logger.log_verbose("Handshake send error: " + ec.message());
+            });
+    }
+
+    // JOIN -> CHAL -> AUTH -> ACK, for rooms with a password
+    void handle_join(std::size_t listener, const char* data, const udp::endpoint& sender, const std::string& sender_key,
+                     std::size_t bytes) noexcept {
+        int64_t epoch = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count() / 30;
+        uint64_t client_nonce = static_cast<uint64_t>(JamProtocol::read_i64(data + JamProtocol::TAG_SIZE));
+
+        if (JamProtocol::has_header(data, bytes, Auth::JOIN_TAG, Auth::JOIN_HEADER_SIZE)) {
+            auto challenge = std::make_shared<std::vector<char>>(Auth::CHALLENGE_SIZE);
+            JamProtocol::write_tag(challenge->data(), Auth::CHALLENGE_TAG);
+            JamProtocol::write_i64(challenge->data() + JamProtocol::TAG_SIZE, static_cast<int64_t>(client_nonce));
+            JamProtocol::write_i64(challenge->data() + JamProtocol::TAG_SIZE + Auth::NONCE_SIZE,
+                static_cast<int64_t>(challenge_cookie(sender_key, client_nonce, epoch)));
+            send_handshake(listener, sender, std::move(challenge));
+            return;
+        }
+
+        const char* p = data + JamProtocol::TAG_SIZE + Auth::NONCE_SIZE;
+        uint64_t server_nonce = static_cast<uint64_t>(JamProtocol::read_i64(p));
+        uint64_t proof = static_cast<uint64_t>(JamProtocol::read_i64(p + Auth::NONCE_SIZE));
+        std::string nickname(data + Auth::AUTH_HEADER_SIZE, bytes - Auth::AUTH_HEADER_SIZE);
+        // A challenge stays valid into the next epoch, so it lives between 30 and 60 s
+        bool fresh = Auth::equal(server_nonce, challenge_cookie(sender_key, client_nonce, epoch)) ||
+                     Auth::equal(server_nonce, challenge_cookie(sender_key, client_nonce, epoch - 1));
+        if (!fresh || !Auth::equal(proof, Auth::proof(room_key_, client_nonce, server_nonce, nickname))) {
+            logger.log("Rejected join from " + sender_key + (fresh ? ": wrong password" : ": stale challenge"));
+            metrics_.add(ServerMetrics::AUTH_REJECTED);
+            send_handshake(listener, sender, std::make_shared<const std::vector<char>>(Auth::DENY_TAG, Auth::DENY_TAG + 4));
+            return;
+        }
+
+        auto it = clients_.find(sender_key);
+        if (it != clients_.end() && it->second.join_nonce == client_nonce) {
+            // Our ACK was lost and the client retried its AUTH
+            acknowledge(it->second);
+            return;
+        }
+        if (it != clients_.end()) {
+            // Same address, new session (the client restarted): start it over
+            forget_subscriptions_to(it->second.id);
+            erase_client(it);
+        }
+        Client& client = clients_.try_emplace(sender_key, sender, 0, nickname).first->second;
+        client.key = sender_key;
+        client.join_nonce = client_nonce;
+        client.auth = PacketAuth(Auth::session_key(room_key_, client_nonce, server_nonce, 's'),
+                                 Auth::session_key(room_key_, client_nonce, server_nonce, 'c'));
+        welcome(client, listener);
+    }
+
+    // -upstream host:port is resolved once, at startup
+    void resolve_upstream() {
+        std::size_t colon = config_.upstream.rfind(':');
+        udp::resolver resolver(io_context_);
+        boost::system::error_code ec;
+        auto results = resolver.resolve(udp::v4(), config_.upstream.substr(0, colon), config_.upstream.substr(colon + 1), ec);
+        if (ec || results.empty()) {
+            throw std::runtime_error("Cannot resolve upstream " + config_.upstream + (ec ? ": " + ec.message() : ""));
+        }
+        upstream_endpoint_ = results.begin()->endpoint();
+        const auto address = upstream_endpoint_.address();
+        if ((address.is_loopback() || address.is_unspecified()) &&
+            std::find(config_.ports.begin(), config_.ports.end(), upstream_endpoint_.port()) != config_.ports.end()) {
+            throw std::runtime_error("Upstream " + config_.upstream + " is this server");
+        }
+        upstream_key_ = address.to_string() + ":" + std::to_string(upstream_endpoint_.port());
+    }
+
+    std::string link_nickname() const {
+        return "relay " + node_name(node_id_);
+    }
+
+    void start_link(std::chrono::steady_clock::duration delay) noexcept {
+        link_timer_.expires_after(delay);
+        link_timer_.async_wait([this](const boost::system::error_code& ec) {
+            if (ec || !is_running_ || !accepting_) return;
+            std::lock_guard<std::mutex> lock(clients_mutex_);
+            start_link(tend_link());
+        });
+    }
+
+    // Joins while the link is down; keeps it alive and the clocks mapped while it is up.
+    // Returns when to look again.
+    std::chrono::steady_clock::duration tend_link() noexcept {
+        auto it = clients_.find(upstream_key_);
+        if (it != clients_.end() && std::chrono::steady_clock::now() - it->second.last_heartbeat > config_.heartbeat_timeout) {
+            link_down("upstream went silent");
+            it = clients_.end();
+        }
+        if (it == clients_.end()) {
+            send_link_join();
+            return LINK_RETRY_INTERVAL;
+        }
+        // Doubles as our heartbeat: the upstream drops clients that stop talking
+        auto packet = std::make_shared<std::vector<char>>(JamProtocol::SYNC_SIZE);
+        JamProtocol::write_tag(packet->data(), JamProtocol::SYNC_TAG);
+        JamProtocol::write_i64(packet->data() + JamProtocol::TAG_SIZE, ClockSync::local_now_ns());
+        enqueue(it->second, std::move(packet), EgressQueue::Lane::Realtime);
+        if (upstream_clock_.is_synchronized()) return LINK_SYNC_INTERVAL;
+        return LINK_FAST_SYNC_INTERVAL;
+    }
+
+    // The upstream takes us for a player until we send LINK
+    void send_link_join() noexcept {
+        std::string nickname = link_nickname();
+        if (!password_) {
+            // The QUIT ends a session the upstream may still hold for our address from an earlier run
+            send_handshake(0, upstream_endpoint_, std::make_shared<const std::vector<char>>(std::initializer_list<char>{'Q', 'U', 'I', 'T'}));
+            send_handshake(0, upstream_endpoint_, std::make_shared<const std::vector<char>>(nickname.begin(), nickname.end()));
+            return;
+        }
+        link_nonce_ = Auth::random_u64();
+        auto join = std::make_shared<std::vector<char>>(Auth::JOIN_HEADER_SIZE);
+        JamProtocol::write_tag(join->data(), Auth::JOIN_TAG);
+        JamProtocol::write_i64(join->data() + JamProtocol::TAG_SIZE, static_cast<int64_t>(link_nonce_));
+        join->insert(join->end(), nickname.begin(), nickname.end());
+        send_handshake(0, upstream_endpoint_, std::move(join));
+    }
+
+    // Handshake replies from the upstream; the room password is shared by all its nodes
+    void join_upstream(char* data, std::size_t bytes) noexcept {
+        if (!password_) {
+            if (bytes == 3 && std::strncmp(data, "ACK", 3) == 0) link_up(PacketAuth());
+            return;
+        }
+        if (JamProtocol::has_tag(data, bytes, Auth::CHALLENGE_TAG, Auth::CHALLENGE_SIZE)) {
+            uint64_t client_nonce = static_cast<uint64_t>(JamProtocol::read_i64(data + JamProtocol::TAG_SIZE));
+            if (link_nonce_ == 0 || client_nonce != link_nonce_) return; // Answer to an earlier JOIN
+            uint64_t server_nonce = static_cast<uint64_t>(JamProtocol::read_i64(data + JamProtocol::TAG_SIZE + Auth::NONCE_SIZE));
+            std::string nickname = link_nickname();
+            link_auth_ = PacketAuth(Auth::session_key(room_key_, client_nonce, server_nonce, 'c'),
+                                    Auth::session_key(room_key_, client_nonce, server_nonce, 's'));
+            auto reply = std::make_shared<std::vector<char>>(Auth::AUTH_HEADER_SIZE);
+            char* p = reply->data();
+            JamProtocol::write_tag(p, Auth::AUTH_TAG);
+            JamProtocol::write_i64(p + JamProtocol::TAG_SIZE, static_cast<int64_t>(client_nonce));
+            JamProtocol::write_i64(p + JamProtocol::TAG_SIZE + Auth::NONCE_SIZE, static_cast<int64_t>(server_nonce));
+            JamProtocol::write_i64(p + JamProtocol::TAG_SIZE + 2 * Auth::NONCE_SIZE,
+                static_cast<int64_t>(Auth::proof(room_key_, client_nonce, server_nonce, nickname)));
+            reply->insert(reply->end(), nickname.begin(), nickname.end());
+            send_handshake(0, upstream_endpoint_, std::move(reply));
+            return;
+        }
+        if (bytes == 4 && std::strncmp(data, Auth::DENY_TAG, 4) == 0) {
+            if (!link_denied_) logger.log("Upstream " + config_.upstream + " refused our room password; retrying");
+            link_denied_ = true;
+            return;
+        }
+        // Its ACK, or anything sent after it if the ACK was lost, proves we were admitted
+        if (link_auth_.enabled() && link_auth_.open(data, bytes)) link_up(link_auth_);
+    }
+
+    void link_up(const PacketAuth& auth) noexcept {
+        Client& link = clients_.try_emplace(upstream_key_, upstream_endpoint_, 0, "upstream " + config_.upstream).first->second;
+        link.key = upstream_key_;
+        link.upstream = true;
+        link.listener = 0;
+        link.auth = auth;
+        link.egress = EgressQueue(config_.egress_max_depth, config_.egress_max_age);
+        link_nonce_ = 0;
+        link_auth_ = PacketAuth();
+        link_denied_ = false;
+        upstream_clock_.reset();
+        have_upstream_tempo_ = false;
+        logger.log("Linked to upstream " + config_.upstream + " as relay node " + node_name(node_id_));
+
+        auto hello = std::make_shared<std::vector<char>>(JamProtocol::LINK_SIZE);
+        JamProtocol::write_tag(hello->data(), JamProtocol::LINK_TAG);
+        JamProtocol::write_u32(hello->data() + JamProtocol::TAG_SIZE, node_id_);
+        enqueue(link, std::move(hello), EgressQueue::Lane::Realtime);
+        start_link(std::chrono::milliseconds(0)); // Clock sync right away
+    }
+
+    // The link timer rejoins; meanwhile transport requests are handled here
+    void link_down(const std::string& reason) noexcept {
+        auto it = clients_.find(upstream_key_);
+        if (it == clients_.end()) return;
+        erase_client(it);
+        upstream_clock_.reset();
+        logger.log("Lost the link to upstream " + config_.upstream + " (" + reason + ")");
+    }
+
+    // What the upstream sends any client (PING, SYNR, TMPO, SHUT) plus RLAY frames from the
+    // rest of the room. Before the link is up, only its handshake replies.
+    void handle_upstream(char* data, std::size_t bytes, int64_t recv_ns) noexcept {
+        auto it = clients_.find(upstream_key_);
+        if (it == clients_.end()) {
+            join_upstream(data, bytes);
+            return;
+        }
+        Client& link = it->second;
+        if (link.auth.enabled() && !link.auth.open(data, bytes)) {
+            logger.log_verbose("Dropped unauthenticated datagram from upstream " + config_.upstream);
+            metrics_.add(ServerMetrics::AUTH_REJECTED);
+            return;
+        }
+        link.last_heartbeat = std::chrono::steady_clock::now();
+        TempoState tempo;
+        RelayFrame frame;
+        if (JamProtocol::has_tag(data, bytes, JamProtocol::PING_TAG, JamProtocol::PING_SIZE)) {
+            auto pong = std::make_shared<std::vector<char>>(data, data + bytes);
+            JamProtocol::write_tag(pong->data(), JamProtocol::PONG_TAG);
+            enqueue(link, std::move(pong), EgressQueue::Lane::Realtime);
+        } else if (JamProtocol::has_tag(data, bytes, JamProtocol::SYNC_REPLY_TAG, JamProtocol::SYNC_REPLY_SIZE)) {
+            const char* p = data + JamProtocol::TAG_SIZE;
+            upstream_clock_.add_sample(JamProtocol::read_i64(p), JamProtocol::read_i64(p + 8), JamProtocol::read_i64(p + 16), recv_ns);
+            follow_upstream_tempo();
+        } else if (TempoState::decode(data, bytes, tempo)) {
+            upstream_tempo_ = tempo;
+            have_upstream_tempo_ = true;
+            follow_upstream_tempo();
+        } else if (RelayFrame::decode(data, bytes, frame)) {
+            handle_relay(link, frame);
+        } else if (JamProtocol::has_tag(data, bytes, JamProtocol::SHUTDOWN_TAG, JamProtocol::SHUTDOWN_SIZE)) {
+            link_down("upstream is shutting down");
+        }
+    }
+
+    // The root node owns the room tempo. Its anchors are on its session clock, so we re-anchor
+    // them on ours before passing them on, once the clocks are mapped. Changes are recognised
+    // by content, not version, since every node numbers its own: on a misconfigured cycle of
+    // links a version bump would otherwise chase itself around forever.
+    void follow_upstream_tempo() noexcept {
+        if (!have_upstream_tempo_ || !upstream_clock_.is_synchronized()) return;
+        const TempoState& upstream = upstream_tempo_;
+        TempoState followed = upstream;
+        followed.anchor_ns = upstream_clock_.to_local(upstream.anchor_ns);
+        bool same = upstream.run_id == adopted_tempo_.run_id && upstream.anchor_tick == adopted_tempo_.anchor_tick &&
+                    upstream.bpm_milli == adopted_tempo_.bpm_milli && upstream.running == adopted_tempo_.running &&
+                    upstream.anchor_ns == adopted_tempo_.anchor_ns;
+        if (same && std::llabs(followed.anchor_ns - tempo_.anchor_ns) <= TEMPO_RESYNC_NS) return;
+        adopted_tempo_ = upstream;
+        followed.version = tempo_.version + 1; // Our clients only ever see our own sequence
+        tempo_ = followed;
+        logger.log_verbose("Following upstream tempo: " + std::string(tempo_.running ? "running" : "stopped") + " at " +
+                           std::to_string(tempo_.bpm()) + " BPM");
+        broadcast_tempo();
+    }
+
+	// One datagram, so it carries only what the UI shows and what /subscriptions needs; the
+	// per-peer egress counters are on /metrics
+	void send_client_list(Client& requester) noexcept {
 		json client_list;
 		json clients_array = json::array();
 		for (const auto& [id, client] : clients_) {
@@ -218,130 +1335,572 @@ private:
 							  std::chrono::steady_clock::now() - client.last_midi_activity < MIDI_ACTIVITY_TIMEOUT);
 			client_info["active"] = is_active;
 			client_info["latency_ms"] = client.latency_ms; // New: Include latency
+			client_info["rtt_us"] = client.rtt_us;
+			client_info["id"] = client.id;
+			if (client.relay_node != 0 || client.upstream) client_info["relay"] = true;
+			clients_array.push_back(client_info);
+		}
+		// Players on other relay nodes, as seen through their relayed MIDI
+		auto now = std::chrono::steady_clock::now();
+		for (const auto& [key, remote] : remote_senders_) {
+			json client_info;
+			client_info["nickname"] = node_name(remote.node) + "/" + std::to_string(remote.origin_id);
+			client_info["channel"] = remote.channel;
+			client_info["active"] = now - remote.last_seen < MIDI_ACTIVITY_TIMEOUT;
+			client_info["id"] = remote.id;
+			client_info["remote"] = true;
 			clients_array.push_back(client_info);
 		}
 		client_list["clients"] = clients_array;
 		std::string json_str = client_list.dump(); // Serialize to string
-		log_data("Sending", sender, json_str.data(), json_str.size());
-		socket_.async_send_to(
-			boost::asio::buffer(json_str), sender,
-			[](const boost::system::error_code& ec, std::size_t) {
-				if (ec) logger.log_verbose("Client list send error: " + ec.message());
-			});
+		log_data("Sending", requester.endpoint, json_str.data(), json_str.size());
+		enqueue(requester, std::make_shared<const std::vector<char>>(json_str.begin(), json_str.end()),
+			EgressQueue::Lane::Bulk);
 	}
 
-    void forward_midi(const std::string& sender_key, std::size_t bytes) noexcept {
-        auto buffer = std::make_shared<std::vector<char>>(buffer_.begin(), buffer_.begin() + bytes);
-        for (const auto& [id, client] : clients_) {
-            if (id != sender_key) {
+    // Per-sender token bucket; the first drop after a quiet period is logged
+    bool admit(Client& client, EgressQueue::Lane lane) noexcept {
+        auto now = std::chrono::steady_clock::now();
+        if (client.ingress_limit.consume(now, lane == EgressQueue::Lane::Realtime)) return true;
+        ++client.throttled_packets;
+        metrics_.add(ServerMetrics::THROTTLED_PACKETS);
+        if (now - client.last_throttle_log > config_.heartbeat_interval) {
+            client.last_throttle_log = now;
+            logger.log("Rate limiting " + client.nickname + " (" + std::to_string(client.throttled_packets) + " packets dropped so far)");
+        }
+        return false;
+    }
+
+    // Fans a packet from `sender_id` out to everyone but `from`. Receivers without subscriptions
+    // share one buffer; the rest get a copy filtered and remapped for them, or nothing at all.
+    // Receivers of the other MIDI format share one translated buffer, made for the first of them.
+    // Linked relay nodes get `frame` instead, unless it has no hops left.
+    void forward_midi(const Client* from, uint16_t sender_id, const char* data, std::size_t bytes, EgressQueue::Lane lane,
+                      int32_t coalesce_key, const RelayFrame& frame) noexcept {
+        auto buffer = std::make_shared<const std::vector<char>>(data, data + bytes);
+        std::shared_ptr<const std::vector<char>> relayed; // Encoded for the first relay node that needs it
+        auto now = std::chrono::steady_clock::now();
+        bool sysex = JamProtocol::is_sysex_fragment(data, bytes);
+        bool ump = !sysex && Ump::is_packet(data, bytes);
+        std::shared_ptr<const std::vector<char>> translated; // Empty if nothing survives translation
+        EgressQueue::Lane translated_lane = lane;
+        int32_t translated_key = EgressQueue::NO_COALESCE;
+        metrics_.add(ServerMetrics::FORWARDED_PACKETS);
+        for (auto& [id, client] : clients_) {
+            if (&client == from) continue;
+            if (client.relay_node != 0 || client.upstream) {
+                if (frame.hops == 0) continue;
+                if (!relayed) {
+                    auto encoded = std::make_shared<std::vector<char>>();
+                    frame.encode(*encoded);
+                    relayed = std::move(encoded);
+                }
+                // Frames from different players must not replace each other in the queue
+                enqueue(client, relayed, lane, EgressQueue::NO_COALESCE, now);
+                metrics_.add(ServerMetrics::RELAY_SENT);
+                continue;
+            }
+            std::shared_ptr<const std::vector<char>> own = buffer; // In the format this receiver reads
+            EgressQueue::Lane own_lane = lane;
+            int32_t own_key = coalesce_key;
+            if (!sysex && client.ump != ump) {
+                if (!translated) {
+                    auto copy = std::make_shared<std::vector<char>>();
+                    std::size_t dropped = 0;
+                    if (Ump::translate(data, bytes, *copy, dropped)) {
+                        translated_lane = EgressQueue::classify(copy->data(), copy->size(), translated_key);
+                    } else {
+                        copy->clear();
+                    }
+                    translated = std::move(copy);
+                    metrics_.add(ServerMetrics::UMP_TRANSLATED);
+                    if (dropped) {
+                        logger.log_verbose("UMP translation dropped " + std::to_string(dropped) + " message(s) past " +
+                                           std::to_string(Ump::MAX_WORDS) + " words");
+                        metrics_.add(ServerMetrics::UMP_DROPPED, dropped);
+                    }
+                }
+                if (translated->empty()) continue;
+                own = translated;
+                own_lane = translated_lane;
+                own_key = translated_key;
+            }
+            if (client.subscriptions.passes_all()) {
                 // Log the outgoing data
-                log_data("Sending", client.endpoint, buffer->data(), buffer->size());
+                log_data("Sending", client.endpoint, own->data(), own->size());
+                enqueue(client, own, own_lane, own_key, now);
+                metrics_.add(ServerMetrics::FANOUT_PACKETS);
+                continue;
+            }
+            const Subscription& subscription = client.subscriptions.for_sender(sender_id);
+            std::shared_ptr<const std::vector<char>> filtered = own;
+            EgressQueue::Lane filtered_lane = own_lane;
+            int32_t filtered_key = own_key;
+            if (subscription.muted()) {
+                filtered = nullptr;
+            } else if (!sysex && !subscription.passes_all()) {
+                // Filtering can leave a single message, which may then be coalesced under its new channel
+                auto copy = std::make_shared<std::vector<char>>();
+                if (subscription.apply(own->data(), own->size(), *copy)) {
+                    filtered_lane = EgressQueue::classify(copy->data(), copy->size(), filtered_key);
+                    filtered = std::move(copy);
+                } else {
+                    filtered = nullptr;
+                }
+            }
+            if (!filtered) {
+                ++client.filtered_packets;
+                metrics_.add(ServerMetrics::FILTERED_PACKETS);
+                continue;
+            }
+            log_data("Sending", client.endpoint, filtered->data(), filtered->size());
+            enqueue(client, std::move(filtered), filtered_lane, filtered_key, now);
+            metrics_.add(ServerMetrics::FANOUT_PACKETS);
+        }
+        if (static_cast<uint8_t>(data[0]) & 0x80) MIDIJAM_TRACE(Trace::SERVER_FANOUT, data, bytes);
+    }
+
+    // A local player's packet as it leaves this node for the rest of the federation
+    RelayFrame local_frame(const Client& sender, const char* data, std::size_t bytes) noexcept {
+        RelayFrame frame;
+        frame.origin_node = node_id_;
+        frame.sequence = ++relay_sequence_;
+        frame.origin_client = sender.id;
+        frame.hops = RelayFrame::MAX_HOPS;
+        frame.payload = data;
+        frame.payload_size = bytes;
+        return frame;
+    }
+
+    void relay_to(Client& client, const RelayFrame& frame, EgressQueue::Lane lane) noexcept {
+        auto encoded = std::make_shared<std::vector<char>>();
+        frame.encode(*encoded);
+        enqueue(client, std::move(encoded), lane);
+        metrics_.add(ServerMetrics::RELAY_SENT);
+    }
+
+    static uint64_t remote_key(uint32_t node, uint16_t origin_id) noexcept {
+        return (static_cast<uint64_t>(node) << 16) | origin_id;
+    }
+
+    static std::string node_name(uint32_t node) {
+        char name[9];
+        std::snprintf(name, sizeof(name), "%08x", node);
+        return name;
+    }
+
+    // A player on another node, under an id from our own sequence: ids are only unique per node,
+    // and receivers tell senders apart (subscriptions, SysEx reassembly) by id
+    RemoteSender& remote_sender(uint32_t node, uint16_t origin_id) noexcept {
+        auto [it, inserted] = remote_senders_.try_emplace(remote_key(node, origin_id));
+        RemoteSender& remote = it->second;
+        if (inserted) {
+            remote.id = next_client_id_++;
+            if (next_client_id_ == 0) next_client_id_ = 1;
+            remote.node = node;
+            remote.origin_id = origin_id;
+            logger.log_verbose("Relayed sender " + node_name(node) + "/" + std::to_string(origin_id) + " is id " + std::to_string(remote.id));
+        }
+        return remote;
+    }
+
+    // An RLAY frame from a linked node (either direction): drop repeats, play it here, pass it on
+    void handle_relay(Client& from, const RelayFrame& frame) noexcept {
+        auto now = std::chrono::steady_clock::now();
+        if (frame.origin_node == node_id_ || !relay_filter_.accept(frame.origin_node, frame.sequence, now)) {
+            // Our own frame came back, or a second copy arrived: the links form a cycle
+            metrics_.add(ServerMetrics::RELAY_DUPLICATES);
+            return;
+        }
+        const char* data = frame.payload;
+        std::size_t bytes = frame.payload_size;
+        if (JamProtocol::has_tag(data, bytes, JamProtocol::TRANSPORT_TAG, JamProtocol::TRANSPORT_SIZE)) {
+            // Transport requests travel towards the root only, which applies them
+            if (from.upstream) return;
+            metrics_.add(ServerMetrics::RELAY_RECEIVED);
+            if (auto link = clients_.find(upstream_key_); link != clients_.end()) {
+                if (frame.hops > 1) {
+                    RelayFrame onward = frame;
+                    --onward.hops;
+                    relay_to(link->second, onward, EgressQueue::Lane::Realtime);
+                }
+            } else {
+                const char* p = data + JamProtocol::TAG_SIZE;
+                apply_transport(from, JamProtocol::read_i64(p), JamProtocol::read_i64(p + 8), ClockSync::local_now_ns());
+            }
+            return;
+        }
+        EgressQueue::Lane lane = EgressQueue::Lane::Bulk;
+        int32_t coalesce_key = EgressQueue::NO_COALESCE;
+        std::array<char, JamProtocol::SYSEX_HEADER_SIZE + JamProtocol::SYSEX_FRAGMENT_PAYLOAD> restamped;
+        RemoteSender& remote = remote_sender(frame.origin_node, frame.origin_client);
+        remote.last_seen = now;
+        if (JamProtocol::is_sysex_fragment(data, bytes)) {
+            // Stamped with the origin's id for the next node; ours is the alias
+            std::memcpy(restamped.data(), data, bytes);
+            JamProtocol::write_u16(restamped.data() + JamProtocol::TAG_SIZE, remote.id);
+            data = restamped.data();
+        } else if (static_cast<uint8_t>(data[0]) >= 0x80 && static_cast<uint8_t>(data[0]) < 0xF8) {
+            lane = EgressQueue::classify(data, bytes, coalesce_key);
+            MidiMessage::for_each(reinterpret_cast<const uint8_t*>(data), bytes,
+                [&remote](const uint8_t* msg, std::size_t) {
+                    if (MidiMessage::is_channel_message(msg[0])) remote.channel = MidiMessage::channel(msg[0]);
+                });
+        } else if (Ump::is_packet(data, bytes)) {
+            // Relayed in the format the player sent; each node translates for its own receivers
+            lane = EgressQueue::classify(data, bytes, coalesce_key);
+            Ump::for_each(data, bytes, [&remote](const uint32_t* words, std::size_t) {
+                if (Ump::is_channel_voice(words[0])) remote.channel = Ump::channel(words[0]);
+            });
+        } else {
+            logger.log_verbose("Dropped relayed packet that is not MIDI from " + from.nickname);
+            return;
+        }
+        metrics_.add(ServerMetrics::RELAY_RECEIVED);
+        RelayFrame onward = frame;
+        --onward.hops;
+        forward_midi(&from, remote.id, data, bytes, lane, coalesce_key, onward);
+    }
+
+    // Drops every receiver's entry for a sender that left. Requires clients_mutex_.
+    void forget_subscriptions_to(uint16_t sender) noexcept {
+        for (auto& [id, client] : clients_) client.subscriptions.forget_sender(sender);
+        for (auto& [token, session] : parked_sessions_) session.client.subscriptions.forget_sender(sender);
+    }
+
+    // Every outgoing packet goes through the peer's bounded egress queue. Requires clients_mutex_.
+    void enqueue(Client& client, std::shared_ptr<const std::vector<char>> data, EgressQueue::Lane lane,
+                 int32_t coalesce_key = EgressQueue::NO_COALESCE,
+                 std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now()) noexcept {
+        uint64_t overflow_before = client.egress.overflow_drops();
+        if (client.egress.push(EgressQueue::Packet{std::move(data), now, coalesce_key}, lane)) {
+            ++client.coalesced_packets;
+            metrics_.add(ServerMetrics::COALESCED_PACKETS);
+        }
+        if (client.egress.overflow_drops() != overflow_before) metrics_.add(ServerMetrics::OVERFLOW_DROPS);
+        pump_egress(client);
+    }
+
+    // One send in flight per peer; the rest waits in the priority lanes. Requires clients_mutex_.
+    void pump_egress(Client& client) noexcept {
+        EgressQueue::Packet packet;
+        if (client.send_in_flight) return;
+        auto now = std::chrono::steady_clock::now();
+        if (uring_) {
+            pump_egress_uring(client, now);
+            return;
+        }
+        if (!pop_egress(client, packet, now)) return;
+        client.send_in_flight = true;
+        // Packets are shared between receivers, so each gets its MAC trailer as a second buffer
+        std::shared_ptr<std::array<char, PacketAuth::TRAILER_SIZE>> trailer;
+        if (client.auth.enabled()) {
+            trailer = std::make_shared<std::array<char, PacketAuth::TRAILER_SIZE>>();
+            client.auth.seal(packet.data->data(), packet.data->size(), trailer->data());
+        }
+        std::array<boost::asio::const_buffer, 2> buffers{
+            boost::asio::buffer(*packet.data),
+            trailer ? boost::asio::buffer(*trailer) : boost::asio::const_buffer()};
+        listeners_[client.listener]->socket.async_send_to(
+            buffers, client.endpoint,
+            [this, key = client.key, data = packet.data, trailer](const boost::system::error_code& ec, std::size_t sent) {
+                count_sent(*data, ec, sent);
+                send_finished(key);
+            });
+    }
+
+    // With io_uring the "one send" is every packet the lanes release now, submitted together
+    // and in order, with no syscall of its own. Requires clients_mutex_.
+    void pump_egress_uring(Client& client, std::chrono::steady_clock::time_point now) noexcept {
+        struct Batch {
+            std::vector<std::shared_ptr<const std::vector<char>>> packets;
+            std::array<std::array<char, PacketAuth::TRAILER_SIZE>, UringIo::MAX_SEND_BATCH> trailers;
+            std::size_t remaining = 0;
+        };
+        auto batch = std::make_shared<Batch>();
+        std::array<UringIo::Datagram, UringIo::MAX_SEND_BATCH> datagrams;
+        EgressQueue::Packet packet;
+        while (batch->packets.size() < UringIo::MAX_SEND_BATCH && pop_egress(client, packet, now)) {
+            std::size_t i = batch->packets.size();
+            datagrams[i] = UringIo::Datagram{packet.data->data(), packet.data->size(), nullptr, 0};
+            if (client.auth.enabled()) {
+                client.auth.seal(packet.data->data(), packet.data->size(), batch->trailers[i].data());
+                datagrams[i].extra = batch->trailers[i].data();
+                datagrams[i].extra_bytes = PacketAuth::TRAILER_SIZE;
+            }
+            batch->packets.push_back(std::move(packet.data));
+        }
+        if (batch->packets.empty()) return;
+        batch->remaining = batch->packets.size();
+        client.send_in_flight = true;
+        bool queued = uring_->send(client.listener, client.endpoint.data(), client.endpoint.size(), datagrams.data(),
+            batch->packets.size(), [this, key = client.key, batch](std::size_t i, int result) {
+                boost::system::error_code ec;
+                if (result < 0) ec.assign(-result, boost::system::system_category());
+                count_sent(*batch->packets[i], ec, result < 0 ? 0 : static_cast<std::size_t>(result));
+                if (--batch->remaining == 0) send_finished(key);
+            });
+        if (!queued) {
+            // Ring or send slots full: these are dropped, the next enqueue pumps again
+            metrics_.add(ServerMetrics::SEND_ERRORS, batch->packets.size());
+            client.send_in_flight = false;
+        }
+    }
+
+    bool pop_egress(Client& client, EgressQueue::Packet& packet, std::chrono::steady_clock::time_point now) noexcept {
+        uint64_t stale_before = client.egress.stale_drops();
+        bool popped = client.egress.pop(packet, now);
+        if (uint64_t stale = client.egress.stale_drops() - stale_before) metrics_.add(ServerMetrics::STALE_DROPS, stale);
+        if (popped) {
+            metrics_.observe(ServerMetrics::EGRESS_WAIT, std::chrono::duration_cast<std::chrono::nanoseconds>(now - packet.enqueued).count());
+        }
+        return popped;
+    }
+
+    void count_sent(const std::vector<char>& data, const boost::system::error_code& ec, std::size_t sent) noexcept {
+        if (ec) {
+            logger.log_verbose("Send error: " + ec.message());
+            metrics_.add(ServerMetrics::SEND_ERRORS);
+        } else {
+            metrics_.add(ServerMetrics::SENT_PACKETS);
+            metrics_.add(ServerMetrics::SENT_BYTES, sent);
+            if (static_cast<uint8_t>(data[0]) & 0x80) MIDIJAM_TRACE(Trace::SERVER_SEND, data.data(), data.size());
+        }
+    }
+
+    // The client's send is done; start its next one
+    void send_finished(const std::string& key) noexcept {
+        std::lock_guard<std::mutex> lock(clients_mutex_);
+        if (auto it = clients_.find(key); it != clients_.end()) {
+            it->second.send_in_flight = false;
+            pump_egress(it->second);
+        }
+    }
+
+    void send_ping(Client& client) noexcept {
+        client.last_ping_sent = std::chrono::steady_clock::now(); // Record ping time
+        auto packet = std::make_shared<std::vector<char>>(JamProtocol::PING_SIZE);
+        JamProtocol::write_tag(packet->data(), JamProtocol::PING_TAG);
+        JamProtocol::write_i64(packet->data() + JamProtocol::TAG_SIZE, ClockSync::local_now_ns());
+
+        // Log the outgoing PING
+        log_data("Sending", client.endpoint, packet->data(), packet->size());
+
+        enqueue(client, std::move(packet), EgressQueue::Lane::Realtime);
+    }
+
+    // The server's steady clock is the session clock; clients estimate their offset to it
+    void send_sync_reply(Client& client, int64_t t0, int64_t t1) noexcept {
+        auto packet = std::make_shared<std::vector<char>>(JamProtocol::SYNC_REPLY_SIZE);
+        JamProtocol::write_tag(packet->data(), JamProtocol::SYNC_REPLY_TAG);
+        JamProtocol::write_i64(packet->data() + JamProtocol::TAG_SIZE, t0);
+        JamProtocol::write_i64(packet->data() + JamProtocol::TAG_SIZE + 8, t1);
+        JamProtocol::write_i64(packet->data() + JamProtocol::TAG_SIZE + 16, ClockSync::local_now_ns());
+        enqueue(client, std::move(packet), EgressQueue::Lane::Realtime);
+    }
+
+    std::shared_ptr<const std::vector<char>> encode_tempo() const {
+        auto packet = std::make_shared<std::vector<char>>(JamProtocol::TEMPO_SIZE);
+        tempo_.encode(packet->data());
+        return packet;
+    }
 
-                socket_.async_send_to(
-                    boost::asio::buffer(*buffer), client.endpoint,
-                    [](const boost::system::error_code& ec, std::size_t) {
-                        if (ec) logger.log_verbose("Send error: " + ec.message());
-                    });
+    void send_tempo(Client& client) noexcept {
+        enqueue(client, encode_tempo(), EgressQueue::Lane::Realtime);
+    }
+
+    void broadcast_tempo() noexcept {
+        auto packet = encode_tempo();
+        for (auto& [id, client] : clients_) {
+            if (!client.upstream) enqueue(client, packet, EgressQueue::Lane::Realtime);
+        }
+    }
+
+    // Start/Continue are scheduled far enough ahead that the slowest client hears
+    // about it before the downbeat, so everyone starts on the same session time.
+    int64_t start_lead_ns() const noexcept {
+        int64_t max_rtt_ns = 0;
+        for (const auto& [id, client] : clients_) {
+            max_rtt_ns = std::max(max_rtt_ns, client.rtt_us * 1000);
+        }
+        return std::clamp(max_rtt_ns, MIN_START_LEAD_NS, MAX_START_LEAD_NS);
+    }
+
+    void apply_transport(Client& client, int64_t command, int64_t value, int64_t now_ns) noexcept {
+        double position = tempo_.position_at(now_ns);
+        switch (command) {
+            case TempoState::CMD_START:
+                tempo_.anchor_tick = 0;
+                tempo_.anchor_ns = now_ns + start_lead_ns();
+                tempo_.running = true;
+                ++tempo_.run_id;
+                break;
+            case TempoState::CMD_CONTINUE:
+                if (tempo_.running) return;
+                tempo_.anchor_ns = now_ns + start_lead_ns();
+                tempo_.running = true;
+                ++tempo_.run_id;
+                break;
+            case TempoState::CMD_STOP:
+                if (!tempo_.running) return;
+                // Park on a 16th-note boundary so Continue can be expressed as an SPP
+                tempo_.anchor_tick = static_cast<int64_t>(position) / TempoState::CLOCKS_PER_SPP_UNIT * TempoState::CLOCKS_PER_SPP_UNIT;
+                tempo_.anchor_ns = now_ns;
+                tempo_.running = false;
+                break;
+            case TempoState::CMD_SONG_POSITION:
+                if (tempo_.running || value < 0 || value > 0x3FFF) return;
+                tempo_.anchor_tick = value * TempoState::CLOCKS_PER_SPP_UNIT;
+                break;
+            case TempoState::CMD_TEMPO: {
+                if (value < TempoState::MIN_BPM_MILLI || value > TempoState::MAX_BPM_MILLI) return;
+                if (tempo_.running && now_ns > tempo_.anchor_ns) {
+                    // Re-anchor on the next tick so the new tempo takes over without a phase jump
+                    int64_t next_tick = static_cast<int64_t>(position) + 1;
+                    tempo_.anchor_ns = tempo_.time_of_tick(next_tick);
+                    tempo_.anchor_tick = next_tick;
+                }
+                tempo_.bpm_milli = value;
+                break;
             }
+            default:
+                logger.log_verbose("Unknown transport command from " + client.nickname);
+                return;
         }
+        ++tempo_.version;
+        logger.log("Transport " + std::to_string(command) + " from " + client.nickname + ": " +
+                   (tempo_.running ? "running" : "stopped") + " at " + std::to_string(tempo_.bpm()) + " BPM");
+        broadcast_tempo();
+    }
+
+    // Counters come from the lock-free shards; room state gauges are read under the lock
+    std::string render_metrics() {
+        std::string out;
+        metrics_.render(out);
+        std::lock_guard<std::mutex> lock(clients_mutex_);
+        std::size_t queued = 0;
+        for (const auto& [id, client] : clients_) queued += client.egress.size();
+        ServerMetrics::render_gauge(out, "midijam_clients", "Connected clients", static_cast<double>(clients_.size()));
+        ServerMetrics::render_gauge(out, "midijam_io_uring", "1 while datagrams go through io_uring", uring_ ? 1.0 : 0.0);
+        ServerMetrics::render_gauge(out, "midijam_egress_queued_packets", "Packets waiting in egress queues", static_cast<double>(queued));
+        ServerMetrics::render_gauge(out, "midijam_tempo_bpm", "Room tempo", tempo_.bpm());
+        ServerMetrics::render_gauge(out, "midijam_transport_running", "1 while the room transport is running", tempo_.running ? 1.0 : 0.0);
+        if (!config_.upstream.empty()) {
+            ServerMetrics::render_gauge(out, "midijam_upstream_linked", "1 while the link to the upstream relay node is up",
+                                        clients_.count(upstream_key_) ? 1.0 : 0.0);
+        }
+        ServerMetrics::render_gauge(out, "midijam_parked_sessions", "Timed-out sessions that can still be resumed",
+                                    static_cast<double>(parked_sessions_.size()));
+        ServerMetrics::render_gauge(out, "midijam_remote_senders", "Players on other relay nodes heard recently",
+                                    static_cast<double>(remote_senders_.size()));
+        out += "# HELP midijam_client_last_rtt_seconds Latest round trip per client\n"
+               "# TYPE midijam_client_last_rtt_seconds gauge\n";
+        for (const auto& [id, client] : clients_) {
+            if (client.rtt_us < 0) continue;
+            out += "midijam_client_last_rtt_seconds{client=\"" + ServerMetrics::escape_label(client.nickname) +
+                   "\",id=\"" + std::to_string(client.id) + "\"} " + std::to_string(client.rtt_us / 1e6) + "\n";
+        }
+        // Per-client egress and filtering counters
+        auto per_client = [&](const char* name, const char* type, const char* help, auto value) {
+            out += std::string("# HELP ") + name + " " + help + "\n# TYPE " + name + " " + type + "\n";
+            for (const auto& [id, client] : clients_) {
+                out += std::string(name) + "{client=\"" + ServerMetrics::escape_label(client.nickname) + "\",id=\"" +
+                       std::to_string(client.id) + "\"} " + std::to_string(value(client)) + "\n";
+            }
+        };
+        per_client("midijam_client_throttled_packets_total", "counter", "Packets from this client dropped by the ingress limit",
+                   [](const Client& c) { return c.throttled_packets; });
+        per_client("midijam_client_coalesced_packets_total", "counter", "Controller updates merged before reaching this client",
+                   [](const Client& c) { return c.coalesced_packets; });
+        per_client("midijam_client_filtered_packets_total", "counter", "Packets this client's subscriptions removed entirely",
+                   [](const Client& c) { return c.filtered_packets; });
+        per_client("midijam_client_stale_drops_total", "counter", "Packets to this client dropped for age",
+                   [](const Client& c) { return c.egress.stale_drops(); });
+        per_client("midijam_client_overflow_drops_total", "counter", "Packets to this client dropped by a full queue",
+                   [](const Client& c) { return c.egress.overflow_drops(); });
+        per_client("midijam_client_queued_packets", "gauge", "Packets waiting in this client's egress queue",
+                   [](const Client& c) { return c.egress.size(); });
+        per_client("midijam_client_queue_peak_packets", "gauge", "Deepest this client's egress queue has been",
+                   [](const Client& c) { return c.egress.peak_size(); });
+        return out;
     }
 
     void start_cleanup() noexcept {
-        cleanup_timer_.expires_after(HEARTBEAT_TIMEOUT);
+        cleanup_timer_.expires_after(config_.heartbeat_timeout);
         cleanup_timer_.async_wait([this](const boost::system::error_code& ec) {
             if (!ec && is_running_) {  // Check is_running_ before executing
+                std::lock_guard<std::mutex> lock(clients_mutex_);
                 auto now = std::chrono::steady_clock::now();
                 for (auto it = clients_.begin(); it != clients_.end();) {
-                    if (now - it->second.last_heartbeat > HEARTBEAT_TIMEOUT) {
+                    // The upstream link is watched by its own timer
+                    if (!it->second.upstream && now - it->second.last_heartbeat > config_.heartbeat_timeout) {
                         logger.log("Client timed out: " + it->second.nickname + " @ " + it->first);
-                        it = clients_.erase(it);
+                        metrics_.add(ServerMetrics::CLIENTS_TIMED_OUT);
+                        if (it->second.session_token != 0) {
+                            // Others keep their subscriptions to it until it is past resuming
+                            uint64_t token = it->second.session_token;
+                            parked_sessions_[token] = ParkedSession{std::move(it->second), now};
+                        } else {
+                            forget_subscriptions_to(it->second.id);
+                        }
+                        it = erase_client(it);
+                    } else {
+                        ++it;
+                    }
+                }
+                for (auto it = parked_sessions_.begin(); it != parked_sessions_.end();) {
+                    if (now - it->second.parked > RESUME_WINDOW) {
+                        logger.log_verbose("Session of " + it->second.client.nickname + " expired");
+                        uint16_t id = it->second.client.id;
+                        it = parked_sessions_.erase(it);
+                        forget_subscriptions_to(id);
+                    } else {
+                        ++it;
+                    }
+                }
+                for (auto it = remote_senders_.begin(); it != remote_senders_.end();) {
+                    if (now - it->second.last_seen > REMOTE_SENDER_TIMEOUT) {
+                        forget_subscriptions_to(it->second.id);
+                        it = remote_senders_.erase(it);
                     } else {
                         ++it;
                     }
                 }
+                relay_filter_.expire(now, REMOTE_SENDER_TIMEOUT);
                 start_cleanup();
             }
         });
     }
 
     void start_ping() noexcept {
-        ping_timer_.expires_after(HEARTBEAT_INTERVAL);
+        ping_timer_.expires_after(config_.heartbeat_interval);
         ping_timer_.async_wait([this](const boost::system::error_code& ec) {
             if (!ec && is_running_) { // Check is_running_ before executing
+                std::lock_guard<std::mutex> lock(clients_mutex_);
+                auto tempo = encode_tempo();
                 for (auto& [id, client] : clients_) {
-                    client.last_ping_sent = std::chrono::steady_clock::now(); // Record ping time
-
-                    // Log the outgoing PING
-                    log_data("Sending", client.endpoint, "PING", 4);
-
-                    socket_.async_send_to(boost::asio::buffer("PING", 4), client.endpoint,
-                        [](const boost::system::error_code& ec, std::size_t) {
-                            if (ec) logger.log_verbose("Ping send error: " + ec.message());
-                        });
+                    if (client.upstream) continue; // It pings us
+                    send_ping(client);
+                    enqueue(client, tempo, EgressQueue::Lane::Realtime); // Periodic resend covers lost TMPO updates
                 }
                 start_ping();
             }
         });
     }
 
-    friend int main(int argc, char* argv[]); // Allow main to access is_running_
 };
 
-MidiJamServer* global_server = nullptr; // Global pointer to the server instance
-
-void signal_handler(int signal) {
-    if (signal == SIGINT) {
-        logger.log("SIGINT received! Shutting down server...");
-        if (global_server) {
-            global_server->stop(); // Stop the server gracefully
-        }
-        std::exit(0);
-    }
-}
-
 int main(int argc, char* argv[]) {
     try {
-        short port = 5000; // Default port
-        bool debug_mode = false;
-
-        // Check for debug argument
-        if (argc > 1) {
-            for (int i = 1; i < argc; ++i) {
-                if (std::string(argv[i]) == "-debug") {
-                    debug_mode = true;
-                    break;
-                }
-            }
+        ServerConfig config = ServerConfig::from_command_line(argc, argv);
+        if (config.show_help) {
+            std::cout << ServerConfig::usage();
+            return 0;
         }
+        logger.set_debug_mode(config.debug);
 
-        logger.set_debug_mode(debug_mode);
-
-
-        // Prompt the user for the port number
-        logger.log("Enter the UDP port number for the server (default: 5000): ");
-        std::string input;
-        std::getline(std::cin, input);
-
-        if (!input.empty()) {
-            try {
-                port = static_cast<short>(std::stoi(input));
-                if (port <= 0 || port > 65535) {
-                    logger.log("Invalid port number. Using default port 5000.");
-                    port = 5000; // Fallback to default
-                }
-            } catch (const std::exception&) {
-                logger.log("Invalid input. Using default port 5000.");
-                port = 5000; // Fallback to default
-            }
-        }
-
-        MidiJamServer server(port);
-        global_server = &server; // Assign the server instance to the global pointer
-
-        // Register the signal handler
-        std::signal(SIGINT, signal_handler);
-
-        server.run();
+        MidiJamServer server(config, std::vector<std::string>(argv, argv + argc));
+        server.run(); // Until a signal stops it
 
     } catch (const std::exception& e) {
         logger.log("Fatal error: " + std::string(e.what()));
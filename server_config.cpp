@@ -0,0 +1,284 @@
+#include "server_config.h"
+#include "third_party/nlohmann/json.hpp"
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <algorithm>
+
+using json = nlohmann::json;
+
+static std::vector<std::string> split_list(const std::string& value) {
+    std::vector<std::string> items;
+    std::stringstream stream(value);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+static long long parse_integer(const std::string& flag, const std::string& value) {
+    try {
+        std::size_t used = 0;
+        long long parsed = std::stoll(value, &used);
+        if (used != value.size()) throw std::invalid_argument(value);
+        return parsed;
+    } catch (const std::exception&) {
+        throw std::runtime_error("Invalid value for " + flag + ": '" + value + "' (expected an integer)");
+    }
+}
+
+static double parse_number(const std::string& flag, const std::string& value) {
+    try {
+        std::size_t used = 0;
+        double parsed = std::stod(value, &used);
+        if (used != value.size()) throw std::invalid_argument(value);
+        return parsed;
+    } catch (const std::exception&) {
+        throw std::runtime_error("Invalid value for " + flag + ": '" + value + "' (expected a number)");
+    }
+}
+
+static uint16_t to_port(const std::string& source, long long value) {
+    if (value <= 0 || value > 65535) {
+        throw std::runtime_error("Invalid port in " + source + ": " + std::to_string(value));
+    }
+    return static_cast<uint16_t>(value);
+}
+
+ServerConfig ServerConfig::from_command_line(int argc, char* argv[]) {
+    ServerConfig config;
+    // The config file is applied first so flags can override individual settings
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (std::string(argv[i]) == "-config") config.load_file(argv[i + 1]);
+    }
+    // Kept out of argv, where every local user can read it
+    if (const char* password = std::getenv(PASSWORD_ENV)) config.password = password;
+    config.parse_args(argc, argv);
+    if (!config.show_help) config.validate();
+    return config;
+}
+
+void ServerConfig::load_file(const std::string& path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error("Cannot open config file: " + path);
+    }
+    json root;
+    try {
+        root = json::parse(file);
+    } catch (const std::exception& e) {
+        throw std::runtime_error("Config file " + path + " is not valid JSON: " + e.what());
+    }
+    if (!root.is_object()) {
+        throw std::runtime_error("Config file " + path + " must contain a JSON object");
+    }
+    for (const auto& [key, value] : root.items()) {
+        try {
+            if (key == "ports") {
+                ports.clear();
+                for (const auto& port : value) ports.push_back(to_port(path, port.get<long long>()));
+            } else if (key == "worker_threads") {
+                worker_threads = value.get<unsigned int>();
+            } else if (key == "cpu_affinity") {
+                cpu_affinity = value.get<std::vector<int>>();
+            } else if (key == "receive_buffer_size") {
+                receive_buffer_size = value.get<int>();
+            } else if (key == "send_buffer_size") {
+                send_buffer_size = value.get<int>();
+            } else if (key == "busy_poll_us") {
+                busy_poll_us = value.get<int>();
+            } else if (key == "io_backend") {
+                io_backend = value.get<std::string>();
+            } else if (key == "heartbeat_timeout_s") {
+                heartbeat_timeout = std::chrono::seconds(value.get<long long>());
+            } else if (key == "heartbeat_interval_s") {
+                heartbeat_interval = std::chrono::seconds(value.get<long long>());
+            } else if (key == "ingress_rate") {
+                ingress_rate = value.get<double>();
+            } else if (key == "ingress_burst") {
+                ingress_burst = value.get<double>();
+            } else if (key == "egress_max_depth") {
+                egress_max_depth = value.get<std::size_t>();
+            } else if (key == "egress_max_age_ms") {
+                egress_max_age = std::chrono::milliseconds(value.get<long long>());
+            } else if (key == "bpm") {
+                initial_bpm = value.get<double>();
+            } else if (key == "metrics_port") {
+                metrics_port = value.get<long long>() == 0 ? 0 : to_port(path, value.get<long long>());
+            } else if (key == "metrics_address") {
+                metrics_address = value.get<std::string>();
+            } else if (key == "trace_file") {
+                trace_file = value.get<std::string>();
+            } else if (key == "password") {
+                password = value.get<std::string>();
+            } else if (key == "upstream") {
+                upstream = value.get<std::string>();
+            } else if (key == "debug") {
+                debug = value.get<bool>();
+            } else {
+                throw std::runtime_error("unknown setting");
+            }
+        } catch (const json::exception& e) {
+            throw std::runtime_error("Config file " + path + ": bad value for \"" + key + "\": " + e.what());
+        } catch (const std::runtime_error& e) {
+            throw std::runtime_error("Config file " + path + ": \"" + key + "\": " + e.what());
+        }
+    }
+}
+
+void ServerConfig::parse_args(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (flag == "-debug") {
+            debug = true;
+            continue;
+        }
+        if (flag == "-help" || flag == "--help" || flag == "-h") {
+            show_help = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            throw std::runtime_error("Missing value for " + flag + "\n" + usage());
+        }
+        std::string value = argv[++i];
+        if (flag == "-config") {
+            // Already applied by from_command_line
+        } else if (flag == "-port") {
+            ports.clear();
+            for (const auto& item : split_list(value)) ports.push_back(to_port(flag, parse_integer(flag, item)));
+        } else if (flag == "-threads") {
+            worker_threads = static_cast<unsigned int>(std::max(0LL, parse_integer(flag, value)));
+        } else if (flag == "-cpus") {
+            cpu_affinity.clear();
+            for (const auto& item : split_list(value)) cpu_affinity.push_back(static_cast<int>(parse_integer(flag, item)));
+        } else if (flag == "-rcvbuf") {
+            receive_buffer_size = static_cast<int>(parse_integer(flag, value));
+        } else if (flag == "-sndbuf") {
+            send_buffer_size = static_cast<int>(parse_integer(flag, value));
+        } else if (flag == "-busy-poll") {
+            busy_poll_us = static_cast<int>(parse_integer(flag, value));
+        } else if (flag == "-io") {
+            io_backend = value;
+        } else if (flag == "-heartbeat-timeout") {
+            heartbeat_timeout = std::chrono::seconds(parse_integer(flag, value));
+        } else if (flag == "-heartbeat-interval") {
+            heartbeat_interval = std::chrono::seconds(parse_integer(flag, value));
+        } else if (flag == "-rate") {
+            ingress_rate = parse_number(flag, value);
+        } else if (flag == "-burst") {
+            ingress_burst = parse_number(flag, value);
+        } else if (flag == "-queue-depth") {
+            egress_max_depth = static_cast<std::size_t>(std::max(0LL, parse_integer(flag, value)));
+        } else if (flag == "-max-age") {
+            egress_max_age = std::chrono::milliseconds(parse_integer(flag, value));
+        } else if (flag == "-bpm") {
+            initial_bpm = parse_number(flag, value);
+        } else if (flag == "-metrics-port") {
+            long long port = parse_integer(flag, value);
+            metrics_port = port == 0 ? 0 : to_port(flag, port);
+        } else if (flag == "-metrics-address") {
+            metrics_address = value;
+        } else if (flag == "-trace") {
+            trace_file = value;
+        } else if (flag == "-password") {
+            password = value;
+            password_in_args = true;
+        } else if (flag == "-upstream") {
+            upstream = value;
+        } else if (flag == "-handoff") {
+            auto fds = split_list(value);
+            if (fds.size() != 2) throw std::runtime_error("Invalid value for -handoff: '" + value + "' (expected <fd>,<fd>)");
+            handoff_fd = static_cast<int>(parse_integer(flag, fds[0]));
+            handoff_ready_fd = static_cast<int>(parse_integer(flag, fds[1]));
+        } else {
+            throw std::runtime_error("Unknown option: " + flag + "\n" + usage());
+        }
+    }
+}
+
+void ServerConfig::validate() const {
+    if (ports.empty()) throw std::runtime_error("At least one port is required");
+    std::vector<uint16_t> sorted = ports;
+    std::sort(sorted.begin(), sorted.end());
+    if (std::adjacent_find(sorted.begin(), sorted.end()) != sorted.end()) {
+        throw std::runtime_error("Duplicate port in port list");
+    }
+    if (worker_threads > 1024) throw std::runtime_error("worker_threads must be at most 1024");
+    unsigned int cpus = std::thread::hardware_concurrency();
+    for (int cpu : cpu_affinity) {
+        if (cpu < 0 || (cpus > 0 && static_cast<unsigned int>(cpu) >= cpus)) {
+            throw std::runtime_error("CPU " + std::to_string(cpu) + " in cpu_affinity does not exist (" +
+                                     std::to_string(cpus) + " CPUs available)");
+        }
+    }
+    if (receive_buffer_size < 4096 || receive_buffer_size > (64 << 20)) {
+        throw std::runtime_error("receive_buffer_size must be between 4 KB and 64 MB");
+    }
+    if (send_buffer_size < 4096 || send_buffer_size > (64 << 20)) {
+        throw std::runtime_error("send_buffer_size must be between 4 KB and 64 MB");
+    }
+    if (busy_poll_us < 0 || busy_poll_us > 1000000) throw std::runtime_error("busy_poll_us must be between 0 and 1000000");
+    if (io_backend != "asio" && io_backend != "uring") throw std::runtime_error("io_backend must be \"asio\" or \"uring\"");
+    if (heartbeat_interval.count() <= 0) throw std::runtime_error("heartbeat_interval must be positive");
+    if (heartbeat_timeout <= heartbeat_interval) {
+        throw std::runtime_error("heartbeat_timeout must be longer than heartbeat_interval");
+    }
+    if (ingress_rate <= 0.0) throw std::runtime_error("ingress_rate must be positive");
+    if (ingress_burst < 1.0) throw std::runtime_error("ingress_burst must be at least 1");
+    if (egress_max_depth == 0) throw std::runtime_error("egress_max_depth must be at least 1");
+    if (egress_max_age.count() <= 0) throw std::runtime_error("egress_max_age must be positive");
+    if (initial_bpm < 20.0 || initial_bpm > 300.0) throw std::runtime_error("bpm must be between 20 and 300");
+    if (metrics_port != 0 && std::find(ports.begin(), ports.end(), metrics_port) != ports.end()) {
+        // Different protocols could share the number, but it's almost certainly a typo
+        throw std::runtime_error("metrics_port must differ from the UDP ports");
+    }
+    if (metrics_port != 0 && metrics_address.empty()) throw std::runtime_error("metrics_address must not be empty");
+    if (password.size() > 256) throw std::runtime_error("password must be at most 256 characters");
+    if (!upstream.empty()) {
+        std::size_t colon = upstream.rfind(':');
+        if (colon == std::string::npos || colon == 0) throw std::runtime_error("upstream must be host:port");
+        to_port("upstream", parse_integer("upstream", upstream.substr(colon + 1)));
+    }
+    if ((handoff_fd < 0) != (handoff_ready_fd < 0)) throw std::runtime_error("-handoff needs two descriptors");
+}
+
+std::string ServerConfig::usage() {
+    return "Usage: MidiJamServer [options]\n"
+           "  -config <file>            JSON config file (flags override it)\n"
+           "  -port <p[,p...]>          UDP port(s) to listen on (default 5000)\n"
+           "  -threads <n>              Worker threads (default: one per CPU)\n"
+           "  -cpus <c[,c...]>          Pin worker i to CPU c[i % count]\n"
+           "  -rcvbuf <bytes>           SO_RCVBUF (default 65536)\n"
+           "  -sndbuf <bytes>           SO_SNDBUF (default 65536)\n"
+           "  -busy-poll <us>           SO_BUSY_POLL, Linux only (default off)\n"
+           "  -io <asio|uring>          Network I/O backend; uring needs Linux 6.0 (default asio)\n"
+           "  -heartbeat-timeout <s>    Drop silent clients after this long (default 20)\n"
+           "  -heartbeat-interval <s>   Ping interval (default 5)\n"
+           "  -rate <pps> -burst <n>    Per-client ingress token bucket (default 1000/200)\n"
+           "  -queue-depth <n>          Per-peer egress queue depth (default 256)\n"
+           "  -max-age <ms>             Drop queued MIDI older than this (default 100)\n"
+           "  -bpm <tempo>              Initial room tempo (default 120)\n"
+           "  -metrics-port <port>      Serve Prometheus metrics at /metrics (default off)\n"
+           "  -metrics-address <ip>     Metrics listen address (default 127.0.0.1)\n"
+           "  -trace <file>             Trace MIDI hot path stages, write Chrome trace JSON on exit\n"
+           "  -password <secret>        Require this room password and authenticate every packet; visible\n"
+           "                            in ps, so prefer \"password\" in the config file or $MIDIJAM_PASSWORD\n"
+           "  -upstream <host:port>     Link to another server as a relay node of the same room\n"
+           "  -handoff <fd>,<fd>        Internal: take over from a server doing a hot restart (SIGUSR2)\n"
+           "  -debug                    Verbose logging\n";
+}
+
+std::vector<std::string> ServerConfig::strip_password(const std::vector<std::string>& arguments) {
+    std::vector<std::string> stripped;
+    for (std::size_t i = 0; i < arguments.size(); ++i) {
+        if (arguments[i] == "-password") {
+            ++i; // And its value
+            continue;
+        }
+        stripped.push_back(arguments[i]);
+    }
+    return stripped;
+}
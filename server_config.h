@@ -0,0 +1,53 @@
+#ifndef SERVER_CONFIG_H
+#define SERVER_CONFIG_H
+
+#include "egress_queue.h"
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Server settings: built-in defaults, overridden by a JSON config file (-config),
+// then by the environment (MIDIJAM_PASSWORD), then by command line flags. Everything is
+// validated before the server starts.
+struct ServerConfig {
+    static constexpr const char* PASSWORD_ENV = "MIDIJAM_PASSWORD";
+
+    std::vector<uint16_t> ports{5000};
+    unsigned int worker_threads = 0;          // 0 = one per hardware thread
+    std::vector<int> cpu_affinity;            // Worker i is pinned to cpu_affinity[i % size]; empty = no pinning
+    int receive_buffer_size = 65536;          // SO_RCVBUF
+    int send_buffer_size = 65536;             // SO_SNDBUF
+    int busy_poll_us = 0;                     // SO_BUSY_POLL (Linux), 0 = off
+    std::string io_backend = "asio";          // "asio" or "uring" (Linux; falls back to asio if unavailable)
+    std::chrono::seconds heartbeat_timeout{20};
+    std::chrono::seconds heartbeat_interval{5};
+    double ingress_rate = TokenBucket::DEFAULT_RATE;
+    double ingress_burst = TokenBucket::DEFAULT_BURST;
+    std::size_t egress_max_depth = EgressQueue::DEFAULT_MAX_DEPTH;
+    std::chrono::milliseconds egress_max_age = EgressQueue::DEFAULT_MAX_AGE;
+    double initial_bpm = 120.0;
+    uint16_t metrics_port = 0;                // Prometheus /metrics listener, 0 = off
+    std::string metrics_address = "127.0.0.1";
+    std::string trace_file;                   // Enables tracing; Chrome trace JSON is written here on shutdown
+    std::string password;                     // Room password; empty = anyone may join, packets unauthenticated
+    bool password_in_args = false;            // Set by -password: hot restart hands the room key over instead
+    std::string upstream;                     // Relay node to link to ("host:port"); empty = this node is the root
+    int handoff_fd = -1;                      // Hot restart: snapshot left by the previous process...
+    int handoff_ready_fd = -1;                // ...and the pipe to tell it we took over
+    bool debug = false;
+    bool show_help = false;
+
+    // All of these throw std::runtime_error describing the offending setting
+    static ServerConfig from_command_line(int argc, char* argv[]);
+    void load_file(const std::string& path);
+    void parse_args(int argc, char* argv[]);
+    void validate() const;
+
+    static std::string usage();
+    // `arguments` without a "-password" pair, to re-run a command line without the secret on it
+    static std::vector<std::string> strip_password(const std::vector<std::string>& arguments);
+};
+
+#endif
@@ -0,0 +1,197 @@
+#include "server_metrics.h"
+#include <boost/beast.hpp>
+#include <algorithm>
+#include <cstdio>
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+using boost::asio::ip::tcp;
+
+struct MetricInfo {
+    const char* name;
+    const char* help;
+};
+
+static constexpr MetricInfo COUNTER_INFO[ServerMetrics::COUNTER_COUNT] = {
+    {"midijam_received_packets_total", "UDP datagrams received"},
+    {"midijam_received_bytes_total", "UDP payload bytes received"},
+    {"midijam_forwarded_packets_total", "MIDI and SysEx datagrams accepted for fan-out"},
+    {"midijam_fanout_packets_total", "Forwarded copies queued for receivers"},
+    {"midijam_filtered_packets_total", "Forwarded copies dropped by receiver subscriptions"},
+    {"midijam_sent_packets_total", "UDP datagrams sent"},
+    {"midijam_sent_bytes_total", "UDP payload bytes sent"},
+    {"midijam_send_errors_total", "Failed UDP sends"},
+    {"midijam_throttled_packets_total", "Datagrams dropped by per-client ingress rate limits"},
+    {"midijam_coalesced_packets_total", "Controller updates merged in egress queues"},
+    {"midijam_stale_drops_total", "Queued packets dropped for exceeding their max age"},
+    {"midijam_overflow_drops_total", "Packets dropped because an egress queue was full"},
+    {"midijam_clients_joined_total", "Clients that joined"},
+    {"midijam_clients_quit_total", "Clients that left with QUIT"},
+    {"midijam_clients_timed_out_total", "Clients dropped after missing heartbeats"},
+    {"midijam_clients_resumed_total", "Sessions re-attached with their resume token"},
+    {"midijam_auth_rejected_total", "Datagrams dropped for failing room authentication"},
+    {"midijam_relay_sent_total", "Frames queued for linked relay nodes"},
+    {"midijam_relay_received_total", "Frames accepted from linked relay nodes"},
+    {"midijam_relay_duplicates_total", "Relayed frames dropped as duplicates or loops"},
+    {"midijam_probes_answered_total", "Latency probes echoed to clients choosing a server"},
+    {"midijam_ump_translated_total", "Fanned-out packets translated between MIDI 1.0 bytes and UMP"},
+    {"midijam_ump_dropped_messages_total", "MIDI 1.0 messages past the UMP datagram size, dropped in translation"},
+};
+
+static constexpr MetricInfo HISTOGRAM_INFO[ServerMetrics::HISTOGRAM_COUNT] = {
+    {"midijam_handle_duration_seconds", "Time from receive completion to the end of packet handling"},
+    {"midijam_egress_wait_seconds", "Time packets spent in per-peer egress queues"},
+    {"midijam_client_rtt_seconds", "Server to client round trip times"},
+};
+
+static std::string format_number(double value) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.9g", value);
+    return text;
+}
+
+static void render_header(std::string& out, const char* name, const char* help, const char* type) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+void ServerMetrics::observe(Histogram histogram, int64_t ns) noexcept {
+    if (ns < 0) ns = 0;
+    HistogramShard& shard = local_shard().histograms[histogram];
+    std::size_t bucket = std::lower_bound(BUCKET_BOUNDS_NS.begin(), BUCKET_BOUNDS_NS.end(), ns) - BUCKET_BOUNDS_NS.begin();
+    bump(shard.buckets[bucket], 1);
+    bump(shard.sum_ns, ns);
+}
+
+ServerMetrics::Shard& ServerMetrics::local_shard() {
+    thread_local const ServerMetrics* owner = nullptr;
+    thread_local Shard* shard = nullptr;
+    if (owner != this) {
+        auto fresh = std::make_unique<Shard>();
+        std::lock_guard<std::mutex> lock(shards_mutex_);
+        shard = fresh.get();
+        owner = this;
+        shards_.push_back(std::move(fresh));
+    }
+    return *shard;
+}
+
+void ServerMetrics::render(std::string& out) const {
+    std::lock_guard<std::mutex> lock(shards_mutex_);
+    for (int c = 0; c < COUNTER_COUNT; ++c) {
+        uint64_t total = 0;
+        for (const auto& shard : shards_) total += shard->counters[c].load(std::memory_order_relaxed);
+        render_header(out, COUNTER_INFO[c].name, COUNTER_INFO[c].help, "counter");
+        out += COUNTER_INFO[c].name;
+        out += ' ' + std::to_string(total) + '\n';
+    }
+    for (int h = 0; h < HISTOGRAM_COUNT; ++h) {
+        std::array<uint64_t, BUCKET_BOUNDS_NS.size() + 1> buckets{};
+        int64_t sum_ns = 0;
+        for (const auto& shard : shards_) {
+            const HistogramShard& hist = shard->histograms[h];
+            for (std::size_t b = 0; b < buckets.size(); ++b) buckets[b] += hist.buckets[b].load(std::memory_order_relaxed);
+            sum_ns += hist.sum_ns.load(std::memory_order_relaxed);
+        }
+        const std::string name = HISTOGRAM_INFO[h].name;
+        render_header(out, HISTOGRAM_INFO[h].name, HISTOGRAM_INFO[h].help, "histogram");
+        // Buckets are cumulative; _count uses the bucket sum so it can't disagree with them mid-update
+        uint64_t cumulative = 0;
+        for (std::size_t b = 0; b < BUCKET_BOUNDS_NS.size(); ++b) {
+            cumulative += buckets[b];
+            out += name + "_bucket{le=\"" + format_number(BUCKET_BOUNDS_NS[b] / 1e9) + "\"} " + std::to_string(cumulative) + '\n';
+        }
+        cumulative += buckets.back();
+        out += name + "_bucket{le=\"+Inf\"} " + std::to_string(cumulative) + '\n';
+        out += name + "_sum " + format_number(sum_ns / 1e9) + '\n';
+        out += name + "_count " + std::to_string(cumulative) + '\n';
+    }
+}
+
+void ServerMetrics::render_gauge(std::string& out, const std::string& name, const std::string& help, double value) {
+    render_header(out, name.c_str(), help.c_str(), "gauge");
+    out += name + ' ' + format_number(value) + '\n';
+}
+
+std::string ServerMetrics::escape_label(const std::string& value) {
+    std::string escaped;
+    escaped.reserve(value.size());
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            escaped += '\\';
+            escaped += c;
+        } else if (c == '\n') {
+            escaped += "\\n";
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+MetricsEndpoint::MetricsEndpoint(boost::asio::io_context& io, const std::string& address, uint16_t port, Render render,
+                                 int inherited_fd)
+    : acceptor_(io), render_(std::move(render)) {
+    tcp::endpoint endpoint(boost::asio::ip::make_address(address), port);
+    if (inherited_fd >= 0) {
+        acceptor_.assign(endpoint.protocol(), inherited_fd);
+    } else {
+        acceptor_.open(endpoint.protocol());
+        acceptor_.set_option(tcp::acceptor::reuse_address(true));
+        acceptor_.bind(endpoint);
+        acceptor_.listen();
+    }
+    start_accept();
+}
+
+void MetricsEndpoint::stop() {
+    boost::system::error_code ec;
+    acceptor_.close(ec);
+}
+
+void MetricsEndpoint::start_accept() {
+    acceptor_.async_accept([this](boost::system::error_code ec, tcp::socket socket) {
+        if (ec == boost::asio::error::operation_aborted) return;
+        if (!ec) {
+            struct Session {
+                explicit Session(tcp::socket s) : stream(std::move(s)) {}
+                beast::tcp_stream stream;
+                beast::flat_buffer buffer;
+                http::request<http::empty_body> request;
+                http::response<http::string_body> response;
+            };
+            auto session = std::make_shared<Session>(std::move(socket));
+            session->stream.expires_after(std::chrono::seconds(5)); // Don't let idle scrapers hold sockets
+            http::async_read(session->stream, session->buffer, session->request,
+                [this, session](beast::error_code ec, std::size_t) {
+                    if (ec) return;
+                    auto& response = session->response;
+                    response.version(session->request.version());
+                    response.set(http::field::server, "MidiJam Server");
+                    response.keep_alive(false);
+                    if (session->request.method() == http::verb::get && session->request.target() == "/metrics") {
+                        response.result(http::status::ok);
+                        response.set(http::field::content_type, "text/plain; version=0.0.4; charset=utf-8");
+                        response.body() = render_();
+                    } else {
+                        response.result(http::status::not_found);
+                        response.set(http::field::content_type, "text/plain");
+                        response.body() = "Not found\n";
+                    }
+                    response.prepare_payload();
+                    http::async_write(session->stream, response, [session](beast::error_code, std::size_t) {
+                        beast::error_code ignored;
+                        session->stream.socket().shutdown(tcp::socket::shutdown_send, ignored);
+                    });
+                });
+        }
+        start_accept();
+    });
+}
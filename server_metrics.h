@@ -0,0 +1,115 @@
+#ifndef SERVER_METRICS_H
+#define SERVER_METRICS_H
+
+#include <boost/asio.hpp>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Server counters and latency histograms. Each io thread writes to its own shard
+// (single writer, relaxed atomics, no locked instructions), so the packet path never
+// contends; a scrape walks every shard and sums them.
+class ServerMetrics {
+public:
+    enum Counter {
+        RECEIVED_PACKETS,
+        RECEIVED_BYTES,
+        FORWARDED_PACKETS,   // MIDI and SysEx datagrams accepted for fan-out
+        FANOUT_PACKETS,      // Copies queued for receivers
+        FILTERED_PACKETS,    // Copies a receiver's subscriptions removed entirely
+        SENT_PACKETS,
+        SENT_BYTES,
+        SEND_ERRORS,
+        THROTTLED_PACKETS,
+        COALESCED_PACKETS,
+        STALE_DROPS,
+        OVERFLOW_DROPS,
+        CLIENTS_JOINED,
+        CLIENTS_QUIT,
+        CLIENTS_TIMED_OUT,
+        CLIENTS_RESUMED,     // Sessions re-attached with their resume token
+        AUTH_REJECTED,       // Datagrams that failed the room password checks
+        RELAY_SENT,          // RLAY frames queued for linked relay nodes
+        RELAY_RECEIVED,      // RLAY frames accepted from linked relay nodes
+        RELAY_DUPLICATES,    // RLAY frames dropped as already seen or looped back
+        PROBES_ANSWERED,     // PROB latency probes echoed
+        UMP_TRANSLATED,      // Fanned-out packets translated between raw MIDI and UMP
+        UMP_DROPPED,         // MIDI 1.0 messages that did not fit a translated UMP datagram
+        COUNTER_COUNT
+    };
+
+    enum Histogram {
+        HANDLE_DURATION,     // Receive completion to end of handle_packet, lock wait included
+        EGRESS_WAIT,         // Time a packet spent in a peer's egress queue
+        CLIENT_RTT,          // Timestamped PING/PONG round trips
+        HISTOGRAM_COUNT
+    };
+
+    // Upper bounds in nanoseconds, from 10 us to 1 s; the +Inf bucket is implicit
+    static constexpr std::array<int64_t, 15> BUCKET_BOUNDS_NS{
+        10000, 50000, 100000, 250000, 500000,
+        1000000, 2500000, 5000000, 10000000, 25000000,
+        50000000, 100000000, 250000000, 500000000, 1000000000};
+
+    void add(Counter counter, uint64_t amount = 1) noexcept {
+        bump(local_shard().counters[counter], amount);
+    }
+
+    void observe(Histogram histogram, int64_t ns) noexcept;
+
+    // Prometheus text exposition (version 0.0.4) of all counters and histograms
+    void render(std::string& out) const;
+
+    // Helpers for callers appending their own gauges to a scrape
+    static void render_gauge(std::string& out, const std::string& name, const std::string& help, double value);
+    static std::string escape_label(const std::string& value);
+
+private:
+    struct HistogramShard {
+        std::array<std::atomic<uint64_t>, BUCKET_BOUNDS_NS.size() + 1> buckets{};
+        std::atomic<int64_t> sum_ns{0};
+    };
+
+    struct Shard {
+        std::array<std::atomic<uint64_t>, COUNTER_COUNT> counters{};
+        std::array<HistogramShard, HISTOGRAM_COUNT> histograms{};
+    };
+
+    // Only the owning thread writes, so a plain load/store pair is enough
+    template <typename T, typename U>
+    static void bump(std::atomic<T>& value, U amount) noexcept {
+        value.store(value.load(std::memory_order_relaxed) + static_cast<T>(amount), std::memory_order_relaxed);
+    }
+
+    Shard& local_shard();
+
+    mutable std::mutex shards_mutex_; // Taken when a thread registers its shard and on scrape
+    std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+// Minimal HTTP listener answering GET /metrics, one request per connection.
+// Runs on the server's io_context; the render callback is invoked on an io thread.
+class MetricsEndpoint {
+public:
+    using Render = std::function<std::string()>;
+
+    // With `inherited_fd`, adopts an acceptor already bound to address:port (hot restart)
+    MetricsEndpoint(boost::asio::io_context& io, const std::string& address, uint16_t port, Render render, int inherited_fd = -1);
+    void stop();
+    int native_handle() { return acceptor_.native_handle(); }
+    uint16_t port() const { return acceptor_.local_endpoint().port(); } // The one picked for port 0, too
+
+private:
+    void start_accept();
+
+    boost::asio::ip::tcp::acceptor acceptor_;
+    Render render_;
+};
+
+#endif
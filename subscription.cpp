@@ -0,0 +1,92 @@
+#include "subscription.h"
+#include "jam_protocol.h"
+#include "midi_message.h"
+#include "ump.h"
+
+Subscription::Subscription() noexcept {
+    for (uint8_t c = 0; c < 16; ++c) remap[c] = c;
+}
+
+bool Subscription::passes_all() const noexcept {
+    if (channels != ALL_CHANNELS) return false;
+    for (uint8_t c = 0; c < 16; ++c) {
+        if (remap[c] != c) return false;
+    }
+    return true;
+}
+
+bool Subscription::apply(const char* data, std::size_t bytes, std::vector<char>& out) const {
+    out.clear();
+    if (Ump::is_packet(data, bytes)) {
+        out.assign(data, data + JamProtocol::TAG_SIZE);
+        Ump::for_each(data, bytes, [this, &out](const uint32_t* words, std::size_t count) {
+            uint32_t first = words[0];
+            if (Ump::is_channel_voice(first)) {
+                uint8_t channel = Ump::channel(first);
+                if (!(channels & (1u << channel))) return;
+                first = (first & ~0x000F0000u) | (static_cast<uint32_t>(remap[channel] & 0x0F) << 16);
+            }
+            std::size_t at = out.size();
+            out.resize(at + 4 * count);
+            Ump::write_word(out.data() + at, first);
+            for (std::size_t w = 1; w < count; ++w) Ump::write_word(out.data() + at + 4 * w, words[w]);
+        });
+        return out.size() > JamProtocol::TAG_SIZE;
+    }
+    MidiMessage::for_each(reinterpret_cast<const uint8_t*>(data), bytes,
+        [this, &out](const uint8_t* msg, std::size_t len) {
+            uint8_t status = msg[0];
+            if (MidiMessage::is_channel_message(status)) {
+                uint8_t channel = MidiMessage::channel(status);
+                if (!(channels & (1u << channel))) return;
+                status = MidiMessage::type(status) | (remap[channel] & 0x0F);
+            }
+            out.push_back(static_cast<char>(status));
+            out.insert(out.end(), reinterpret_cast<const char*>(msg) + 1, reinterpret_cast<const char*>(msg) + len);
+        });
+    return !out.empty();
+}
+
+void Subscription::encode(char* out) const noexcept {
+    JamProtocol::write_tag(out, JamProtocol::SUBSCRIBE_TAG);
+    JamProtocol::write_u16(out + JamProtocol::TAG_SIZE, sender);
+    JamProtocol::write_u16(out + JamProtocol::TAG_SIZE + 2, channels);
+    for (std::size_t c = 0; c < 16; ++c) out[JamProtocol::TAG_SIZE + 4 + c] = static_cast<char>(remap[c]);
+}
+
+bool Subscription::decode(const char* data, std::size_t bytes, Subscription& subscription) noexcept {
+    if (!JamProtocol::has_tag(data, bytes, JamProtocol::SUBSCRIBE_TAG, JamProtocol::SUBSCRIBE_SIZE)) return false;
+    subscription.sender = JamProtocol::read_u16(data + JamProtocol::TAG_SIZE);
+    subscription.channels = JamProtocol::read_u16(data + JamProtocol::TAG_SIZE + 2);
+    for (std::size_t c = 0; c < 16; ++c) {
+        subscription.remap[c] = static_cast<uint8_t>(data[JamProtocol::TAG_SIZE + 4 + c]) & 0x0F;
+    }
+    return true;
+}
+
+void SubscriptionTable::set(const Subscription& subscription) {
+    if (subscription.sender == Subscription::ALL_SENDERS) {
+        default_ = subscription;
+    } else {
+        by_sender_[subscription.sender] = subscription;
+    }
+    refresh();
+}
+
+const Subscription& SubscriptionTable::for_sender(uint16_t sender) const noexcept {
+    auto it = by_sender_.find(sender);
+    return it == by_sender_.end() ? default_ : it->second;
+}
+
+std::vector<Subscription> SubscriptionTable::entries() const {
+    std::vector<Subscription> list{default_};
+    for (const auto& [sender, subscription] : by_sender_) list.push_back(subscription);
+    return list;
+}
+
+void SubscriptionTable::refresh() noexcept {
+    passes_all_ = default_.passes_all();
+    for (const auto& [sender, subscription] : by_sender_) {
+        passes_all_ = passes_all_ && subscription.passes_all();
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef SUBSCRIPTION_H
+#define SUBSCRIPTION_H
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+// What one receiver wants from one sender: which of the sender's channels to hear and
+// which channel each of them should arrive on. A receiver sets these with SUBS
+// messages; the server applies them while fanning out, so filtered traffic is never sent.
+struct Subscription {
+    static constexpr uint16_t ALL_SENDERS = 0; // Sender id of a receiver's default subscription
+    static constexpr uint16_t ALL_CHANNELS = 0xFFFF;
+
+    uint16_t sender = ALL_SENDERS;
+    uint16_t channels = ALL_CHANNELS;  // Bit c set: channel c (0-based) passes; 0 mutes the sender
+    std::array<uint8_t, 16> remap;     // Output channel per input channel
+
+    Subscription() noexcept;
+
+    bool passes_all() const noexcept; // Every channel, unchanged
+    bool muted() const noexcept { return channels == 0; }
+
+    // Copies the messages of a raw MIDI or UMP datagram this subscription keeps into `out`,
+    // remapping channels. System common messages pass; returns false if nothing is left.
+    bool apply(const char* data, std::size_t bytes, std::vector<char>& out) const;
+
+    void encode(char* out) const noexcept; // JamProtocol::SUBSCRIBE_SIZE bytes
+    static bool decode(const char* data, std::size_t bytes, Subscription& subscription) noexcept;
+};
+
+// One receiver's subscriptions, by sender id. Receivers that never sent SUBS keep an
+// empty table, and forwarding to them costs a single flag check.
+class SubscriptionTable {
+public:
+    // Replaces the default (sender ALL_SENDERS) or one sender's entry, which overrides it
+    void set(const Subscription& subscription);
+    void forget_sender(uint16_t sender) noexcept { by_sender_.erase(sender); refresh(); }
+
+    bool passes_all() const noexcept { return passes_all_; }
+    const Subscription& for_sender(uint16_t sender) const noexcept;
+    std::vector<Subscription> entries() const; // The default first, for saving and replaying through set()
+
+private:
+    void refresh() noexcept;
+
+    Subscription default_;
+    std::unordered_map<uint16_t, Subscription> by_sender_;
+    bool passes_all_ = true;
+};
+
+#endif
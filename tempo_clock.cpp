@@ -0,0 +1,171 @@
+#include "tempo_clock.h"
+#include "jam_protocol.h"
+#include <algorithm>
+#include <cmath>
+
+double TempoState::tick_ns() const noexcept {
+    return 60e12 / (static_cast<double>(bpm_milli) * CLOCKS_PER_BEAT);
+}
+
+int64_t TempoState::time_of_tick(int64_t tick) const noexcept {
+    return anchor_ns + static_cast<int64_t>(std::llround(static_cast<double>(tick - anchor_tick) * tick_ns()));
+}
+
+double TempoState::position_at(int64_t session_ns) const noexcept {
+    if (!running || session_ns <= anchor_ns) return static_cast<double>(anchor_tick);
+    return static_cast<double>(anchor_tick) + static_cast<double>(session_ns - anchor_ns) / tick_ns();
+}
+
+void TempoState::encode(char* out) const noexcept {
+    JamProtocol::write_tag(out, JamProtocol::TEMPO_TAG);
+    char* p = out + JamProtocol::TAG_SIZE;
+    JamProtocol::write_i64(p, version);
+    JamProtocol::write_i64(p + 8, run_id);
+    JamProtocol::write_i64(p + 16, anchor_ns);
+    JamProtocol::write_i64(p + 24, anchor_tick);
+    JamProtocol::write_i64(p + 32, bpm_milli);
+    JamProtocol::write_i64(p + 40, running ? 1 : 0);
+}
+
+bool TempoState::decode(const char* data, std::size_t bytes, TempoState& state) noexcept {
+    if (!JamProtocol::has_tag(data, bytes, JamProtocol::TEMPO_TAG, JamProtocol::TEMPO_SIZE)) return false;
+    const char* p = data + JamProtocol::TAG_SIZE;
+    TempoState decoded;
+    decoded.version = JamProtocol::read_i64(p);
+    decoded.run_id = JamProtocol::read_i64(p + 8);
+    decoded.anchor_ns = JamProtocol::read_i64(p + 16);
+    decoded.anchor_tick = JamProtocol::read_i64(p + 24);
+    decoded.bpm_milli = JamProtocol::read_i64(p + 32);
+    decoded.running = JamProtocol::read_i64(p + 40) != 0;
+    if (decoded.bpm_milli < MIN_BPM_MILLI || decoded.bpm_milli > MAX_BPM_MILLI || decoded.anchor_tick < 0) return false;
+    state = decoded;
+    return true;
+}
+
+MidiClockGenerator::MidiClockGenerator(const ClockSync& clock, Sink sink)
+    : clock_(clock), sink_(std::move(sink)) {}
+
+MidiClockGenerator::~MidiClockGenerator() {
+    stop();
+}
+
+void MidiClockGenerator::start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (thread_.joinable()) return;
+    stop_ = false;
+    thread_ = std::thread([this]() { run(); });
+}
+
+void MidiClockGenerator::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) thread_.join();
+}
+
+void MidiClockGenerator::update(const TempoState& state) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!reset_ && state.version == pending_.version && state.run_id == pending_.run_id) return; // Periodic resend
+        pending_ = state;
+        changed_ = true;
+        restart_ = reset_;
+        reset_ = false;
+    }
+    cv_.notify_all();
+}
+
+void MidiClockGenerator::reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    reset_ = true;
+}
+
+TempoState MidiClockGenerator::state() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_;
+}
+
+void MidiClockGenerator::emit(std::initializer_list<unsigned char> bytes) {
+    sink_(std::vector<unsigned char>(bytes));
+}
+
+void MidiClockGenerator::run() {
+    TempoState current;
+    bool start_pending = false; // Start/Continue not yet emitted for current.run_id
+    int64_t next_tick = 0;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_) {
+        if (changed_) {
+            TempoState previous = current;
+            current = pending_;
+            bool restart = restart_; // Anchor and position come from a different room clock
+            changed_ = false;
+            restart_ = false;
+            if (previous.running && !current.running) {
+                lock.unlock();
+                emit({0xFC});
+                lock.lock();
+            }
+            if (!current.running && (current.anchor_tick != previous.anchor_tick || restart)) {
+                int64_t spp = current.anchor_tick / TempoState::CLOCKS_PER_SPP_UNIT;
+                lock.unlock();
+                emit({0xF2, static_cast<unsigned char>(spp & 0x7F), static_cast<unsigned char>((spp >> 7) & 0x7F)});
+                lock.lock();
+            }
+            if (current.running && (!previous.running || current.run_id != previous.run_id || restart)) {
+                start_pending = true;
+                next_tick = current.anchor_tick;
+            } else if (current.running && !start_pending) {
+                // Tempo change mid-run: keep counting from the next tick of the new anchor
+                int64_t now_session = clock_.session_now_ns();
+                next_tick = std::max(current.anchor_tick, static_cast<int64_t>(std::floor(current.position_at(now_session))) + 1);
+            }
+            continue;
+        }
+
+        if (!current.running || !clock_.is_synchronized()) {
+            cv_.wait_for(lock, IDLE_WAIT);
+            continue;
+        }
+
+        int64_t due = clock_.to_local(current.time_of_tick(next_tick));
+        int64_t now = ClockSync::local_now_ns();
+        if (start_pending && now - due > static_cast<int64_t>(MAX_LATE_TICKS * current.tick_ns())) {
+            // Joined (or synced) while the room was already running: pick it up at the next
+            // 16th-note boundary with Song Position + Continue, not Start from the anchor
+            int64_t tick = static_cast<int64_t>(std::floor(current.position_at(clock_.to_session(now)))) + 1;
+            next_tick = (tick + TempoState::CLOCKS_PER_SPP_UNIT - 1) / TempoState::CLOCKS_PER_SPP_UNIT * TempoState::CLOCKS_PER_SPP_UNIT;
+            continue;
+        }
+        if (due - now > SPIN_THRESHOLD_NS) {
+            // Sleep until just before the tick, waking early for state changes
+            cv_.wait_for(lock, std::chrono::nanoseconds(due - now - SPIN_THRESHOLD_NS));
+            continue;
+        }
+        if (now - due > static_cast<int64_t>(MAX_LATE_TICKS * current.tick_ns()) && !start_pending) {
+            next_tick = static_cast<int64_t>(std::floor(current.position_at(clock_.to_session(now)))) + 1;
+            continue;
+        }
+
+        lock.unlock();
+        while (ClockSync::local_now_ns() < due) {
+            std::this_thread::yield();
+        }
+        if (start_pending) {
+            if (next_tick == 0) {
+                emit({0xFA});
+            } else {
+                int64_t spp = next_tick / TempoState::CLOCKS_PER_SPP_UNIT;
+                emit({0xF2, static_cast<unsigned char>(spp & 0x7F), static_cast<unsigned char>((spp >> 7) & 0x7F)});
+                emit({0xFB});
+            }
+            start_pending = false;
+        }
+        emit({0xF8});
+        lock.lock();
+        ++next_tick;
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef TEMPO_CLOCK_H
+#define TEMPO_CLOCK_H
+
+#include "clock_sync.h"
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Room tempo and transport, owned by the server. Instead of streaming 24 clock
+// bytes per beat, the server distributes an anchor (session time + clock position)
+// and a tempo; every client derives the same tick times from it.
+struct TempoState {
+    static constexpr int64_t CLOCKS_PER_BEAT = 24;
+    static constexpr int64_t CLOCKS_PER_SPP_UNIT = 6; // Song Position Pointer counts 16th notes
+
+    // Transport commands carried by TRAN requests (the MIDI status bytes, plus tempo)
+    static constexpr int64_t CMD_START = 0xFA;
+    static constexpr int64_t CMD_CONTINUE = 0xFB;
+    static constexpr int64_t CMD_STOP = 0xFC;
+    static constexpr int64_t CMD_SONG_POSITION = 0xF2; // value: position in 16th notes
+    static constexpr int64_t CMD_TEMPO = 0x100;        // value: tempo in milli-BPM
+
+    static constexpr int64_t MIN_BPM_MILLI = 20000;
+    static constexpr int64_t MAX_BPM_MILLI = 300000;
+
+    int64_t version = 0;        // Bumped on every change
+    int64_t run_id = 0;         // Bumped on every Start/Continue so clients re-send transport
+    int64_t anchor_ns = 0;      // Session time at which the clock is at anchor_tick
+    int64_t anchor_tick = 0;    // Clock position (24 per quarter note)
+    int64_t bpm_milli = 120000;
+    bool running = false;
+
+    double tick_ns() const noexcept;
+    int64_t time_of_tick(int64_t tick) const noexcept;
+    double position_at(int64_t session_ns) const noexcept; // Frozen at anchor_tick while stopped
+    double bpm() const noexcept { return bpm_milli / 1000.0; }
+
+    void encode(char* out) const noexcept; // JamProtocol::TEMPO_SIZE bytes
+    static bool decode(const char* data, std::size_t bytes, TempoState& state) noexcept;
+};
+
+// Emits MIDI Clock (0xF8) and Start/Continue/Stop/SPP locally from a high-resolution
+// timer thread, phase-aligned to the session clock via ClockSync.
+class MidiClockGenerator {
+public:
+    using Sink = std::function<void(const std::vector<unsigned char>&)>;
+
+    MidiClockGenerator(const ClockSync& clock, Sink sink);
+    ~MidiClockGenerator();
+
+    void start();
+    void stop();
+    void update(const TempoState& state);
+    // The next update comes from another server or session, whose versions and run ids
+    // start over: take it even if they match, and pick up a running room afresh
+    void reset();
+    TempoState state() const;
+
+private:
+    static constexpr auto IDLE_WAIT = std::chrono::milliseconds(100);
+    static constexpr int64_t SPIN_THRESHOLD_NS = 1000000; // Busy-wait the last millisecond
+    static constexpr int64_t MAX_LATE_TICKS = 2;          // Skip ahead instead of bursting after a stall
+
+    void run();
+    void emit(std::initializer_list<unsigned char> bytes);
+
+    const ClockSync& clock_;
+    Sink sink_;
+    std::thread thread_;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    TempoState pending_;
+    bool changed_ = false;
+    bool reset_ = false;   // Set by reset() until the next update
+    bool restart_ = false; // The pending update follows a reset()
+    bool stop_ = false;
+};
+
+#endif
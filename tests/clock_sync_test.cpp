@@ -0,0 +1,106 @@
+// ClockSync against a simulated server clock with a known offset and drift: convergence,
+// the min-RTT filter under asymmetric queuing, step detection and reset. No sockets or
+// sleeps; every timestamp is synthetic, so the results are exact from run to run.
+#include "clock_sync.h"
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+static int failures = 0;
+
+static void check(bool ok, const std::string& what) {
+    if (!ok) {
+        std::cerr << "FAIL: " << what << std::endl;
+        ++failures;
+    }
+}
+
+static constexpr int64_t MS = 1000000;
+static constexpr int64_t SECOND = 1000 * MS;
+
+// Session clock the simulated server runs: session = local + offset + drift * (local - epoch)
+struct SimServer {
+    int64_t offset;
+    double drift;
+    int64_t epoch;
+
+    int64_t at(int64_t local) const {
+        return local + offset + static_cast<int64_t>(drift * static_cast<double>(local - epoch));
+    }
+};
+
+// One PING/PONG exchange starting at local time t0 with the given one-way delays
+static void exchange(ClockSync& sync, const SimServer& server, int64_t t0, int64_t out_ns, int64_t back_ns) {
+    const int64_t processing = 50000;
+    int64_t t1 = server.at(t0 + out_ns);
+    int64_t t2 = server.at(t0 + out_ns + processing);
+    sync.add_sample(t0, t1, t2, t0 + out_ns + processing + back_ns);
+}
+
+// Distance between the estimate and the true session clock at a local time
+static int64_t error_ns(const ClockSync& sync, const SimServer& server, int64_t local) {
+    return std::llabs(sync.to_session(local) - server.at(local));
+}
+
+int main() {
+    const int64_t start = 1000 * SECOND;
+    SimServer server{5 * SECOND, 100e-6, start};
+    ClockSync sync;
+
+    // Convergence: synchronized after MIN_SAMPLES, offset and drift found once the span allows
+    int64_t t = start;
+    for (int i = 0; i < 3; ++i, t += SECOND) exchange(sync, server, t, MS, MS);
+    check(!sync.is_synchronized(), "not synchronized before four samples");
+    exchange(sync, server, t, MS, MS);
+    t += SECOND;
+    check(sync.is_synchronized(), "synchronized after four samples");
+    for (int i = 0; i < 26; ++i, t += SECOND) exchange(sync, server, t, MS, MS);
+    check(std::abs(sync.drift_ppm() - 100.0) < 1.0, "drift estimated as 100 ppm: " + std::to_string(sync.drift_ppm()));
+    check(error_ns(sync, server, t) < 10000, "offset within 10 us: " + std::to_string(error_ns(sync, server, t)));
+    check(std::llabs(sync.rtt_ns() - 2 * MS) < 100, "minimum round trip is 2 ms: " + std::to_string(sync.rtt_ns()));
+    int64_t session = sync.to_session(t);
+    check(std::llabs(sync.to_local(session) - t) <= 1, "to_local inverts to_session");
+
+    // Asymmetric queuing: a 20 ms delay on the way back shifts the raw offset by 10 ms;
+    // the min-RTT filter must keep those samples out of the fit
+    for (int i = 0; i < 30; ++i, t += SECOND) exchange(sync, server, t, MS, i % 2 ? 21 * MS : MS);
+    check(sync.is_synchronized(), "queuing outliers do not look like a step");
+    check(error_ns(sync, server, t) < 10000, "outliers filtered, offset within 10 us: " + std::to_string(error_ns(sync, server, t)));
+    check(std::abs(sync.drift_ppm() - 100.0) < 1.0, "drift unchanged by outliers: " + std::to_string(sync.drift_ppm()));
+
+    // A 200 ms step seen only on congested exchanges needs three agreeing samples
+    SimServer stepped = server;
+    stepped.offset += 200 * MS;
+    std::size_t before = sync.sample_count();
+    for (int i = 0; i < 2; ++i, t += SECOND) exchange(sync, stepped, t, MS, 21 * MS);
+    check(sync.is_synchronized() && sync.sample_count() == before + 2, "two congested step samples are not enough");
+    check(error_ns(sync, server, t) < 10000, "estimate holds while the step is unconfirmed");
+    exchange(sync, stepped, t, MS, 21 * MS);
+    t += SECOND;
+    check(!sync.is_synchronized() && sync.sample_count() == 1, "third congested step sample restarts the window");
+    for (int i = 0; i < 4; ++i, t += SECOND) exchange(sync, stepped, t, MS, MS);
+    check(sync.is_synchronized(), "synchronized again after the step");
+    check(error_ns(sync, stepped, t) < 500000, "new offset within 0.5 ms before drift is refit: " +
+          std::to_string(error_ns(sync, stepped, t)));
+
+    // One uncongested sample is proof enough of a step
+    ClockSync direct;
+    t = start;
+    for (int i = 0; i < 8; ++i, t += SECOND) exchange(direct, server, t, MS, MS);
+    exchange(direct, server, t, MS, MS + 40 * MS);  // Congested, residual under the threshold
+    t += SECOND;
+    check(direct.is_synchronized() && direct.sample_count() == 9, "congestion alone is not a step");
+    exchange(direct, stepped, t, MS, MS);
+    t += SECOND;
+    check(!direct.is_synchronized() && direct.sample_count() == 1, "trusted step sample restarts the window at once");
+
+    // Corrupt replies are ignored; reset forgets everything
+    direct.add_sample(t, t, t, t - 1);
+    check(direct.sample_count() == 1, "reply before request is ignored");
+    sync.reset();
+    check(!sync.is_synchronized() && sync.sample_count() == 0 && sync.rtt_ns() == -1, "reset clears the estimate");
+    check(sync.to_session(t) == t, "reset maps session time to local time");
+
+    if (failures == 0) std::cout << "Clock sync OK" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
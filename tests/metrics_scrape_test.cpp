@@ -0,0 +1,102 @@
+// Scrapes a MetricsEndpoint on an ephemeral localhost port and checks that the reply is
+// valid Prometheus text exposition carrying every server counter and histogram.
+#include "server_metrics.h"
+#include <boost/asio.hpp>
+#include <iostream>
+#include <map>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+using boost::asio::ip::tcp;
+
+static int failures = 0;
+
+static void check(bool ok, const std::string& what) {
+    if (!ok) {
+        std::cerr << "FAIL: " << what << std::endl;
+        ++failures;
+    }
+}
+
+static std::string scrape(uint16_t port, const std::string& target) {
+    boost::asio::io_context io;
+    tcp::socket socket(io);
+    socket.connect(tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), port));
+    std::string request = "GET " + target + " HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n";
+    boost::asio::write(socket, boost::asio::buffer(request));
+    std::string reply;
+    boost::system::error_code ec;
+    boost::asio::read(socket, boost::asio::dynamic_buffer(reply), ec); // Until the server closes
+    return reply;
+}
+
+int main() {
+    ServerMetrics metrics;
+    metrics.add(ServerMetrics::RECEIVED_PACKETS, 3);
+    metrics.add(ServerMetrics::SENT_BYTES, 1500);
+    metrics.observe(ServerMetrics::HANDLE_DURATION, 20000);     // 20 us
+    metrics.observe(ServerMetrics::HANDLE_DURATION, 2000000000); // Past the last bound
+
+    boost::asio::io_context io;
+    MetricsEndpoint endpoint(io, "127.0.0.1", 0, [&metrics]() {
+        std::string out;
+        metrics.render(out);
+        ServerMetrics::render_gauge(out, "midijam_clients", "Connected clients", 2);
+        return out;
+    });
+    std::thread server([&io]() { io.run(); });
+
+    std::string reply = scrape(endpoint.port(), "/metrics");
+    std::string missing = scrape(endpoint.port(), "/nothing");
+    endpoint.stop();
+    io.stop();
+    server.join();
+
+    std::size_t split = reply.find("\r\n\r\n");
+    check(reply.rfind("HTTP/1.1 200", 0) == 0, "status 200 for /metrics");
+    check(reply.find("text/plain; version=0.0.4") < split, "exposition content type");
+    check(missing.rfind("HTTP/1.1 404", 0) == 0, "status 404 for other paths");
+    if (split == std::string::npos) {
+        std::cerr << "FAIL: no body" << std::endl;
+        return 1;
+    }
+
+    // Every sample must be `name{labels} value` and belong to a family declared by # TYPE
+    const std::regex sample(R"(([a-zA-Z_:][a-zA-Z0-9_:]*)(\{[^}]*\})? (-?[0-9.e+-]+|\+Inf|NaN))");
+    const std::regex type_line(R"(# TYPE ([a-zA-Z_:][a-zA-Z0-9_:]*) (counter|gauge|histogram))");
+    std::map<std::string, std::string> types;
+    std::map<std::string, double> values; // Unlabelled samples and histogram +Inf buckets
+    std::istringstream body(reply.substr(split + 4));
+    std::string line;
+    while (std::getline(body, line)) {
+        std::smatch match;
+        if (line.empty() || line.rfind("# HELP ", 0) == 0) continue;
+        if (line[0] == '#') {
+            check(std::regex_match(line, match, type_line), "TYPE line: " + line);
+            if (!match.empty()) types[match[1]] = match[2];
+            continue;
+        }
+        if (!std::regex_match(line, match, sample)) {
+            check(false, "sample line: " + line);
+            continue;
+        }
+        std::string name = match[1];
+        std::string family = std::regex_replace(name, std::regex("_(bucket|sum|count)$"), "");
+        check(types.count(name) || (types.count(family) && types[family] == "histogram"), "declared family for " + name);
+        if (!match[2].matched) values[name] = std::stod(match[3]);
+        if (match[2] == "{le=\"+Inf\"}") values[name + "+Inf"] = std::stod(match[3]);
+    }
+
+    check(values["midijam_received_packets_total"] == 3, "midijam_received_packets_total == 3");
+    check(values["midijam_sent_bytes_total"] == 1500, "midijam_sent_bytes_total == 1500");
+    check(values.count("midijam_send_errors_total") && values["midijam_send_errors_total"] == 0, "midijam_send_errors_total present");
+    check(values["midijam_clients"] == 2, "midijam_clients gauge");
+    check(values["midijam_handle_duration_seconds_count"] == 2, "handle duration count");
+    check(values["midijam_handle_duration_seconds_bucket+Inf"] == 2, "+Inf bucket matches count");
+    check(types["midijam_egress_wait_seconds"] == "histogram", "egress wait histogram declared");
+
+    if (failures == 0) std::cout << "metrics scrape OK (" << types.size() << " families)" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
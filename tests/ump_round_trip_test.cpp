@@ -0,0 +1,113 @@
+// MIDI 1.0 -> UMP -> MIDI 1.0 round trips: Note On velocity 0, every 7-bit velocity and
+// controller value, pitch bend across its 14-bit range, the min-center-max scaling rules,
+// and datagrams too large for one UMP packet.
+#include "egress_queue.h"
+#include "jam_protocol.h"
+#include "ump.h"
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static int failures = 0;
+
+static void check(bool ok, const std::string& what) {
+    if (!ok) {
+        std::cerr << "FAIL: " << what << std::endl;
+        ++failures;
+    }
+}
+
+static std::string hex(const std::vector<char>& bytes) {
+    std::string out;
+    char byte[4];
+    for (char c : bytes) {
+        std::snprintf(byte, sizeof(byte), "%02x ", static_cast<uint8_t>(c));
+        out += byte;
+    }
+    return out;
+}
+
+// MIDI 1.0 bytes through UMP and back
+static std::vector<char> round_trip(const std::vector<uint8_t>& midi, std::size_t* ump_words = nullptr) {
+    std::vector<char> packet, back;
+    std::size_t dropped = 0;
+    if (!Ump::from_midi1(midi.data(), midi.size(), packet, dropped)) return back;
+    check(dropped == 0, "nothing dropped from a small datagram");
+    check(Ump::is_packet(packet.data(), packet.size()), "from_midi1 builds a valid UMP datagram");
+    if (ump_words) *ump_words = (packet.size() - JamProtocol::TAG_SIZE) / 4;
+    Ump::to_midi1(packet.data(), packet.size(), back);
+    return back;
+}
+
+static void expect(const std::vector<uint8_t>& midi, const std::vector<uint8_t>& expected, const std::string& what) {
+    std::vector<char> back = round_trip(midi);
+    std::vector<char> want(expected.begin(), expected.end());
+    check(back == want, what + ": got " + hex(back) + "want " + hex(want));
+}
+
+int main() {
+    // Note On velocity 0 is a Note Off in MIDI 2.0, and comes back as one
+    std::size_t words = 0;
+    std::vector<char> back = round_trip({0x93, 60, 0}, &words);
+    check(words == 2, "a note is one 64-bit UMP");
+    check(back == std::vector<char>{static_cast<char>(0x83), 60, 0}, "Note On velocity 0 becomes Note Off: got " + hex(back));
+    for (uint8_t velocity = 1; velocity < 128; ++velocity) {
+        expect({0x90, 64, velocity}, {0x90, 64, velocity}, "Note On velocity " + std::to_string(velocity));
+        expect({0x85, 64, velocity}, {0x85, 64, velocity}, "Note Off velocity " + std::to_string(velocity));
+    }
+    for (uint8_t value = 0; value < 128; ++value) {
+        expect({0xB2, 74, value}, {0xB2, 74, value}, "CC 74 value " + std::to_string(value));
+        expect({0xD2, value}, {0xD2, value}, "channel pressure " + std::to_string(value));
+    }
+    expect({0xC4, 17}, {0xC4, 17}, "program change");
+
+    // Pitch bend: every 14-bit value survives, and center stays center on the wire
+    bool bend_ok = true;
+    for (uint32_t bend = 0; bend < 16384; ++bend) {
+        std::vector<char> got = round_trip({0xE1, static_cast<uint8_t>(bend & 0x7F), static_cast<uint8_t>(bend >> 7)});
+        if (got != std::vector<char>{static_cast<char>(0xE1), static_cast<char>(bend & 0x7F), static_cast<char>(bend >> 7)}) {
+            check(false, "pitch bend " + std::to_string(bend) + ": got " + hex(got));
+            bend_ok = false;
+            break;
+        }
+    }
+    check(bend_ok, "every pitch bend value round-trips");
+
+    // Min-center-max scaling
+    check(Ump::scale_up(0, 14, 32) == 0, "bend minimum scales to 0");
+    check(Ump::scale_up(0x2000, 14, 32) == 0x80000000u, "bend center scales to the 32-bit center");
+    check(Ump::scale_up(0x3FFF, 14, 32) == 0xFFFFFFFFu, "bend maximum scales to the 32-bit maximum");
+    check(Ump::scale_up(64, 7, 16) == 0x8000, "velocity 64 scales to the 16-bit center");
+    check(Ump::scale_up(127, 7, 16) == 0xFFFF, "velocity 127 scales to the 16-bit maximum");
+    check(Ump::scale_up(127, 7, 32) == 0xFFFFFFFFu, "controller 127 scales to the 32-bit maximum");
+    bool monotonic = true;
+    for (uint32_t v = 1; v < 16384; ++v) monotonic &= Ump::scale_up(v, 14, 32) > Ump::scale_up(v - 1, 14, 32);
+    check(monotonic, "14-bit scaling is strictly increasing");
+
+    // Running status and several messages in one datagram
+    expect({0x90, 60, 100, 64, 0, 0xF8, 67, 90}, {0x90, 60, 100, 0x80, 64, 0, 0xF8, 0x90, 67, 90}, "running status with realtime");
+
+    // More channel messages than one UMP datagram holds: the excess is counted, not lost silently
+    std::vector<uint8_t> burst;
+    for (int i = 0; i < 40; ++i) burst.insert(burst.end(), {0x90, static_cast<uint8_t>(i), 100});
+    std::vector<char> packet;
+    std::size_t dropped = 0;
+    Ump::from_midi1(burst.data(), burst.size(), packet, dropped);
+    check((packet.size() - JamProtocol::TAG_SIZE) / 4 == Ump::MAX_WORDS, "a full datagram holds MAX_WORDS words");
+    check(dropped == 40 - Ump::MAX_WORDS / 2, "messages past MAX_WORDS are counted: " + std::to_string(dropped));
+
+    // The same controller in two UMP groups must not coalesce into one queue entry
+    int32_t keys[2];
+    for (uint32_t group = 0; group < 2; ++group) {
+        std::vector<char> cc(JamProtocol::TAG_SIZE + 8);
+        JamProtocol::write_tag(cc.data(), JamProtocol::UMP_TAG);
+        Ump::write_word(cc.data() + 4, (uint32_t(Ump::TYPE_MIDI2_CHANNEL) << 28) | (group << 24) | (0xB0u << 16) | (7u << 8));
+        Ump::write_word(cc.data() + 8, 0x80000000u);
+        EgressQueue::classify(cc.data(), cc.size(), keys[group]);
+    }
+    check(keys[0] != EgressQueue::NO_COALESCE && keys[0] != keys[1], "UMP groups get separate coalescing keys");
+
+    if (failures == 0) std::cout << "UMP round trip OK" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,129 @@
+#include "trace.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> Trace::enabled_{false};
+
+struct TraceEvent {
+    int64_t timestamp_ns;
+    uint8_t stage;
+    uint8_t bytes;
+    std::array<uint8_t, Trace::MAX_BYTES> data;
+};
+
+// Single writer (the owning thread); readers copy and then discard anything the writer
+// may have overwritten while they were copying.
+struct TraceRing {
+    int tid = 0;
+    std::atomic<uint64_t> head{0};
+    std::atomic<uint64_t> floor{0}; // Events before this index were cleared
+    std::array<TraceEvent, Trace::RING_CAPACITY> events;
+};
+
+static std::mutex rings_mutex; // Taken when a thread registers its ring and on dump
+static std::vector<std::unique_ptr<TraceRing>> rings;
+
+static TraceRing& local_ring() {
+    thread_local TraceRing* ring = nullptr;
+    if (!ring) {
+        auto fresh = std::make_unique<TraceRing>();
+        std::lock_guard<std::mutex> lock(rings_mutex);
+        fresh->tid = static_cast<int>(rings.size()) + 1;
+        ring = fresh.get();
+        rings.push_back(std::move(fresh));
+    }
+    return *ring;
+}
+
+static const char* stage_name(uint8_t stage) {
+    static constexpr const char* NAMES[Trace::STAGE_COUNT] = {
+        "midi_in", "client_send", "server_receive", "server_fanout", "server_send", "client_receive", "midi_out"};
+    return stage < Trace::STAGE_COUNT ? NAMES[stage] : "unknown";
+}
+
+// FNV-1a over the bytes, with the channel nibble of a channel message masked out
+static uint32_t event_id(const TraceEvent& event) {
+    uint32_t hash = 2166136261u;
+    for (uint8_t i = 0; i < event.bytes; ++i) {
+        uint8_t byte = event.data[i];
+        if (i == 0 && byte >= 0x80 && byte < 0xF0) byte &= 0xF0;
+        hash = (hash ^ byte) * 16777619u;
+    }
+    return hash;
+}
+
+int64_t Trace::now_ns() noexcept {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Trace::record(Stage stage, int64_t timestamp_ns, const void* data, std::size_t bytes) noexcept {
+    TraceRing& ring = local_ring();
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    TraceEvent& event = ring.events[head % RING_CAPACITY];
+    event.timestamp_ns = timestamp_ns;
+    event.stage = stage;
+    event.bytes = static_cast<uint8_t>(bytes < MAX_BYTES ? bytes : MAX_BYTES);
+    std::memcpy(event.data.data(), data, event.bytes);
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+std::string Trace::chrome_json(const std::string& process_name, int pid,
+                               const std::function<int64_t(int64_t)>& to_session) {
+    std::string out = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    char line[256];
+    std::snprintf(line, sizeof(line), "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"", pid);
+    out += line;
+    for (char c : process_name) {
+        if (c == '"' || c == '\\') out += '\\';
+        if (static_cast<unsigned char>(c) >= 0x20) out += c;
+    }
+    out += "\"}}";
+
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    std::vector<TraceEvent> copy;
+    for (const auto& ring : rings) {
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        uint64_t first = std::max(head > RING_CAPACITY ? head - RING_CAPACITY : 0, ring->floor.load(std::memory_order_relaxed));
+        copy.clear();
+        for (uint64_t i = first; i < head; ++i) copy.push_back(ring->events[i % RING_CAPACITY]);
+        // Anything the writer lapped during the copy (or is writing right now) may be torn; drop it
+        uint64_t after = ring->head.load(std::memory_order_acquire) + 1;
+        std::size_t skip = after > RING_CAPACITY + first ? static_cast<std::size_t>(after - RING_CAPACITY - first) : 0;
+        if (skip > copy.size()) skip = copy.size();
+
+        std::snprintf(line, sizeof(line), ",{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+                      pid, ring->tid, ring->tid);
+        out += line;
+        for (std::size_t i = skip; i < copy.size(); ++i) {
+            const TraceEvent& event = copy[i];
+            char hex[3 * MAX_BYTES + 1] = {0};
+            int used = 0;
+            for (uint8_t b = 0; b < event.bytes; ++b) {
+                used += std::snprintf(hex + used, sizeof(hex) - used, b ? " %02x" : "%02x", event.data[b]);
+            }
+            // Chrome wants microseconds; keep the nanoseconds as a fraction
+            int64_t ts = to_session(event.timestamp_ns);
+            std::snprintf(line, sizeof(line),
+                          ",{\"name\":\"%s\",\"cat\":\"midi\",\"ph\":\"i\",\"s\":\"t\",\"pid\":%d,\"tid\":%d,"
+                          "\"ts\":%lld.%03lld,\"args\":{\"id\":\"%08x\",\"msg\":\"%s\"}}",
+                          stage_name(event.stage), pid, ring->tid,
+                          static_cast<long long>(ts / 1000), static_cast<long long>((ts % 1000 + 1000) % 1000),
+                          event_id(event), hex);
+            out += line;
+        }
+    }
+    out += "]}";
+    return out;
+}
+
+void Trace::clear() {
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    for (auto& ring : rings) ring->floor.store(ring->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+}
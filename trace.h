@@ -0,0 +1,66 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <string>
+
+// Per-stage timestamps for MIDI events on their way from one player's controller to
+// another player's synth. Each thread appends to its own fixed-size ring (no locks, no
+// allocation after the first event), and a dump turns every ring into Chrome trace
+// JSON (chrome://tracing, Perfetto). Events are correlated across processes by an id
+// hashed from the MIDI bytes with the channel masked out, since clients rewrite it.
+//
+// Building with -DMIDIJAM_TRACING=OFF compiles the MIDIJAM_TRACE macros out entirely;
+// otherwise a disabled tracer costs one relaxed load and a predictable branch.
+class Trace {
+public:
+    enum Stage : uint8_t {
+        MIDI_IN,        // Client: RtMidi callback entry
+        CLIENT_SEND,    // Client: UDP send completed
+        SERVER_RECEIVE, // Server: receive completion
+        SERVER_FANOUT,  // Server: queued to every peer
+        SERVER_SEND,    // Server: UDP send to one peer completed
+        CLIENT_RECEIVE, // Peer client: receive completion
+        MIDI_OUT,       // Peer client: handed to RtMidi
+        STAGE_COUNT
+    };
+
+#ifdef MIDIJAM_TRACING
+    static constexpr bool COMPILED_IN = true;
+#else
+    static constexpr bool COMPILED_IN = false;
+#endif
+    static constexpr std::size_t RING_CAPACITY = 16384; // Events kept per thread
+    static constexpr std::size_t MAX_BYTES = 8;         // MIDI bytes kept per event
+
+    static bool enabled() noexcept { return enabled_.load(std::memory_order_relaxed); }
+    static void set_enabled(bool enabled) noexcept { enabled_.store(enabled, std::memory_order_relaxed); }
+
+    static int64_t now_ns() noexcept;
+    static void record(Stage stage, int64_t timestamp_ns, const void* data, std::size_t bytes) noexcept;
+
+    // Chrome trace JSON of everything still in the rings. `to_session` maps local
+    // steady-clock timestamps onto the shared session clock so dumps from the server
+    // and every client can be merged into one timeline.
+    static std::string chrome_json(const std::string& process_name, int pid,
+                                   const std::function<int64_t(int64_t)>& to_session);
+    static void clear();
+
+private:
+    static std::atomic<bool> enabled_;
+};
+
+#ifdef MIDIJAM_TRACING
+#define MIDIJAM_TRACE_AT(stage, timestamp_ns, data, bytes) \
+    do { if (Trace::enabled()) Trace::record((stage), (timestamp_ns), (data), (bytes)); } while (0)
+#define MIDIJAM_TRACE(stage, data, bytes) \
+    do { if (Trace::enabled()) Trace::record((stage), Trace::now_ns(), (data), (bytes)); } while (0)
+#else
+#define MIDIJAM_TRACE_AT(stage, timestamp_ns, data, bytes) do { } while (0)
+#define MIDIJAM_TRACE(stage, data, bytes) do { } while (0)
+#endif
+
+#endif
@@ -0,0 +1,173 @@
+#include "ump.h"
+#include "jam_protocol.h"
+#include "midi_message.h"
+
+static_assert(JamProtocol::TAG_SIZE == 4, "UMP words must stay aligned after the tag");
+
+uint32_t Ump::scale_up(uint32_t value, unsigned from_bits, unsigned to_bits) noexcept {
+    const unsigned scale_bits = to_bits - from_bits;
+    uint32_t shifted = value << scale_bits;
+    const uint32_t center = 1u << (from_bits - 1);
+    if (value <= center) return shifted;
+    // Above the center, repeat the bits below the top one to fill the new low bits
+    const unsigned repeat_bits = from_bits - 1;
+    uint32_t repeat = value & ((1u << repeat_bits) - 1);
+    repeat = scale_bits > repeat_bits ? repeat << (scale_bits - repeat_bits) : repeat >> (repeat_bits - scale_bits);
+    while (repeat != 0) {
+        shifted |= repeat;
+        repeat >>= repeat_bits;
+    }
+    return shifted;
+}
+
+bool Ump::is_packet(const char* data, std::size_t bytes) noexcept {
+    return JamProtocol::has_header(data, bytes, JamProtocol::UMP_TAG, TAG_SIZE + 4) &&
+           (bytes - TAG_SIZE) % 4 == 0 && (bytes - TAG_SIZE) / 4 <= MAX_WORDS;
+}
+
+uint32_t Ump::read_word(const char* in) noexcept {
+    return JamProtocol::read_u32(in);
+}
+
+void Ump::write_word(char* out, uint32_t word) noexcept {
+    JamProtocol::write_u32(out, word);
+}
+
+static void append_word(std::vector<char>& packet, uint32_t word) {
+    std::size_t at = packet.size();
+    packet.resize(at + 4);
+    Ump::write_word(packet.data() + at, word);
+}
+
+static uint32_t channel_voice(uint8_t status, uint8_t index1, uint8_t index2) noexcept {
+    return (static_cast<uint32_t>(Ump::TYPE_MIDI2_CHANNEL) << 28) | (static_cast<uint32_t>(status) << 16) |
+           (static_cast<uint32_t>(index1) << 8) | index2;
+}
+
+bool Ump::from_midi1(const uint8_t* data, std::size_t bytes, std::vector<char>& packet, std::size_t& dropped) {
+    packet.resize(TAG_SIZE);
+    JamProtocol::write_tag(packet.data(), JamProtocol::UMP_TAG);
+    dropped = 0;
+    MidiMessage::for_each(data, bytes, [&packet, &dropped](const uint8_t* msg, std::size_t len) {
+        uint8_t status = msg[0];
+        if (status == 0xF0) return;
+        std::size_t words = MidiMessage::is_channel_message(status) ? 2 : 1;
+        if ((packet.size() - TAG_SIZE) / 4 + words > MAX_WORDS) {
+            ++dropped;
+            return;
+        }
+        uint8_t data1 = len > 1 ? msg[1] : 0;
+        uint8_t data2 = len > 2 ? msg[2] : 0;
+        if (!MidiMessage::is_channel_message(status)) {
+            append_word(packet, (static_cast<uint32_t>(TYPE_SYSTEM) << 28) | (static_cast<uint32_t>(status) << 16) |
+                                (static_cast<uint32_t>(data1) << 8) | data2);
+            return;
+        }
+        switch (MidiMessage::type(status)) {
+            case 0x90:
+                if (data2 == 0) status = 0x80 | MidiMessage::channel(status);
+                [[fallthrough]];
+            case 0x80:
+                append_word(packet, channel_voice(status, data1, 0));
+                append_word(packet, scale_up(data2, 7, 16) << 16);
+                break;
+            case 0xA0: case 0xB0:
+                append_word(packet, channel_voice(status, data1, 0));
+                append_word(packet, scale_up(data2, 7, 32));
+                break;
+            case 0xC0:
+                append_word(packet, channel_voice(status, 0, 0)); // Option flags: no bank
+                append_word(packet, static_cast<uint32_t>(data1) << 24);
+                break;
+            case 0xD0:
+                append_word(packet, channel_voice(status, 0, 0));
+                append_word(packet, scale_up(data1, 7, 32));
+                break;
+            default: // 0xE0, pitch bend
+                append_word(packet, channel_voice(status, 0, 0));
+                append_word(packet, scale_up(data1 | (data2 << 7), 14, 32));
+                break;
+        }
+    });
+    return packet.size() > TAG_SIZE;
+}
+
+static void append_bytes(std::vector<char>& out, uint8_t status, uint8_t data1, uint8_t data2, std::size_t len) {
+    out.push_back(static_cast<char>(status));
+    if (len > 1) out.push_back(static_cast<char>(data1 & 0x7F));
+    if (len > 2) out.push_back(static_cast<char>(data2 & 0x7F));
+}
+
+bool Ump::to_midi1(const char* packet, std::size_t bytes, std::vector<char>& out) {
+    out.clear();
+    for_each(packet, bytes, [&out](const uint32_t* words, std::size_t) {
+        uint32_t word = words[0];
+        uint8_t status = Ump::status(word);
+        switch (message_type(word)) {
+            case TYPE_SYSTEM:
+                if (status >= 0xF1 && status != 0xF7) {
+                    append_bytes(out, status, index1(word), index2(word), MidiMessage::expected_length(status));
+                }
+                return;
+            case TYPE_MIDI1_CHANNEL:
+                if (MidiMessage::is_channel_message(status)) {
+                    append_bytes(out, status, index1(word), index2(word), MidiMessage::expected_length(status));
+                }
+                return;
+            case TYPE_MIDI2_CHANNEL:
+                break;
+            default:
+                return; // Utility, SysEx and data messages have no place in a MIDI datagram
+        }
+        uint32_t value = words[1];
+        uint8_t channel = Ump::channel(word);
+        switch (status >> 4) {
+            case 0x8:
+                append_bytes(out, status, index1(word), static_cast<uint8_t>(scale_down(value >> 16, 16, 7)), 3);
+                break;
+            case 0x9: {
+                // A soft MIDI 2.0 note must not turn into a MIDI 1.0 note off
+                uint8_t velocity = static_cast<uint8_t>(scale_down(value >> 16, 16, 7));
+                append_bytes(out, status, index1(word), velocity == 0 ? 1 : velocity, 3);
+                break;
+            }
+            case 0xA: case 0xB:
+                append_bytes(out, status, index1(word), static_cast<uint8_t>(scale_down(value, 32, 7)), 3);
+                break;
+            case 0xC:
+                if (index2(word) & 0x01) { // Bank valid
+                    append_bytes(out, 0xB0 | channel, 0, static_cast<uint8_t>(value >> 8), 3);
+                    append_bytes(out, 0xB0 | channel, 32, static_cast<uint8_t>(value), 3);
+                }
+                append_bytes(out, status, static_cast<uint8_t>(value >> 24), 0, 2);
+                break;
+            case 0xD:
+                append_bytes(out, status, static_cast<uint8_t>(scale_down(value, 32, 7)), 0, 2);
+                break;
+            case 0xE: {
+                uint32_t bend = scale_down(value, 32, 14);
+                append_bytes(out, status, static_cast<uint8_t>(bend), static_cast<uint8_t>(bend >> 7), 3);
+                break;
+            }
+            case 0x2: case 0x3: {
+                // Registered / assignable controller: parameter number, then a 14-bit data entry
+                bool registered = (status >> 4) == 0x2;
+                uint32_t entry = scale_down(value, 32, 14);
+                append_bytes(out, 0xB0 | channel, registered ? 101 : 99, index1(word), 3);
+                append_bytes(out, 0xB0 | channel, registered ? 100 : 98, index2(word), 3);
+                append_bytes(out, 0xB0 | channel, 6, static_cast<uint8_t>(entry >> 7), 3);
+                append_bytes(out, 0xB0 | channel, 38, static_cast<uint8_t>(entry), 3);
+                break;
+            }
+            default:
+                break; // Per-note controllers and management
+        }
+    });
+    return !out.empty();
+}
+
+bool Ump::translate(const char* data, std::size_t bytes, std::vector<char>& out, std::size_t& dropped) {
+    dropped = 0;
+    if (is_packet(data, bytes)) return to_midi1(data, bytes, out);
+    return from_midi1(reinterpret_cast<const uint8_t*>(data), bytes, out, dropped);
+}
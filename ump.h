@@ -0,0 +1,84 @@
+#ifndef UMP_H
+#define UMP_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// MIDI 2.0 Universal MIDI Packets, the optional wire format next to raw MIDI 1.0 bytes.
+// A UMP datagram is JamProtocol::UMP_TAG followed by whole 32-bit words, little-endian,
+// so every message is one or two word loads instead of a status-byte walk. Channel voice
+// messages travel as MIDI 2.0 (message type 4, 64-bit) with 16-bit velocity and 32-bit
+// controllers; system common and realtime as type 1 (32-bit). SysEx stays on SYSX fragments.
+// Translation follows the MIDI 2.0 translation and bit-scaling rules, so a MIDI 1.0 message
+// scaled up and back down comes out with the same values.
+class Ump {
+public:
+    static constexpr uint8_t TYPE_SYSTEM = 0x1;         // 32-bit system common and realtime
+    static constexpr uint8_t TYPE_MIDI1_CHANNEL = 0x2;  // 32-bit MIDI 1.0 channel voice, accepted on input
+    static constexpr uint8_t TYPE_MIDI2_CHANNEL = 0x4;  // 64-bit MIDI 2.0 channel voice
+    static constexpr std::size_t MAX_WORDS = 64;        // Per datagram
+
+    static constexpr uint8_t message_type(uint32_t word) noexcept { return static_cast<uint8_t>(word >> 28); }
+    // Words in a message, from the type of its first word
+    static constexpr std::size_t word_count(uint32_t word) noexcept {
+        constexpr uint8_t counts[16] = {1, 1, 1, 2, 2, 4, 1, 1, 2, 2, 2, 3, 3, 4, 4, 4};
+        return counts[message_type(word)];
+    }
+    static constexpr bool is_channel_voice(uint32_t word) noexcept {
+        return message_type(word) == TYPE_MIDI1_CHANNEL || message_type(word) == TYPE_MIDI2_CHANNEL;
+    }
+    static constexpr uint8_t group(uint32_t word) noexcept { return static_cast<uint8_t>(word >> 24) & 0x0F; }
+    // Status nibble and channel share a byte, as in MIDI 1.0
+    static constexpr uint8_t status(uint32_t word) noexcept { return static_cast<uint8_t>(word >> 16); }
+    static constexpr uint8_t channel(uint32_t word) noexcept { return static_cast<uint8_t>(word >> 16) & 0x0F; }
+    static constexpr uint8_t index1(uint32_t word) noexcept { return static_cast<uint8_t>(word >> 8); }
+    static constexpr uint8_t index2(uint32_t word) noexcept { return static_cast<uint8_t>(word); }
+
+    // Min-center-max scaling: 0 stays 0, the center stays the center, the maximum becomes
+    // the maximum, and scale_down(scale_up(v)) == v
+    static uint32_t scale_up(uint32_t value, unsigned from_bits, unsigned to_bits) noexcept;
+    static constexpr uint32_t scale_down(uint32_t value, unsigned from_bits, unsigned to_bits) noexcept {
+        return value >> (from_bits - to_bits);
+    }
+
+    // True for a UMP_TAG datagram of 1 to MAX_WORDS whole words
+    static bool is_packet(const char* data, std::size_t bytes) noexcept;
+    static uint32_t read_word(const char* in) noexcept;
+    static void write_word(char* out, uint32_t word) noexcept;
+
+    // Calls `f(const uint32_t* words, std::size_t count)` for every complete message of a datagram
+    template <typename F>
+    static void for_each(const char* packet, std::size_t bytes, F&& f) {
+        const std::size_t total = (bytes - TAG_SIZE) / 4;
+        std::size_t i = 0;
+        while (i < total) {
+            uint32_t words[4];
+            words[0] = read_word(packet + TAG_SIZE + 4 * i);
+            std::size_t count = word_count(words[0]);
+            if (i + count > total) return;
+            for (std::size_t w = 1; w < count; ++w) words[w] = read_word(packet + TAG_SIZE + 4 * (i + w));
+            f(static_cast<const uint32_t*>(words), count);
+            i += count;
+        }
+    }
+
+    // MIDI 1.0 bytes (several messages, running status) to a UMP datagram; SysEx is skipped.
+    // A Note On with velocity 0 becomes a Note Off, as MIDI 2.0 has no such shorthand.
+    // Messages past MAX_WORDS don't fit one datagram and are counted in `dropped` (32
+    // channel messages fit, far more than one controller event or layered split produces).
+    // False if nothing was left to send.
+    static bool from_midi1(const uint8_t* data, std::size_t bytes, std::vector<char>& packet, std::size_t& dropped);
+    // A UMP datagram to MIDI 1.0 bytes. RPN/NRPN become their CC 101/100/6/38 (99/98)
+    // sequences and a bank-valid Program Change its bank selects; messages with no MIDI 1.0
+    // equivalent are dropped. False if nothing was left.
+    static bool to_midi1(const char* packet, std::size_t bytes, std::vector<char>& out);
+    // Whichever of the two a datagram isn't: raw MIDI becomes UMP and the other way round.
+    // `dropped` counts MIDI 1.0 messages that did not fit the UMP datagram.
+    static bool translate(const char* data, std::size_t bytes, std::vector<char>& out, std::size_t& dropped);
+
+private:
+    static constexpr std::size_t TAG_SIZE = 4; // JamProtocol::TAG_SIZE, without pulling it in here
+};
+
+#endif
@@ -0,0 +1,447 @@
+#include "uring_io.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+
+namespace {
+
+// user_data: what completed, in the top byte, and which socket or send slot below it
+constexpr uint64_t KIND_SHIFT = 56;
+constexpr uint64_t KIND_RECEIVE = 1;
+constexpr uint64_t KIND_SEND = 2;
+constexpr uint64_t KIND_CANCEL = 3;
+constexpr uint64_t KIND_WAKE = 4;
+constexpr uint64_t KIND_TEST = 5;
+constexpr uint16_t BUFFER_GROUP = 0;
+constexpr std::size_t NAME_SIZE = sizeof(sockaddr_in6); // Source address space in each receive buffer
+
+uint64_t tag(uint64_t kind, uint64_t index) noexcept {
+    return (kind << KIND_SHIFT) | index;
+}
+
+int enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) noexcept {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+std::string error_text(const char* what) {
+    return std::string(what) + ": " + std::strerror(errno);
+}
+
+thread_local const UringIo* ring_thread_of = nullptr; // Set on the thread inside run()
+
+} // namespace
+
+struct UringIo::Ring {
+    int fd = -1;
+    void* sq_map = MAP_FAILED;
+    std::size_t sq_map_size = 0;
+    void* cq_map = MAP_FAILED;
+    std::size_t cq_map_size = 0;
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    std::size_t sqes_size = 0;
+    unsigned* sq_head = nullptr;
+    unsigned* sq_tail = nullptr;
+    unsigned* sq_array = nullptr;
+    unsigned sq_mask = 0;
+    unsigned sq_entries = 0;
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    io_uring_cqe* cqes = nullptr;
+    unsigned cq_mask = 0;
+    // The provided buffer ring as plain entries: io_uring_buf_ring's flexible array member
+    // doesn't lay out at offset 0 under C++. The kernel reads the tail from bufs[0].resv.
+    io_uring_buf* buffer_ring = static_cast<io_uring_buf*>(MAP_FAILED);
+    std::size_t buffer_ring_size = 0;
+    uint16_t buffer_tail = 0; // Ours; published to the kernel with a release store
+
+    ~Ring() {
+        if (buffer_ring != MAP_FAILED) munmap(buffer_ring, buffer_ring_size);
+        if (sqes != MAP_FAILED) munmap(sqes, sqes_size);
+        if (cq_map != MAP_FAILED && cq_map != sq_map) munmap(cq_map, cq_map_size);
+        if (sq_map != MAP_FAILED) munmap(sq_map, sq_map_size);
+        if (fd >= 0) close(fd); // Cancels whatever is still in flight
+    }
+};
+
+struct UringIo::SendSlot {
+    msghdr message{};
+    iovec parts[2]{};
+    sockaddr_storage to{};
+    std::shared_ptr<SendHandler> done; // Shared by the datagrams of one send()
+    std::size_t datagram = 0;
+};
+
+struct UringIo::Socket {
+    int fd = -1;
+    msghdr message{}; // Only reserves the source address space; buffers come from the pool
+    bool wanted = false; // start_receive was called and stop_receive wasn't
+    bool armed = false;  // A multishot receive is in the kernel
+};
+
+UringIo::UringIo(std::size_t datagram_size, ReceiveHandler on_receive)
+    : ring_(new Ring), on_receive_(std::move(on_receive)), datagram_size_(datagram_size),
+      buffer_stride_(sizeof(io_uring_recvmsg_out) + NAME_SIZE + datagram_size), slots_(MAX_SENDS) {
+    Ring& ring = *ring_;
+    try {
+        io_uring_params params{};
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = CQ_ENTRIES;
+        ring.fd = static_cast<int>(syscall(__NR_io_uring_setup, SQ_ENTRIES, &params));
+        if (ring.fd < 0) throw std::runtime_error(error_text("io_uring_setup"));
+        if (!(params.features & IORING_FEAT_NODROP)) throw std::runtime_error("kernel may drop completions (no IORING_FEAT_NODROP)");
+
+        ring.sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        ring.cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_map = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_map) ring.sq_map_size = ring.cq_map_size = std::max(ring.sq_map_size, ring.cq_map_size);
+        ring.sq_map = mmap(nullptr, ring.sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+        if (ring.sq_map == MAP_FAILED) throw std::runtime_error(error_text("mmap of the submission ring"));
+        ring.cq_map = single_map ? ring.sq_map
+                                 : mmap(nullptr, ring.cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_CQ_RING);
+        if (ring.cq_map == MAP_FAILED) throw std::runtime_error(error_text("mmap of the completion ring"));
+        ring.sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        ring.sqes = static_cast<io_uring_sqe*>(mmap(nullptr, ring.sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                                    ring.fd, IORING_OFF_SQES));
+        if (ring.sqes == MAP_FAILED) throw std::runtime_error(error_text("mmap of the submission entries"));
+
+        char* sq = static_cast<char*>(ring.sq_map);
+        ring.sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        ring.sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        ring.sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        ring.sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        ring.sq_entries = params.sq_entries;
+        char* cq = static_cast<char*>(ring.cq_map);
+        ring.cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        ring.cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        ring.cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        ring.cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+
+        // Receive buffers: the kernel picks one per datagram, we hand it back once handled
+        ring.buffer_ring_size = BUFFER_COUNT * sizeof(io_uring_buf);
+        ring.buffer_ring = static_cast<io_uring_buf*>(mmap(nullptr, ring.buffer_ring_size, PROT_READ | PROT_WRITE,
+                                                    MAP_ANONYMOUS | MAP_PRIVATE, -1, 0));
+        if (ring.buffer_ring == MAP_FAILED) throw std::runtime_error(error_text("mmap of the buffer ring"));
+        io_uring_buf_reg registration{};
+        registration.ring_addr = reinterpret_cast<uint64_t>(ring.buffer_ring);
+        registration.ring_entries = BUFFER_COUNT;
+        registration.bgid = BUFFER_GROUP;
+        if (syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_PBUF_RING, &registration, 1) != 0) {
+            throw std::runtime_error(error_text("provided buffer ring"));
+        }
+        buffers_.resize(BUFFER_COUNT * buffer_stride_);
+        for (unsigned i = 0; i < BUFFER_COUNT; ++i) recycle(static_cast<uint16_t>(i));
+
+        free_slots_.reserve(MAX_SENDS);
+        for (std::size_t i = MAX_SENDS; i > 0; --i) free_slots_.push_back(static_cast<uint32_t>(i - 1));
+        self_test();
+    } catch (...) {
+        delete ring_;
+        ring_ = nullptr;
+        throw;
+    }
+}
+
+UringIo::~UringIo() {
+    delete ring_;
+}
+
+std::size_t UringIo::add_socket(int fd) {
+    std::lock_guard<std::mutex> lock(submit_mutex_);
+    sockets_.emplace_back();
+    sockets_.back().fd = fd;
+    sockets_.back().message.msg_namelen = NAME_SIZE;
+    return sockets_.size() - 1;
+}
+
+unsigned UringIo::sq_space() const noexcept {
+    return ring_->sq_entries - (*ring_->sq_tail - __atomic_load_n(ring_->sq_head, __ATOMIC_ACQUIRE));
+}
+
+bool UringIo::queue(const void* prepared) {
+    Ring& ring = *ring_;
+    unsigned tail = *ring.sq_tail;
+    if (tail - __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE) >= ring.sq_entries) {
+        submit_locked(); // Full: the kernel consumes what is queued during the enter
+        if (tail - __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE) >= ring.sq_entries) return false;
+    }
+    unsigned index = tail & ring.sq_mask;
+    std::memcpy(&ring.sqes[index], prepared, sizeof(io_uring_sqe));
+    ring.sq_array[index] = index;
+    __atomic_store_n(ring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ++unsubmitted_;
+    return true;
+}
+
+void UringIo::submit_locked() {
+    while (unsubmitted_ > 0) {
+        int submitted = enter(ring_->fd, unsubmitted_, 0, 0);
+        if (submitted < 0) {
+            if (errno == EINTR) continue;
+            return; // EAGAIN/EBUSY: the ring thread submits them with its next enter
+        }
+        unsubmitted_ -= std::min(unsubmitted_, static_cast<unsigned>(submitted));
+        if (submitted == 0) return;
+    }
+}
+
+void UringIo::arm(std::size_t socket) {
+    io_uring_sqe sqe{};
+    sqe.opcode = IORING_OP_RECVMSG;
+    sqe.fd = sockets_[socket].fd;
+    sqe.addr = reinterpret_cast<uint64_t>(&sockets_[socket].message);
+    sqe.ioprio = IORING_RECV_MULTISHOT;
+    sqe.flags = IOSQE_BUFFER_SELECT;
+    sqe.buf_group = BUFFER_GROUP;
+    sqe.user_data = tag(KIND_RECEIVE, socket);
+    if (queue(&sqe)) {
+        sockets_[socket].armed = true;
+        ++active_receives_;
+    }
+}
+
+void UringIo::start_receive(std::size_t socket) {
+    std::lock_guard<std::mutex> lock(submit_mutex_);
+    sockets_[socket].wanted = true;
+    if (!sockets_[socket].armed) arm(socket);
+    if (ring_thread_of != this) submit_locked();
+}
+
+void UringIo::stop_receive(std::size_t socket) {
+    std::lock_guard<std::mutex> lock(submit_mutex_);
+    sockets_[socket].wanted = false;
+    if (!sockets_[socket].armed) return;
+    io_uring_sqe sqe{};
+    sqe.opcode = IORING_OP_ASYNC_CANCEL;
+    sqe.fd = -1;
+    sqe.addr = tag(KIND_RECEIVE, socket);
+    sqe.user_data = tag(KIND_CANCEL, socket);
+    queue(&sqe);
+    if (ring_thread_of != this) submit_locked();
+}
+
+bool UringIo::send(std::size_t socket, const sockaddr* to, std::size_t to_size, const Datagram* datagrams, std::size_t count,
+                   SendHandler done) {
+    if (count == 0 || count > MAX_SEND_BATCH || to_size > sizeof(sockaddr_storage)) return false;
+    std::lock_guard<std::mutex> lock(submit_mutex_);
+    if (free_slots_.size() < count) return false;
+    // Keep the batch in one submit: the kernel issues its SQEs in order
+    if (sq_space() < count) submit_locked();
+    if (sq_space() < count) return false;
+    auto handler = std::make_shared<SendHandler>(std::move(done));
+    for (std::size_t i = 0; i < count; ++i) {
+        uint32_t index = free_slots_.back();
+        free_slots_.pop_back();
+        SendSlot& slot = slots_[index];
+        std::memcpy(&slot.to, to, to_size);
+        slot.parts[0] = iovec{const_cast<void*>(datagrams[i].data), datagrams[i].bytes};
+        slot.parts[1] = iovec{const_cast<void*>(datagrams[i].extra), datagrams[i].extra_bytes};
+        slot.message = msghdr{};
+        slot.message.msg_name = &slot.to;
+        slot.message.msg_namelen = static_cast<socklen_t>(to_size);
+        slot.message.msg_iov = slot.parts;
+        slot.message.msg_iovlen = datagrams[i].extra_bytes > 0 ? 2 : 1;
+        slot.done = handler;
+        slot.datagram = i;
+        io_uring_sqe sqe{};
+        sqe.opcode = IORING_OP_SENDMSG;
+        sqe.fd = sockets_[socket].fd;
+        sqe.addr = reinterpret_cast<uint64_t>(&slot.message);
+        sqe.len = 1;
+        // Not linked: a failed send (ENOBUFS, say) would cancel every later one to this peer
+        sqe.user_data = tag(KIND_SEND, index);
+        queue(&sqe);
+    }
+    // The ring thread submits a whole fan-out with its next enter; anyone else right away
+    if (ring_thread_of != this) submit_locked();
+    return true;
+}
+
+void UringIo::recycle(uint16_t buffer) noexcept {
+    Ring& ring = *ring_;
+    io_uring_buf& entry = ring.buffer_ring[ring.buffer_tail & (BUFFER_COUNT - 1)];
+    entry.addr = reinterpret_cast<uint64_t>(buffers_.data() + buffer * buffer_stride_);
+    entry.len = static_cast<uint32_t>(buffer_stride_);
+    entry.bid = buffer;
+    ++ring.buffer_tail;
+    __atomic_store_n(&ring.buffer_ring[0].resv, ring.buffer_tail, __ATOMIC_RELEASE);
+}
+
+void UringIo::handle_completion(uint64_t user_data, int32_t result, uint32_t flags) {
+    uint64_t kind = user_data >> KIND_SHIFT;
+    std::size_t index = static_cast<std::size_t>(user_data & ((uint64_t(1) << KIND_SHIFT) - 1));
+    if (kind == KIND_RECEIVE) {
+        if (flags & IORING_CQE_F_BUFFER) {
+            uint16_t buffer = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+            char* base = buffers_.data() + buffer * buffer_stride_;
+            auto* header = reinterpret_cast<io_uring_recvmsg_out*>(base);
+            if (result > 0 && !(header->flags & MSG_TRUNC) && header->payloadlen > 0) {
+                char* name = base + sizeof(io_uring_recvmsg_out);
+                char* payload = name + NAME_SIZE;
+                on_receive_(index, payload, header->payloadlen, reinterpret_cast<const sockaddr*>(name),
+                            std::min<std::size_t>(header->namelen, NAME_SIZE));
+            }
+            recycle(buffer);
+        }
+        if (!(flags & IORING_CQE_F_MORE)) {
+            // Ended: cancelled, out of buffers for a moment, or the socket is gone
+            std::lock_guard<std::mutex> lock(submit_mutex_);
+            sockets_[index].armed = false;
+            --active_receives_;
+            // Cancelled but wanted again: start_receive came before the cancellation finished
+            bool restart = result >= 0 || result == -ENOBUFS || result == -EINTR || result == -EAGAIN || result == -ECANCELED;
+            if (sockets_[index].wanted && restart && running_) arm(index);
+        }
+    } else if (kind == KIND_SEND) {
+        std::shared_ptr<SendHandler> done;
+        std::size_t datagram;
+        {
+            std::lock_guard<std::mutex> lock(submit_mutex_);
+            done = std::move(slots_[index].done);
+            datagram = slots_[index].datagram;
+            free_slots_.push_back(static_cast<uint32_t>(index));
+        }
+        if (done) (*done)(datagram, result);
+    }
+}
+
+void UringIo::run() {
+    Ring& ring = *ring_;
+    ring_thread_of = this;
+    while (running_) {
+        unsigned to_submit;
+        {
+            std::lock_guard<std::mutex> lock(submit_mutex_);
+            to_submit = unsubmitted_;
+            unsubmitted_ = 0;
+        }
+        int submitted = enter(ring.fd, to_submit, 1, IORING_ENTER_GETEVENTS);
+        if (submitted < static_cast<int>(to_submit)) {
+            std::lock_guard<std::mutex> lock(submit_mutex_);
+            unsubmitted_ += to_submit - static_cast<unsigned>(std::max(submitted, 0));
+        }
+        if (submitted < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) break;
+        unsigned head = *ring.cq_head;
+        for (unsigned n = 0; n < COMPLETION_BATCH && head != __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE); ++n) {
+            io_uring_cqe cqe = ring.cqes[head & ring.cq_mask];
+            __atomic_store_n(ring.cq_head, ++head, __ATOMIC_RELEASE);
+            handle_completion(cqe.user_data, cqe.res, cqe.flags);
+        }
+    }
+    ring_thread_of = nullptr;
+}
+
+void UringIo::stop() {
+    running_ = false;
+    std::lock_guard<std::mutex> lock(submit_mutex_);
+    io_uring_sqe sqe{};
+    sqe.opcode = IORING_OP_NOP;
+    sqe.user_data = tag(KIND_WAKE, 0);
+    queue(&sqe);
+    if (ring_thread_of != this) submit_locked();
+}
+
+// Multishot receive into provided buffers needs Linux 6.0; older kernels reject the SQE.
+// A datagram to ourselves shows whether it works before any client depends on it.
+void UringIo::self_test() {
+    Ring& ring = *ring_;
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) throw std::runtime_error(error_text("self-test socket"));
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t address_size = sizeof(address);
+    msghdr message{};
+    message.msg_namelen = NAME_SIZE;
+    std::string failure;
+    if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        getsockname(fd, reinterpret_cast<sockaddr*>(&address), &address_size) != 0 ||
+        sendto(fd, "T", 1, 0, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 1) {
+        failure = error_text("self-test datagram");
+    }
+    io_uring_sqe sqe{};
+    sqe.opcode = IORING_OP_RECVMSG;
+    sqe.fd = fd;
+    sqe.addr = reinterpret_cast<uint64_t>(&message);
+    sqe.ioprio = IORING_RECV_MULTISHOT;
+    sqe.flags = IOSQE_BUFFER_SELECT;
+    sqe.buf_group = BUFFER_GROUP;
+    sqe.user_data = tag(KIND_TEST, 0);
+    bool received = false;
+    bool ended = false;
+    if (failure.empty()) {
+        std::lock_guard<std::mutex> lock(submit_mutex_);
+        queue(&sqe);
+        submit_locked();
+    }
+    // Wait for the datagram, then cancel and wait for the receive to end
+    while (failure.empty() && !ended) {
+        if (enter(ring.fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+            failure = error_text("io_uring_enter");
+            break;
+        }
+        unsigned head = *ring.cq_head;
+        while (head != __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE)) {
+            io_uring_cqe cqe = ring.cqes[head & ring.cq_mask];
+            __atomic_store_n(ring.cq_head, ++head, __ATOMIC_RELEASE);
+            if (cqe.user_data != tag(KIND_TEST, 0)) continue;
+            if (cqe.flags & IORING_CQE_F_BUFFER) recycle(static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT));
+            if (!received) {
+                received = true;
+                if (cqe.res <= 0 || !(cqe.flags & IORING_CQE_F_MORE)) {
+                    failure = std::string("multishot receive unsupported (") +
+                              (cqe.res < 0 ? std::strerror(-cqe.res) : "ended after one datagram") + ")";
+                    ended = !(cqe.flags & IORING_CQE_F_MORE);
+                } else {
+                    io_uring_sqe cancel{};
+                    cancel.opcode = IORING_OP_ASYNC_CANCEL;
+                    cancel.fd = -1;
+                    cancel.addr = tag(KIND_TEST, 0);
+                    cancel.user_data = tag(KIND_CANCEL, 0);
+                    std::lock_guard<std::mutex> lock(submit_mutex_);
+                    queue(&cancel);
+                    submit_locked();
+                }
+            } else if (!(cqe.flags & IORING_CQE_F_MORE)) {
+                ended = true;
+            }
+        }
+    }
+    close(fd);
+    if (!failure.empty()) throw std::runtime_error(failure);
+}
+
+#else
+
+struct UringIo::Ring {};
+struct UringIo::SendSlot {};
+struct UringIo::Socket {};
+
+UringIo::UringIo(std::size_t datagram_size, ReceiveHandler on_receive)
+    : on_receive_(std::move(on_receive)), datagram_size_(datagram_size), buffer_stride_(0) {
+    throw std::runtime_error("io_uring is only available on Linux");
+}
+
+UringIo::~UringIo() = default;
+std::size_t UringIo::add_socket(int) { return 0; }
+void UringIo::start_receive(std::size_t) {}
+void UringIo::stop_receive(std::size_t) {}
+bool UringIo::send(std::size_t, const sockaddr*, std::size_t, const Datagram*, std::size_t, SendHandler) {
+    return false;
+}
+void UringIo::run() {}
+void UringIo::stop() {}
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef URING_IO_H
+#define URING_IO_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+struct sockaddr;
+
+// The server's optional io_uring datagram path (-io uring), next to Boost.Asio. One ring
+// owns every listening socket: a multishot receive per socket fills buffers from a fixed,
+// kernel-provided pool, so a datagram costs one completion instead of a wakeup plus a
+// receive call, and nothing has to re-arm between packets. Sends to one peer go into the
+// same submission, so the kernel issues them in order, and the ring thread submits
+// everything a batch of datagrams produced (a whole fan-out) with one io_uring_enter,
+// which also waits for the next completions. Sends from other threads (timers, shutdown) are submitted at once.
+// Plain syscalls, no liburing; Linux only.
+class UringIo {
+public:
+#ifdef __linux__
+    static constexpr bool SUPPORTED = true;
+#else
+    static constexpr bool SUPPORTED = false;
+#endif
+    static constexpr unsigned SQ_ENTRIES = 1024;
+    static constexpr unsigned CQ_ENTRIES = 8192;    // Multishot receives complete many times per SQE
+    static constexpr unsigned BUFFER_COUNT = 1024;  // Receive buffers shared by every socket, a power of two
+    static constexpr std::size_t MAX_SENDS = 4096;  // Datagrams in flight
+    static constexpr std::size_t MAX_SEND_BATCH = 32; // Datagrams per send()
+    static constexpr unsigned COMPLETION_BATCH = 16; // Handled between submits, so a receive burst can't starve sends
+
+    // `data` is writable and valid until the handler returns; runs on the ring thread
+    using ReceiveHandler = std::function<void(std::size_t socket, char* data, std::size_t bytes,
+                                              const sockaddr* from, std::size_t from_size)>;
+    // Once per datagram of a send(): its index and the bytes sent, or -errno. Each datagram
+    // succeeds or fails on its own. Runs on the ring thread.
+    using SendHandler = std::function<void(std::size_t datagram, int result)>;
+
+    // One datagram: `data` plus an optional second buffer (a MAC trailer)
+    struct Datagram {
+        const void* data;
+        std::size_t bytes;
+        const void* extra;
+        std::size_t extra_bytes;
+    };
+
+    // Sets up the ring and checks that the kernel supports everything used here (multishot
+    // receive, provided buffer rings: Linux 6.0). Throws std::runtime_error otherwise, so
+    // the caller can stay on Asio.
+    UringIo(std::size_t datagram_size, ReceiveHandler on_receive);
+    ~UringIo();
+    UringIo(const UringIo&) = delete;
+    UringIo& operator=(const UringIo&) = delete;
+
+    // Index for start_receive/send; the descriptor stays owned by the caller. Add every
+    // socket before the first start_receive.
+    std::size_t add_socket(int fd);
+    void start_receive(std::size_t socket);
+    // Cancels the socket's receive; datagrams already in buffers are still handled
+    void stop_receive(std::size_t socket);
+    // Receives armed or still winding down after stop_receive
+    int active_receives() const noexcept { return active_receives_.load(); }
+
+    // Queues up to MAX_SEND_BATCH datagrams to `to`, sent in order. Their buffers must stay valid
+    // until `done` has run for each; keep them alive in its captures. False if the ring or
+    // the send slots are full, in which case nothing is sent and `done` never runs.
+    bool send(std::size_t socket, const sockaddr* to, std::size_t to_size, const Datagram* datagrams, std::size_t count,
+              SendHandler done);
+
+    // Processes completions on the calling thread until stop()
+    void run();
+    void stop();
+
+private:
+    struct Ring;
+    struct SendSlot;
+    struct Socket;
+
+    bool queue(const void* sqe); // Copies a prepared SQE into the ring; requires submit_mutex_
+    unsigned sq_space() const noexcept; // Requires submit_mutex_
+    void submit_locked();        // Requires submit_mutex_
+    void arm(std::size_t socket);
+    void handle_completion(uint64_t user_data, int32_t result, uint32_t flags);
+    void recycle(uint16_t buffer) noexcept;
+    void self_test();
+
+    Ring* ring_ = nullptr;
+    ReceiveHandler on_receive_;
+    std::size_t datagram_size_;
+    std::size_t buffer_stride_; // recvmsg header + source address + datagram
+    std::vector<char> buffers_;
+    std::vector<Socket> sockets_;
+    std::vector<SendSlot> slots_;
+    std::vector<uint32_t> free_slots_;
+    std::mutex submit_mutex_;   // Guards the SQ, unsubmitted_, slots and free_slots_
+    unsigned unsubmitted_ = 0;
+    std::atomic<int> active_receives_{0};
+    std::atomic<bool> running_{true};
+};
+
+#endif